@@ -9,7 +9,7 @@ extern MemModInit
 [section .text]
 [bits 32]
 _start:
-AppModInit: ; 0xF000
+AppModInit: ; 0x30000
     push ebp
     mov ebp, esp
     
@@ -0,0 +1,887 @@
+#include "ahci.h"
+#include "pci.h"
+#include "memory.h"
+#include "utility.h"
+#include "task.h"
+#include "interrupt.h"
+#include "iostat.h"
+
+#define HBA_CAP         0x00
+#define HBA_GHC         0x04
+#define HBA_IS          0x08
+#define HBA_PI          0x0C
+
+#define CAP_SNCQ        (1 << 30)
+#define GHC_AE          (1 << 31)
+#define GHC_IE          (1 << 1)
+
+#define PORT_BASE       0x100
+#define PORT_SIZE       0x80
+
+#define PX_CLB          0x00
+#define PX_CLBU         0x04
+#define PX_FB           0x08
+#define PX_FBU          0x0C
+#define PX_IS           0x10
+#define PX_IE           0x14
+#define PX_CMD          0x18
+#define PX_TFD          0x20
+#define PX_SIG          0x24
+#define PX_SSTS         0x28
+#define PX_SERR         0x30
+#define PX_SACT         0x34
+#define PX_CI           0x38
+
+#define PX_CMD_ST       (1 << 0)
+#define PX_CMD_FRE      (1 << 4)
+#define PX_CMD_FR       (1 << 14)
+#define PX_CMD_CR       (1 << 15)
+
+#define PX_IS_DHRS      (1 << 0)
+#define PX_IS_SDBS      (1 << 3)
+#define PX_IS_TFES      (1 << 30)
+
+#define SIG_ATA         0x00000101
+#define SSTS_DET_OK     3
+
+#define FIS_H2D         0x27
+#define FIS_CMD         0x80
+#define FIS_LBA         0x40
+
+#define ATA_IDENTIFY    0xEC
+#define ATA_READ_DMA    0xC8
+#define ATA_WRITE_DMA   0xCA
+#define ATA_READ_DMA_EXT    0x25
+#define ATA_WRITE_DMA_EXT   0x35
+#define ATA_READ_FPDMA      0x60
+#define ATA_WRITE_FPDMA     0x61
+#define ATA_FLUSH           0xE7
+#define ATA_FLUSH_EXT       0xEA
+#define ATA_READ_LOG_EXT    0x2F
+#define ATA_LOG_NCQ         0x10
+
+#define AHCI_SLOT_MAX   32
+#define AHCI_BATCH_MAX  8
+#define AHCI_PRD_MAX    8
+#define AHCI_PRD_BYTES  0x400000
+#define AHCI_TABLE_SIZE (0x80 + AHCI_PRD_MAX * 16)
+#define AHCI_SPIN_MAX   1000000
+#define AHCI_NONE       0xFFFFFFFF
+
+#define ATA_MAX_SECTORS     256
+#define ATA_MAX_SECTORS_EXT 65536
+
+typedef struct
+{
+    uint flags;
+    uint count;
+    uint table;
+    uint tableHi;
+    uint reserved[4];
+} CmdHeader;
+
+typedef struct
+{
+    uint addr;
+    uint addrHi;
+    uint reserved;
+    uint count;
+} PRDEntry;
+
+typedef struct
+{
+    byte fis[64];
+    byte acmd[16];
+    byte reserved[48];
+    PRDEntry prd[AHCI_PRD_MAX];
+} CmdTable;
+
+typedef struct
+{
+    uint si;
+    uint n;
+    uint write;
+    uint batch;
+    uint segs;
+    uint state;
+    IOSpan span;
+} AHCIReq;
+
+typedef struct
+{
+    Queue wait;
+    uint value;
+    uint left;
+    uint failed;
+    uint state;
+    BlkDone done;
+    void* arg;
+} AHCIBatch;
+
+static volatile byte* gHba = NULL;
+static volatile byte* gPort = NULL;
+static uint gPortNo = 0;
+static uint gIrq = -1;
+static uint gSectors = 0;
+static uint gLba48 = 0;
+static uint gNcq = 0;
+static uint gSlots = 0;
+static volatile CmdHeader* gList = NULL;
+static volatile CmdTable* gTable = NULL;
+static uint gActive = 0;
+static AHCIReq gReq[AHCI_SLOT_MAX] = {0};
+static AHCIBatch gBatch[AHCI_BATCH_MAX] = {0};
+static uint gOpen = AHCI_BATCH_MAX;
+static uint gLast = AHCI_NONE;
+static uint gSyncDone = 0;
+static uint gSyncOk = 0;
+static byte* gBounce = NULL;
+static uint gStat = IOSTAT_DEV_MAX;
+
+static uint Reg(uint off)
+{
+    return *(volatile uint*)(gHba + off);
+}
+
+static void SetReg(uint off, uint value)
+{
+    *(volatile uint*)(gHba + off) = value;
+}
+
+static uint PortReg(uint off)
+{
+    return *(volatile uint*)(gPort + off);
+}
+
+static void SetPortReg(uint off, uint value)
+{
+    *(volatile uint*)(gPort + off) = value;
+}
+
+static uint WaitClear(uint off, uint mask)
+{
+    uint i = 0;
+    
+    while( (PortReg(off) & mask) && (++i < AHCI_SPIN_MAX) );
+    
+    return !(PortReg(off) & mask);
+}
+
+static void StopPort()
+{
+    SetPortReg(PX_CMD, PortReg(PX_CMD) & ~PX_CMD_ST);
+    
+    WaitClear(PX_CMD, PX_CMD_CR);
+    
+    SetPortReg(PX_CMD, PortReg(PX_CMD) & ~PX_CMD_FRE);
+    
+    WaitClear(PX_CMD, PX_CMD_FR);
+}
+
+static void StartPort()
+{
+    WaitClear(PX_CMD, PX_CMD_CR);
+    
+    SetPortReg(PX_SERR, -1);
+    SetPortReg(PX_IS, -1);
+    SetPortReg(PX_CMD, PortReg(PX_CMD) | PX_CMD_FRE);
+    SetPortReg(PX_CMD, PortReg(PX_CMD) | PX_CMD_ST);
+}
+
+static uint FreeSlot()
+{
+    uint ret = 0;
+    
+    while( (ret < gSlots) && gReq[ret].state )
+    {
+        ret++;
+    }
+    
+    return (ret < gSlots) ? ret : AHCI_NONE;
+}
+
+static void SetPrd(uint slot, uint i, byte* buf, uint n)
+{
+    volatile PRDEntry* prd = &gTable[slot].prd[i];
+    
+    prd->addr = (uint)buf;
+    prd->addrHi = 0;
+    prd->reserved = 0;
+    prd->count = n * SECT_SIZE - 1;
+}
+
+static void SetFis(uint slot, uint cmd, uint si, uint n)
+{
+    volatile byte* fis = gTable[slot].fis;
+    uint ncq = (cmd == ATA_READ_FPDMA) || (cmd == ATA_WRITE_FPDMA);
+    
+    MemSet((byte*)fis, 0, sizeof(gTable[slot].fis));
+    
+    fis[0] = FIS_H2D;
+    fis[1] = FIS_CMD;
+    fis[2] = cmd;
+    fis[4] = si & 0xFF;
+    fis[5] = (si >> 8) & 0xFF;
+    fis[6] = (si >> 16) & 0xFF;
+    fis[7] = FIS_LBA | (gLba48 ? 0 : ((si >> 24) & 0x0F));
+    fis[8] = gLba48 ? ((si >> 24) & 0xFF) : 0;
+    
+    if( ncq )
+    {
+        fis[3] = n & 0xFF;
+        fis[11] = (n >> 8) & 0xFF;
+        fis[12] = slot << 3;
+    }
+    else
+    {
+        fis[12] = n & 0xFF;
+        fis[13] = (n >> 8) & 0xFF;
+    }
+}
+
+static uint Command(uint write)
+{
+    uint ret = 0;
+    
+    if( gNcq )
+    {
+        ret = write ? ATA_WRITE_FPDMA : ATA_READ_FPDMA;
+    }
+    else if( gLba48 )
+    {
+        ret = write ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT;
+    }
+    else
+    {
+        ret = write ? ATA_WRITE_DMA : ATA_READ_DMA;
+    }
+    
+    return ret;
+}
+
+static uint MaxSectors()
+{
+    return (gNcq || gLba48) ? ATA_MAX_SECTORS_EXT : ATA_MAX_SECTORS;
+}
+
+static void Build(uint slot, uint si, byte* buf, uint n, uint write, uint batch)
+{
+    AHCIReq* req = &gReq[slot];
+    
+    SetPrd(slot, 0, buf, n);
+    
+    req->si = si;
+    req->n = n;
+    req->write = write;
+    req->batch = batch;
+    req->segs = 1;
+    req->state = 1;
+    
+    IOStatBegin(gStat, &req->span);
+}
+
+static void Append(uint slot, byte* buf, uint n)
+{
+    AHCIReq* req = &gReq[slot];
+    
+    SetPrd(slot, req->segs, buf, n);
+    
+    req->n += n;
+    req->segs++;
+}
+
+static void Issue(uint slot, uint cmd, uint si, uint n, uint segs, uint write)
+{
+    volatile CmdHeader* hdr = &gList[slot];
+    
+    SetFis(slot, cmd, si, n);
+    
+    hdr->flags = 5 | (write ? 0x40 : 0) | (segs << 16);
+    hdr->count = 0;
+    hdr->table = (uint)&gTable[slot];
+    hdr->tableHi = 0;
+    
+    asm volatile("" : : : "memory");
+    
+    gActive |= 1 << slot;
+    
+    if( (cmd == ATA_READ_FPDMA) || (cmd == ATA_WRITE_FPDMA) )
+    {
+        SetPortReg(PX_SACT, 1 << slot);
+    }
+    
+    SetPortReg(PX_CI, 1 << slot);
+}
+
+static void IssueAll()
+{
+    uint i = 0;
+    
+    for(i=0; i<gSlots; i++)
+    {
+        AHCIReq* req = &gReq[i];
+        
+        if( req->state == 1 )
+        {
+            req->state = 2;
+            
+            Issue(i, Command(req->write), req->si, req->n, req->segs, req->write);
+        }
+    }
+    
+    gLast = AHCI_NONE;
+}
+
+static void Wake(AHCIBatch* b)
+{
+    Event evt = {DiskEvent, (uint)&b->wait, b->failed ? -1 : b->value, 0};
+    
+    b->state = 0;
+    
+    if( b->done )
+    {
+        b->done(b->arg, !b->failed);
+    }
+    else
+    {
+        EventSchedule(NOTIFY, &evt);
+    }
+}
+
+static void Complete(uint slot, uint ok)
+{
+    AHCIReq* req = &gReq[slot];
+    
+    if( req->n )
+    {
+        IOStatEnd(gStat, &req->span, req->si, req->n, (req->write ? IO_WRITE : IO_READ) | ((req->batch < AHCI_BATCH_MAX) ? IO_ASYNC : 0), ok);
+    }
+    
+    if( req->batch < AHCI_BATCH_MAX )
+    {
+        AHCIBatch* b = &gBatch[req->batch];
+        
+        b->failed = b->failed || !ok;
+        b->left--;
+        
+        if( !b->left && (b->state == 2) )
+        {
+            Wake(b);
+        }
+    }
+    else
+    {
+        gSyncDone = 1;
+        gSyncOk = ok;
+    }
+    
+    req->state = 0;
+    
+    gActive &= ~(1 << slot);
+}
+
+static void Recover()
+{
+    uint failed = gActive;
+    uint log = AHCI_NONE;
+    uint i = 0;
+    
+    StopPort();
+    StartPort();
+    
+    for(i=0; i<gSlots; i++)
+    {
+        if( failed & (1 << i) )
+        {
+            Complete(i, 0);
+            
+            log = (log == AHCI_NONE) ? i : log;
+        }
+    }
+    
+    if( gNcq && (log != AHCI_NONE) )
+    {
+        SetPrd(log, 0, gBounce, 1);
+        
+        Issue(log, ATA_READ_LOG_EXT, ATA_LOG_NCQ, 1, 1, 0);
+        
+        WaitClear(PX_CI, 1 << log);
+        
+        gActive &= ~(1 << log);
+    }
+}
+
+static void Reap()
+{
+    uint done = gActive & ~(PortReg(PX_SACT) | PortReg(PX_CI));
+    uint i = 0;
+    
+    for(i=0; done && (i<gSlots); i++)
+    {
+        if( done & (1 << i) )
+        {
+            Complete(i, 1);
+        }
+    }
+    
+    if( PortReg(PX_IS) & PX_IS_TFES )
+    {
+        Recover();
+    }
+}
+
+static uint Overlaps(uint si, uint n)
+{
+    uint ret = 0;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<gSlots); i++)
+    {
+        AHCIReq* req = &gReq[i];
+        
+        ret = req->state && (si < req->si + req->n) && (req->si < si + n);
+    }
+    
+    return ret;
+}
+
+static uint Busy()
+{
+    uint ret = 0;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<gSlots); i++)
+    {
+        ret = gReq[i].state;
+    }
+    
+    return ret;
+}
+
+static void Drain()
+{
+    uint i = 0;
+    
+    IssueAll();
+    
+    while( Busy() && (++i < AHCI_SPIN_MAX) )
+    {
+        Reap();
+    }
+}
+
+static uint Settle(uint si, uint n)
+{
+    uint ret = FreeSlot();
+    uint i = 0;
+    
+    if( Overlaps(si, n) || (ret == AHCI_NONE) )
+    {
+        IssueAll();
+        
+        while( (Overlaps(si, n) || ((ret = FreeSlot()) == AHCI_NONE)) && (++i < AHCI_SPIN_MAX) )
+        {
+            Reap();
+        }
+    }
+    
+    return ret;
+}
+
+static uint Poll()
+{
+    uint i = 0;
+    
+    while( !gSyncDone && (++i < AHCI_SPIN_MAX) )
+    {
+        Reap();
+    }
+    
+    IOStatWait(gStat, NULL, !gSyncDone);
+    
+    return gSyncOk;
+}
+
+static uint Run(uint si, byte* buf, uint n, uint write)
+{
+    uint slot = Settle(si, n);
+    
+    gSyncDone = 0;
+    gSyncOk = 0;
+    
+    if( slot != AHCI_NONE )
+    {
+        Build(slot, si, buf, n, write, AHCI_BATCH_MAX);
+        
+        IssueAll();
+    }
+    
+    return (slot != AHCI_NONE) && Poll();
+}
+
+static uint Special(uint cmd, byte* buf)
+{
+    Drain();
+    
+    gSyncDone = 0;
+    gSyncOk = 0;
+    
+    gReq[0].n = 0;
+    gReq[0].batch = AHCI_BATCH_MAX;
+    gReq[0].state = 2;
+    
+    if( buf )
+    {
+        SetPrd(0, 0, buf, 1);
+    }
+    
+    Issue(0, cmd, 0, 0, !!buf, 0);
+    
+    return Poll();
+}
+
+static uint CanDma(byte* buf, uint n)
+{
+    return !((uint)buf & 1) && ((uint)buf + n * SECT_SIZE <= FMapBase);
+}
+
+static uint Transfer(uint si, byte* buf, uint n, uint write)
+{
+    uint ret = 0;
+    
+    if( CanDma(buf, n) )
+    {
+        uint ok = 1;
+        uint max = Min(MaxSectors(), AHCI_PRD_BYTES / SECT_SIZE);
+        
+        for(ret=0; ok && (ret<n); ret+=Min(n - ret, max))
+        {
+            ok = Run(si + ret, AddrOff(buf, ret * SECT_SIZE), Min(n - ret, max), write);
+        }
+        
+        ret = ok ? n : 0;
+    }
+    else if( gBounce )
+    {
+        uint ok = 1;
+        
+        for(ret=0; ok && (ret<n); ret+=ok)
+        {
+            byte* p = AddrOff(buf, ret * SECT_SIZE);
+            
+            if( write )
+            {
+                MemCpy(gBounce, p, SECT_SIZE);
+            }
+            
+            ok = Run(si + ret, gBounce, 1, write);
+            
+            if( ok && !write )
+            {
+                MemCpy(p, gBounce, SECT_SIZE);
+            }
+        }
+    }
+    
+    return ret;
+}
+
+static uint AHCISectors(const BlkDev* dev)
+{
+    return gSectors;
+}
+
+static uint AHCIRead(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        ret = Transfer(si, buf, n, 0);
+    }
+    
+    return ret;
+}
+
+static uint AHCIWrite(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        ret = Transfer(si, buf, n, 1);
+    }
+    
+    return ret;
+}
+
+static uint AHCIFlush(const BlkDev* dev)
+{
+    return Special(gLba48 ? ATA_FLUSH_EXT : ATA_FLUSH, NULL);
+}
+
+static uint NewBatch()
+{
+    uint ret = 0;
+    
+    while( (ret < AHCI_BATCH_MAX) && gBatch[ret].state )
+    {
+        ret++;
+    }
+    
+    if( ret < AHCI_BATCH_MAX )
+    {
+        gBatch[ret].state = 1;
+        gBatch[ret].left = 0;
+        gBatch[ret].failed = 0;
+        gBatch[ret].done = NULL;
+    }
+    
+    return ret;
+}
+
+static uint AHCIQueue(const BlkDev* dev, uint si, byte* buf, uint n, uint write)
+{
+    uint ret = 0;
+    AHCIReq* last = (gLast != AHCI_NONE) ? &gReq[gLast] : NULL;
+    uint max = Min(MaxSectors(), AHCI_PRD_BYTES / SECT_SIZE);
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf && CanDma(buf, n) && (n <= max) )
+    {
+        if( last && (last->state == 1) && (last->si + last->n == si) && (last->write == write) &&
+            (last->segs < AHCI_PRD_MAX) && (last->n + n <= MaxSectors()) && !Overlaps(si, n) )
+        {
+            Append(gLast, buf, n);
+            
+            ret = n;
+        }
+        else
+        {
+            uint slot = 0;
+            
+            if( Overlaps(si, n) )
+            {
+                Settle(si, n);
+            }
+            
+            slot = FreeSlot();
+            
+            if( (slot != AHCI_NONE) && ((gOpen < AHCI_BATCH_MAX) || ((gOpen = NewBatch()) < AHCI_BATCH_MAX)) )
+            {
+                Build(slot, si, buf, n, write, gOpen);
+                
+                gBatch[gOpen].left++;
+                gLast = slot;
+                
+                ret = n;
+            }
+        }
+    }
+    
+    return ret;
+}
+
+static uint AHCISubmit(const BlkDev* dev, uint* result, uint value)
+{
+    uint ret = 0;
+    AHCIBatch* b = (gOpen < AHCI_BATCH_MAX) ? &gBatch[gOpen] : NULL;
+    Event* evt = NULL;
+    
+    gOpen = AHCI_BATCH_MAX;
+    
+    IssueAll();
+    
+    if( b && b->left && (gIrq < 16) && result && (evt = CreateEvent(DiskEvent, (uint)&b->wait, (uint)result, 0)) )
+    {
+        b->value = value;
+        b->state = 2;
+        
+        EventSchedule(WAIT, evt);
+        
+        ret = 1;
+    }
+    else if( b )
+    {
+        uint i = 0;
+        
+        while( b->left && (++i < AHCI_SPIN_MAX) )
+        {
+            Reap();
+        }
+        
+        if( result && (b->failed || b->left) )
+        {
+            *result = -1;
+        }
+        
+        b->state = 0;
+    }
+    
+    return ret;
+}
+
+static void AHCIStart(const BlkDev* dev, BlkDone done, void* arg)
+{
+    AHCIBatch* b = (gOpen < AHCI_BATCH_MAX) ? &gBatch[gOpen] : NULL;
+    
+    gOpen = AHCI_BATCH_MAX;
+    
+    IssueAll();
+    
+    if( b && b->left && (gIrq < 16) )
+    {
+        b->done = done;
+        b->arg = arg;
+        b->state = 2;
+    }
+    else
+    {
+        uint i = 0;
+        
+        while( b && b->left && (++i < AHCI_SPIN_MAX) )
+        {
+            Reap();
+        }
+        
+        if( b )
+        {
+            b->state = 0;
+        }
+        
+        done(arg, !(b && (b->failed || b->left)));
+    }
+}
+
+static const BlkDev gAHCIDev = {"sd", NULL, AHCISectors, AHCIRead, AHCIWrite, AHCIFlush, AHCIQueue, AHCISubmit, AHCIStart};
+
+static uint FindPort()
+{
+    uint ret = 0;
+    uint pi = Reg(HBA_PI);
+    uint i = 0;
+    
+    for(i=0; !ret && (i<32); i++)
+    {
+        gPort = gHba + PORT_BASE + i * PORT_SIZE;
+        gPortNo = i;
+        
+        ret = (pi & (1 << i)) && ((PortReg(PX_SSTS) & 0x0F) == SSTS_DET_OK) && (PortReg(PX_SIG) == SIG_ATA);
+    }
+    
+    return ret;
+}
+
+static uint SetupPort()
+{
+    uint ret = 0;
+    uint size = AHCI_SLOT_MAX * sizeof(CmdHeader) + 256 + AHCI_SLOT_MAX * AHCI_TABLE_SIZE;
+    byte* mem = Malloc(size + 1024);
+    
+    gBounce = Malloc(SECT_SIZE);
+    
+    if( mem && gBounce )
+    {
+        byte* base = (byte*)(((uint)mem + 1023) / 1024 * 1024);
+        byte* fis = AddrOff(base, AHCI_SLOT_MAX * sizeof(CmdHeader));
+        
+        MemSet(base, 0, size);
+        
+        gList = (CmdHeader*)base;
+        gTable = (CmdTable*)AddrOff(fis, 256);
+        
+        StopPort();
+        
+        SetPortReg(PX_CLB, (uint)gList);
+        SetPortReg(PX_CLBU, 0);
+        SetPortReg(PX_FB, (uint)fis);
+        SetPortReg(PX_FBU, 0);
+        
+        StartPort();
+        
+        ret = 1;
+    }
+    
+    return ret;
+}
+
+static void Identify()
+{
+    gSlots = 1;
+    
+    if( Special(ATA_IDENTIFY, gBounce) )
+    {
+        ushort* data = (ushort*)gBounce;
+        uint depth = (data[75] & 0x1F) + 1;
+        
+        gLba48 = !!(data[83] & 0x400);
+        gSectors = gLba48 ? ((data[101] << 16) | data[100]) : ((data[61] << 16) | data[60]);
+        
+        if( gLba48 && (data[102] || data[103] || (gSectors == -1)) )
+        {
+            gSectors = -2;
+        }
+        
+        gSlots = Min(((Reg(HBA_CAP) >> 8) & 0x1F) + 1, AHCI_SLOT_MAX);
+        gNcq = gLba48 && (Reg(HBA_CAP) & CAP_SNCQ) && (data[76] & 0x100);
+        
+        if( gNcq )
+        {
+            gSlots = Min(gSlots, depth);
+        }
+    }
+}
+
+void AHCIModInit()
+{
+    uint dev = PCIFind(0x01, 0x06);
+    uint i = 0;
+    
+    if( dev && (((PCIRead(dev, PCI_CLASS) >> 8) & 0xFF) == 0x01) )
+    {
+        gHba = (byte*)(PCIRead(dev, PCI_BAR5) & 0xFFFFFFF0);
+        
+        PCIWrite(dev, PCI_COMMAND, (PCIRead(dev, PCI_COMMAND) | 0x06) & ~0x400);
+        
+        SetReg(HBA_GHC, Reg(HBA_GHC) | GHC_AE);
+        
+        if( FindPort() && SetupPort() )
+        {
+            Identify();
+            
+            if( gSectors )
+            {
+                gIrq = PCIRead(dev, PCI_IRQ_LINE) & 0xFF;
+                gStat = IOStatAdd(gAHCIDev.name);
+                
+                AddDiskIrq(gIrq);
+                
+                SetPortReg(PX_IS, -1);
+                SetPortReg(PX_IE, PX_IS_DHRS | PX_IS_SDBS | PX_IS_TFES);
+                SetReg(HBA_IS, -1);
+                SetReg(HBA_GHC, Reg(HBA_GHC) | GHC_IE);
+            }
+        }
+    }
+    
+    for(i=0; i<AHCI_BATCH_MAX; i++)
+    {
+        Queue_Init(&gBatch[i].wait);
+    }
+}
+
+const BlkDev* AHCIDevice()
+{
+    return gSectors ? &gAHCIDev : NULL;
+}
+
+void AHCIIrq()
+{
+    if( gSectors && (Reg(HBA_IS) & (1 << gPortNo)) )
+    {
+        SetPortReg(PX_IS, PortReg(PX_IS) & ~PX_IS_TFES);
+        
+        Reap();
+        
+        SetReg(HBA_IS, 1 << gPortNo);
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include "blkdev.h"
+
+void AHCIModInit();
+const BlkDev* AHCIDevice();
+void AHCIIrq();
+
+#endif
@@ -4,11 +4,57 @@
 
 #include "type.h"
 
+enum
+{
+    FS_FAILED,
+    FS_SUCCEED,
+    FS_EXISTED,
+    FS_NONEXISTED
+};
+
+enum
+{
+    FS_ADV_NORMAL,
+    FS_ADV_SEQUENTIAL,
+    FS_ADV_RANDOM,
+    FS_ADV_WILLNEED,
+    FS_ADV_DONTNEED
+};
+
+enum
+{
+    FS_WATCH_WRITE  = 0x01,
+    FS_WATCH_APPEND = 0x02,
+    FS_WATCH_CREATE = 0x04,
+    FS_WATCH_DELETE = 0x08
+};
+
+enum
+{
+    FS_DEV_HD,
+    FS_DEV_RAM,
+    FS_DEV_VIRTIO,
+    FS_DEV_AHCI,
+    FS_DEV_STRIPE
+};
+
 typedef struct 
 {
     const char* name;
     void (*tmain)();
     byte priority;
+    byte background;
 } AppInfo;
 
+typedef struct
+{
+    uint fd;
+    const char* name;
+    const char* other;
+    byte* buf;
+    uint len;
+    uint pos;
+    uint ret;
+} FileParam;
+
 #endif
@@ -0,0 +1,23 @@
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include "type.h"
+
+#define SECT_SIZE    512
+
+typedef void (*BlkDone)(void* arg, uint ok);
+
+typedef struct _BlkDev
+{
+    const char* name;
+    void* data;
+    uint (*sectors)(const struct _BlkDev* dev);
+    uint (*read)(const struct _BlkDev* dev, uint si, byte* buf, uint n);
+    uint (*write)(const struct _BlkDev* dev, uint si, byte* buf, uint n);
+    uint (*flush)(const struct _BlkDev* dev);
+    uint (*queue)(const struct _BlkDev* dev, uint si, byte* buf, uint n, uint write);
+    uint (*submit)(const struct _BlkDev* dev, uint* result, uint value);
+    void (*start)(const struct _BlkDev* dev, BlkDone done, void* arg);
+} BlkDev;
+
+#endif
@@ -0,0 +1,747 @@
+
+#include "btree.h"
+#include "utility.h"
+
+#ifdef DTFSER
+#include <malloc.h>
+#include "fs.h"
+#define Malloc malloc
+#define Free free
+#else
+#include "memory.h"
+#include "syscall.h"
+#endif
+
+#define BT_MAGIC      "BTREE01"
+#define BT_PAGE_SIZE  512
+#define BT_CACHE_CNT  16
+#define BT_GROW_PAGES 64
+#define BT_VALUE_MAX  64
+#define BT_META_PAGE  0
+#define BT_NONE       ((uint)-1)
+#define BT_HEAD_SIZE  sizeof(BTPageHead)
+#define BT_INNER_CAP  ((BT_PAGE_SIZE - BT_HEAD_SIZE - sizeof(uint)) / (2 * sizeof(uint)))
+
+enum
+{
+    BT_FAIL,
+    BT_DONE,
+    BT_SPLIT
+};
+
+enum
+{
+    BT_LEAF = 1,
+    BT_INNER
+};
+
+typedef struct
+{
+    uint type;
+    uint cnt;
+    uint next;
+    uint reserved;
+} BTPageHead;
+
+typedef struct
+{
+    char magic[8];
+    uint root;
+    uint pages;
+    uint valSize;
+    uint count;
+} BTMeta;
+
+typedef struct
+{
+    uint page;
+    uint dirty;
+    uint stamp;
+    byte data[BT_PAGE_SIZE];
+} BTSlot;
+
+typedef struct
+{
+    uint fd;
+    BTMeta meta;
+    uint leafCap;
+    uint size;
+    uint clock;
+    uint added;
+    BTSlot slot[BT_CACHE_CNT];
+    byte page[BT_PAGE_SIZE];
+    byte value[BT_VALUE_MAX];
+} BTree;
+
+static BTPageHead* Head(BTSlot* s)
+{
+    return (BTPageHead*)s->data;
+}
+
+static uint* Keys(BTSlot* s)
+{
+    return (uint*)AddrOff(s->data, BT_HEAD_SIZE);
+}
+
+static uint* Kids(BTSlot* s)
+{
+    return Keys(s) + BT_INNER_CAP;
+}
+
+static byte* Value(BTree* bt, BTSlot* s, uint i)
+{
+    return AddrOff(s->data, BT_HEAD_SIZE + bt->leafCap * sizeof(uint) + i * bt->meta.valSize);
+}
+
+static void MoveUp(byte* p, uint bytes, uint by)
+{
+    uint i = 0;
+    
+    for(i=bytes; i>0; i--)
+    {
+        p[i - 1 + by] = p[i - 1];
+    }
+}
+
+static uint LowerBound(uint* keys, uint cnt, uint key)
+{
+    uint lo = 0;
+    uint hi = cnt;
+    
+    while( lo < hi )
+    {
+        uint mid = (lo + hi) / 2;
+        
+        if( keys[mid] < key )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    
+    return lo;
+}
+
+static uint UpperBound(uint* keys, uint cnt, uint key)
+{
+    uint lo = 0;
+    uint hi = cnt;
+    
+    while( lo < hi )
+    {
+        uint mid = (lo + hi) / 2;
+        
+        if( keys[mid] <= key )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    
+    return lo;
+}
+
+static uint ReadPage(BTree* bt, uint page, byte* buf)
+{
+    uint pos = page * BT_PAGE_SIZE;
+    
+    return (FSeek(bt->fd, pos) == pos) && (FRead(bt->fd, buf, BT_PAGE_SIZE) == BT_PAGE_SIZE);
+}
+
+static uint WritePage(BTree* bt, uint page, byte* buf)
+{
+    uint pos = page * BT_PAGE_SIZE;
+    
+    return (FSeek(bt->fd, pos) == pos) && (FWrite(bt->fd, buf, BT_PAGE_SIZE) == BT_PAGE_SIZE);
+}
+
+static BTSlot* FindSlot(BTree* bt, uint page)
+{
+    BTSlot* ret = NULL;
+    BTSlot* lru = &bt->slot[0];
+    uint i = 0;
+    
+    for(i=0; !ret && (i<BT_CACHE_CNT); i++)
+    {
+        BTSlot* s = &bt->slot[i];
+        
+        if( s->page == page )
+        {
+            ret = s;
+        }
+        else if( s->stamp < lru->stamp )
+        {
+            lru = s;
+        }
+    }
+    
+    if( !ret && (!lru->dirty || WritePage(bt, lru->page, lru->data)) )
+    {
+        ret = lru;
+        ret->page = BT_NONE;
+        ret->dirty = 0;
+    }
+    
+    return ret;
+}
+
+static BTSlot* GetPage(BTree* bt, uint page)
+{
+    BTSlot* ret = FindSlot(bt, page);
+    
+    if( ret && (ret->page != page) )
+    {
+        if( ReadPage(bt, page, ret->data) )
+        {
+            ret->page = page;
+        }
+        else
+        {
+            ret = NULL;
+        }
+    }
+    
+    if( ret )
+    {
+        ret->stamp = ++bt->clock;
+    }
+    
+    return ret;
+}
+
+static uint GrowFile(BTree* bt)
+{
+    uint pos = bt->size * BT_PAGE_SIZE;
+    uint ret = (FSeek(bt->fd, pos) == pos);
+    uint i = 0;
+    
+    MemSet(bt->page, 0, BT_PAGE_SIZE);
+    
+    for(i=0; ret && (i<BT_GROW_PAGES); i++)
+    {
+        ret = (FWrite(bt->fd, bt->page, BT_PAGE_SIZE) == BT_PAGE_SIZE);
+        
+        bt->size += ret;
+    }
+    
+    return ret;
+}
+
+static BTSlot* NewPage(BTree* bt, uint type)
+{
+    BTSlot* ret = ((bt->meta.pages < bt->size) || GrowFile(bt)) ? FindSlot(bt, bt->meta.pages) : NULL;
+    
+    if( ret )
+    {
+        MemSet(ret->data, 0, BT_PAGE_SIZE);
+        
+        Head(ret)->type = type;
+        
+        ret->page = bt->meta.pages++;
+        ret->dirty = 1;
+        ret->stamp = ++bt->clock;
+    }
+    
+    return ret;
+}
+
+static BTSlot* FindLeaf(BTree* bt, uint key)
+{
+    BTSlot* ret = GetPage(bt, bt->meta.root);
+    
+    while( ret && (Head(ret)->type == BT_INNER) )
+    {
+        ret = GetPage(bt, Kids(ret)[UpperBound(Keys(ret), Head(ret)->cnt, key)]);
+    }
+    
+    return ret;
+}
+
+static void LeafPut(BTree* bt, BTSlot* s, uint pos, uint key, const byte* val)
+{
+    uint cnt = Head(s)->cnt;
+    uint vs = bt->meta.valSize;
+    
+    MoveUp((byte*)&Keys(s)[pos], (cnt - pos) * sizeof(uint), sizeof(uint));
+    MoveUp(Value(bt, s, pos), (cnt - pos) * vs, vs);
+    
+    Keys(s)[pos] = key;
+    MemCpy(Value(bt, s, pos), val, vs);
+    
+    Head(s)->cnt++;
+    s->dirty = 1;
+}
+
+static void InnerPut(BTSlot* s, uint pos, uint key, uint kid)
+{
+    uint cnt = Head(s)->cnt;
+    
+    MoveUp((byte*)&Keys(s)[pos], (cnt - pos) * sizeof(uint), sizeof(uint));
+    MoveUp((byte*)&Kids(s)[pos + 1], (cnt - pos) * sizeof(uint), sizeof(uint));
+    
+    Keys(s)[pos] = key;
+    Kids(s)[pos + 1] = kid;
+    
+    Head(s)->cnt++;
+    s->dirty = 1;
+}
+
+static uint InsertLeaf(BTree* bt, BTSlot* s, uint key, const byte* val, uint* upKey, uint* upPage)
+{
+    uint ret = BT_DONE;
+    uint cnt = Head(s)->cnt;
+    uint pos = LowerBound(Keys(s), cnt, key);
+    
+    if( (pos < cnt) && (Keys(s)[pos] == key) )
+    {
+        MemCpy(Value(bt, s, pos), val, bt->meta.valSize);
+        
+        s->dirty = 1;
+    }
+    else if( cnt < bt->leafCap )
+    {
+        LeafPut(bt, s, pos, key, val);
+        
+        bt->added = 1;
+    }
+    else
+    {
+        uint mid = ((pos == cnt) && !Head(s)->next) ? cnt : (cnt / 2);
+        BTSlot* r = NewPage(bt, BT_LEAF);
+        
+        if( r )
+        {
+            MemCpy(Keys(r), &Keys(s)[mid], (cnt - mid) * sizeof(uint));
+            MemCpy(Value(bt, r, 0), Value(bt, s, mid), (cnt - mid) * bt->meta.valSize);
+            
+            Head(r)->cnt = cnt - mid;
+            Head(r)->next = Head(s)->next;
+            Head(s)->cnt = mid;
+            Head(s)->next = r->page;
+            s->dirty = 1;
+            
+            if( pos < mid )
+            {
+                LeafPut(bt, s, pos, key, val);
+            }
+            else
+            {
+                LeafPut(bt, r, pos - mid, key, val);
+            }
+            
+            *upKey = Keys(r)[0];
+            *upPage = r->page;
+            
+            bt->added = 1;
+            
+            ret = BT_SPLIT;
+        }
+        else
+        {
+            ret = BT_FAIL;
+        }
+    }
+    
+    return ret;
+}
+
+static uint InsertInner(BTree* bt, BTSlot* s, uint pos, uint key, uint kid, uint* upKey, uint* upPage)
+{
+    uint ret = BT_DONE;
+    uint cnt = Head(s)->cnt;
+    
+    if( cnt < BT_INNER_CAP )
+    {
+        InnerPut(s, pos, key, kid);
+    }
+    else
+    {
+        uint mid = (pos == cnt) ? (cnt - 1) : (cnt / 2);
+        BTSlot* r = NewPage(bt, BT_INNER);
+        
+        if( r )
+        {
+            MemCpy(Keys(r), &Keys(s)[mid + 1], (cnt - mid - 1) * sizeof(uint));
+            MemCpy(Kids(r), &Kids(s)[mid + 1], (cnt - mid) * sizeof(uint));
+            
+            *upKey = Keys(s)[mid];
+            *upPage = r->page;
+            
+            Head(r)->cnt = cnt - mid - 1;
+            Head(s)->cnt = mid;
+            s->dirty = 1;
+            
+            if( pos <= mid )
+            {
+                InnerPut(s, pos, key, kid);
+            }
+            else
+            {
+                InnerPut(r, pos - mid - 1, key, kid);
+            }
+            
+            ret = BT_SPLIT;
+        }
+        else
+        {
+            ret = BT_FAIL;
+        }
+    }
+    
+    return ret;
+}
+
+static uint Insert(BTree* bt, uint page, uint key, const byte* val, uint* upKey, uint* upPage)
+{
+    uint ret = BT_FAIL;
+    BTSlot* s = GetPage(bt, page);
+    
+    if( s && (Head(s)->type == BT_LEAF) )
+    {
+        ret = InsertLeaf(bt, s, key, val, upKey, upPage);
+    }
+    else if( s )
+    {
+        uint pos = UpperBound(Keys(s), Head(s)->cnt, key);
+        uint k = 0;
+        uint p = 0;
+        
+        ret = Insert(bt, Kids(s)[pos], key, val, &k, &p);
+        
+        if( ret == BT_SPLIT )
+        {
+            ret = (s = GetPage(bt, page)) ? InsertInner(bt, s, pos, k, p, upKey, upPage) : BT_FAIL;
+        }
+    }
+    
+    return ret;
+}
+
+static void SortOrder(uint* keys, uint* order, uint n)
+{
+    uint gap = 0;
+    uint i = 0;
+    
+    for(gap=n/2; gap>0; gap/=2)
+    {
+        for(i=gap; i<n; i++)
+        {
+            uint o = order[i];
+            uint j = i;
+            
+            while( (j >= gap) && ((keys[order[j - gap]] > keys[o]) || ((keys[order[j - gap]] == keys[o]) && (order[j - gap] > o))) )
+            {
+                order[j] = order[j - gap];
+                j -= gap;
+            }
+            
+            order[j] = o;
+        }
+    }
+}
+
+static uint SaveMeta(BTree* bt)
+{
+    MemSet(bt->page, 0, BT_PAGE_SIZE);
+    MemCpy(bt->page, &bt->meta, sizeof(bt->meta));
+    
+    return WritePage(bt, BT_META_PAGE, bt->page);
+}
+
+static uint LoadMeta(BTree* bt, uint valSize)
+{
+    uint ret = ReadPage(bt, BT_META_PAGE, bt->page);
+    
+    if( ret )
+    {
+        MemCpy(&bt->meta, bt->page, sizeof(bt->meta));
+        
+        ret = StrCmp(bt->meta.magic, BT_MAGIC, -1) && (bt->meta.valSize == valSize);
+    }
+    
+    return ret;
+}
+
+static uint InitTree(BTree* bt, uint valSize)
+{
+    BTSlot* s = NULL;
+    
+    MemSet(&bt->meta, 0, sizeof(bt->meta));
+    StrCpy(bt->meta.magic, BT_MAGIC, sizeof(bt->meta.magic) - 1);
+    
+    bt->meta.valSize = valSize;
+    bt->meta.pages = BT_META_PAGE + 1;
+    
+    s = NewPage(bt, BT_LEAF);
+    
+    if( s )
+    {
+        bt->meta.root = s->page;
+    }
+    
+    return s && BTreeFlush((uint)bt);
+}
+
+uint BTreeOpen(const char* fn, uint valSize)
+{
+    BTree* ret = NULL;
+    uint fd = 0;
+    
+    if( fn && valSize && (valSize <= BT_VALUE_MAX) && ((FExisted(fn) == FS_EXISTED) || (FCreate(fn) == FS_SUCCEED)) && (fd = FOpen(fn)) )
+    {
+        if( (ret = (BTree*)Malloc(sizeof(BTree))) )
+        {
+            uint i = 0;
+            
+            for(i=0; i<BT_CACHE_CNT; i++)
+            {
+                ret->slot[i].page = BT_NONE;
+                ret->slot[i].dirty = 0;
+                ret->slot[i].stamp = 0;
+            }
+            
+            ret->fd = fd;
+            ret->size = FLength(fd) / BT_PAGE_SIZE;
+            ret->clock = 0;
+            ret->leafCap = (BT_PAGE_SIZE - BT_HEAD_SIZE) / (sizeof(uint) + valSize);
+            
+            if( !(FLength(fd) ? LoadMeta(ret, valSize) : InitTree(ret, valSize)) )
+            {
+                Free(ret);
+                
+                ret = NULL;
+            }
+        }
+        
+        if( !ret )
+        {
+            FClose(fd);
+        }
+    }
+    
+    return (uint)ret;
+}
+
+uint BTreeFlush(uint bt)
+{
+    uint ret = 0;
+    BTree* t = (BTree*)bt;
+    
+    if( t )
+    {
+        BTSlot* s = NULL;
+        
+        ret = 1;
+        
+        do
+        {
+            uint i = 0;
+            
+            s = NULL;
+            
+            for(i=0; i<BT_CACHE_CNT; i++)
+            {
+                if( t->slot[i].dirty && (!s || (t->slot[i].page < s->page)) )
+                {
+                    s = &t->slot[i];
+                }
+            }
+            
+            if( s )
+            {
+                ret = WritePage(t, s->page, s->data);
+                
+                s->dirty = !ret;
+            }
+        } while( s && ret );
+        
+        ret = ret && SaveMeta(t) && (FFlush(t->fd) == 1);
+    }
+    
+    return ret;
+}
+
+uint BTreeClose(uint bt)
+{
+    uint ret = BTreeFlush(bt);
+    BTree* t = (BTree*)bt;
+    
+    if( t )
+    {
+        FClose(t->fd);
+        Free(t);
+    }
+    
+    return ret;
+}
+
+uint BTreeGet(uint bt, uint key, void* value)
+{
+    uint ret = 0;
+    BTree* t = (BTree*)bt;
+    BTSlot* s = t ? FindLeaf(t, key) : NULL;
+    
+    if( s )
+    {
+        uint pos = LowerBound(Keys(s), Head(s)->cnt, key);
+        
+        ret = (pos < Head(s)->cnt) && (Keys(s)[pos] == key);
+        
+        if( ret && value )
+        {
+            MemCpy(value, Value(t, s, pos), t->meta.valSize);
+        }
+    }
+    
+    return ret;
+}
+
+uint BTreePut(uint bt, uint key, const void* value)
+{
+    uint ret = 0;
+    BTree* t = (BTree*)bt;
+    
+    if( t && value )
+    {
+        uint k = 0;
+        uint p = 0;
+        
+        t->added = 0;
+        
+        ret = Insert(t, t->meta.root, key, (const byte*)value, &k, &p);
+        
+        if( ret == BT_SPLIT )
+        {
+            BTSlot* s = NewPage(t, BT_INNER);
+            
+            if( s )
+            {
+                Keys(s)[0] = k;
+                Kids(s)[0] = t->meta.root;
+                Kids(s)[1] = p;
+                Head(s)->cnt = 1;
+                
+                t->meta.root = s->page;
+            }
+            
+            ret = s ? BT_DONE : BT_FAIL;
+        }
+        
+        t->meta.count += (ret && t->added);
+        
+        ret = !!ret;
+    }
+    
+    return ret;
+}
+
+uint BTreePutBatch(uint bt, uint* keys, byte* values, uint n)
+{
+    uint ret = 0;
+    BTree* t = (BTree*)bt;
+    uint* order = (t && keys && values && n) ? (uint*)Malloc(n * sizeof(uint)) : NULL;
+    
+    if( order )
+    {
+        uint i = 0;
+        
+        for(i=0; i<n; i++)
+        {
+            order[i] = i;
+        }
+        
+        SortOrder(keys, order, n);
+        
+        for(i=0; i<n; i++)
+        {
+            ret += BTreePut(bt, keys[order[i]], AddrOff(values, order[i] * t->meta.valSize));
+        }
+        
+        Free(order);
+    }
+    
+    return ret;
+}
+
+uint BTreeDelete(uint bt, uint key)
+{
+    uint ret = 0;
+    BTree* t = (BTree*)bt;
+    BTSlot* s = t ? FindLeaf(t, key) : NULL;
+    
+    if( s )
+    {
+        uint cnt = Head(s)->cnt;
+        uint pos = LowerBound(Keys(s), cnt, key);
+        
+        ret = (pos < cnt) && (Keys(s)[pos] == key);
+        
+        if( ret )
+        {
+            uint vs = t->meta.valSize;
+            
+            MemCpy(&Keys(s)[pos], &Keys(s)[pos + 1], (cnt - pos - 1) * sizeof(uint));
+            MemCpy(Value(t, s, pos), Value(t, s, pos + 1), (cnt - pos - 1) * vs);
+            
+            Head(s)->cnt--;
+            s->dirty = 1;
+            
+            t->meta.count--;
+        }
+    }
+    
+    return ret;
+}
+
+uint BTreeScan(uint bt, uint from, uint to, BTreeVisit visit, void* arg)
+{
+    uint ret = 0;
+    BTree* t = (BTree*)bt;
+    BTSlot* s = t ? FindLeaf(t, from) : NULL;
+    uint page = s ? s->page : 0;
+    uint i = s ? LowerBound(Keys(s), Head(s)->cnt, from) : 0;
+    uint go = 1;
+    
+    while( s && go )
+    {
+        if( i < Head(s)->cnt )
+        {
+            uint key = Keys(s)[i++];
+            
+            go = (key <= to);
+            
+            if( go )
+            {
+                MemCpy(t->value, Value(t, s, i - 1), t->meta.valSize);
+                
+                ret++;
+                
+                go = !visit || visit(key, t->value, arg);
+                
+                s = GetPage(t, page);
+            }
+        }
+        else
+        {
+            page = Head(s)->next;
+            
+            s = page ? GetPage(t, page) : NULL;
+            i = 0;
+        }
+    }
+    
+    return ret;
+}
+
+uint BTreeCount(uint bt)
+{
+    BTree* t = (BTree*)bt;
+    
+    return t ? t->meta.count : 0;
+}
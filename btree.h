@@ -0,0 +1,19 @@
+
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "type.h"
+
+typedef uint (*BTreeVisit)(uint key, void* value, void* arg);
+
+uint BTreeOpen(const char* fn, uint valSize);
+uint BTreeClose(uint bt);
+uint BTreeFlush(uint bt);
+uint BTreeGet(uint bt, uint key, void* value);
+uint BTreePut(uint bt, uint key, const void* value);
+uint BTreePutBatch(uint bt, uint* keys, byte* values, uint n);
+uint BTreeDelete(uint bt, uint key);
+uint BTreeScan(uint bt, uint from, uint to, BTreeVisit visit, void* arg);
+uint BTreeCount(uint bt);
+
+#endif
@@ -10,11 +10,15 @@
 #define AppHeapBase    (HeapBase - HeapSize)
 #define PageDirBase    (HeapBase + HeapSize)
 #define PageTblBase    (PageDirBase + 0x1000)
+#define PageSize       0x1000
+
+#define FMapBase       0x800000
+#define FMapSize       0x800000
 
 #define AppStackSize    512
 
 #define BaseOfKernel    0xB000
-#define BaseOfApp       0xF000
+#define BaseOfApp       0x30000
 
 #define BaseOfSharedMemory 0xA000
 #define AppMainEntry       (BaseOfSharedMemory + 36)
@@ -81,5 +85,7 @@
 
 #define    MASTER_EOI_PORT     0x20
 #define    SLAVE_EOI_PORT      0xA0
+#define    MASTER_IMR_PORT     0x21
+#define    SLAVE_IMR_PORT      0xA1
 
 #endif
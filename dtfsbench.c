@@ -0,0 +1,918 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hdfile.h"
+#include "fs.h"
+#include "utility.h"
+#include "btree.h"
+
+#define BUF_SIZE    (1 << 16)
+#define DEF_SECTORS (1 << 19)
+#define KV_LOOKUPS  10000
+#define KV_READS    4
+#define KV_SCANS    1000
+#define KV_SCAN_LEN 100
+#define RING_SCT    64
+#define DEFRAG_IOS  1024
+#define DEDUP_IOS   2048
+
+typedef struct
+{
+    uint ops;
+    uint bytes;
+} BenchCount;
+
+typedef struct BenchCase BenchCase;
+
+typedef uint (*BenchFunc)(const BenchCase* bc, BenchCount* cnt);
+
+struct BenchCase
+{
+    const char* name;
+    BenchFunc setup;
+    BenchFunc run;
+    uint files;
+    uint size;
+    uint chunk;
+};
+
+typedef struct
+{
+    const BenchCase* bc;
+    BenchCount cnt;
+    HDFileStat stat;
+    double usec;
+    uint ok;
+} BenchResult;
+
+static byte gBuf[BUF_SIZE] = {0};
+static uint gSeed = 1;
+
+static uint Rand()
+{
+    gSeed = gSeed * 1103515245 + 12345;
+    
+    return (gSeed >> 16) & 0x7FFF;
+}
+
+static uint Random(uint n)
+{
+    return n ? (((Rand() << 15) | Rand()) % n) : 0;
+}
+
+static const char* FileName(uint i)
+{
+    static char name[32] = {0};
+    
+    snprintf(name, sizeof(name), "bench-%u", i);
+    
+    return name;
+}
+
+static double Now()
+{
+    struct timespec ts = {0};
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint WriteFiles(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = 1;
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        const char* name = FileName(i);
+        uint fd = 0;
+        
+        ret = (FCreate(name) == FS_SUCCEED) && (fd = FOpen(name));
+        
+        if( ret )
+        {
+            uint done = 0;
+            
+            while( ret && (done < bc->size) )
+            {
+                uint n = Min(bc->chunk, bc->size - done);
+                
+                ret = (FWrite(fd, gBuf, n) == n);
+                
+                done += n;
+                cnt->ops++;
+                cnt->bytes += n;
+            }
+            
+            FClose(fd);
+        }
+    }
+    
+    return ret;
+}
+
+static uint ReadWithHint(const BenchCase* bc, BenchCount* cnt, uint hint)
+{
+    uint ret = 1;
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        uint fd = FOpen(FileName(i));
+        
+        if( (ret = !!fd) )
+        {
+            uint n = 0;
+            
+            FAdvise(fd, 0, 0, hint);
+            
+            while( (n = FRead(fd, gBuf, bc->chunk)) > 0 )
+            {
+                cnt->ops++;
+                cnt->bytes += n;
+            }
+            
+            ret = (FLength(fd) == bc->size) && (FTell(fd) == bc->size);
+            
+            FClose(fd);
+        }
+    }
+    
+    return ret;
+}
+
+static uint ReadFiles(const BenchCase* bc, BenchCount* cnt)
+{
+    return ReadWithHint(bc, cnt, FS_ADV_NORMAL);
+}
+
+static uint ReadSequential(const BenchCase* bc, BenchCount* cnt)
+{
+    return ReadWithHint(bc, cnt, FS_ADV_SEQUENTIAL);
+}
+
+static uint RandomRead(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = 1;
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        uint fd = FOpen(FileName(i));
+        
+        if( (ret = !!fd) )
+        {
+            uint j = 0;
+            
+            for(j=0; ret && (j<bc->size/bc->chunk); j++)
+            {
+                uint pos = Random(bc->size - bc->chunk + 1);
+                
+                ret = (FSeek(fd, pos) == pos) && (FRead(fd, gBuf, bc->chunk) == bc->chunk);
+                
+                cnt->ops++;
+                cnt->bytes += bc->chunk;
+            }
+            
+            FClose(fd);
+        }
+    }
+    
+    return ret;
+}
+
+static uint CreateDelete(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = 1;
+    uint* order = (uint*)malloc(bc->files * sizeof(uint));
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        ret = (FCreate(FileName(i)) == FS_SUCCEED);
+        
+        order[i] = i;
+        cnt->ops++;
+    }
+    
+    for(i=bc->files; i>1; i--)
+    {
+        uint j = Random(i);
+        uint t = order[i-1];
+        
+        order[i-1] = order[j];
+        order[j] = t;
+    }
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        ret = (FDelete(FileName(order[i])) == FS_SUCCEED);
+        
+        cnt->ops++;
+    }
+    
+    free(order);
+    
+    return ret;
+}
+
+static uint AppendLog(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = 1;
+    uint* fds = (uint*)calloc(bc->files, sizeof(uint));
+    uint done = 0;
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        const char* name = FileName(i);
+        
+        ret = (FCreate(name) == FS_SUCCEED) && (fds[i] = FOpen(name));
+    }
+    
+    while( ret && (done < bc->size) )
+    {
+        uint n = Min(bc->chunk, bc->size - done);
+        
+        for(i=0; ret && (i<bc->files); i++)
+        {
+            ret = (FWrite(fds[i], gBuf, n) == n) && FFlush(fds[i]);
+            
+            cnt->ops++;
+            cnt->bytes += n;
+        }
+        
+        done += n;
+    }
+    
+    for(i=0; i<bc->files; i++)
+    {
+        if( fds[i] )
+        {
+            ret = ret && (FLength(fds[i]) == bc->size);
+            
+            FClose(fds[i]);
+        }
+    }
+    
+    free(fds);
+    
+    return ret;
+}
+
+static uint RingLog(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = 1;
+    uint* fds = (uint*)calloc(bc->files, sizeof(uint));
+    uint done = 0;
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        const char* name = FileName(i);
+        
+        ret = (FCreateRing(name, RING_SCT) == FS_SUCCEED) && (fds[i] = FOpen(name));
+    }
+    
+    while( ret && (done < bc->size) )
+    {
+        uint n = Min(bc->chunk, bc->size - done);
+        
+        for(i=0; ret && (i<bc->files); i++)
+        {
+            ret = (FWrite(fds[i], gBuf, n) == n) && FFlush(fds[i]);
+            
+            cnt->ops++;
+            cnt->bytes += n;
+        }
+        
+        done += n;
+    }
+    
+    for(i=0; i<bc->files; i++)
+    {
+        if( fds[i] )
+        {
+            ret = ret && (FLength(fds[i]) == Min(bc->size, RING_SCT * 512));
+            
+            FClose(fds[i]);
+        }
+    }
+    
+    free(fds);
+    
+    return ret;
+}
+
+static uint Preallocate(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = 1;
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        const char* name = FileName(i);
+        uint fd = 0;
+        
+        ret = (FCreate(name) == FS_SUCCEED) && (fd = FOpen(name));
+        
+        if( ret )
+        {
+            ret = (FSeek(fd, bc->size - bc->chunk) == (bc->size - bc->chunk)) &&
+                  (FWrite(fd, gBuf, bc->chunk) == bc->chunk) &&
+                  (FLength(fd) == bc->size);
+            
+            cnt->ops++;
+            cnt->bytes += bc->chunk;
+            
+            FClose(fd);
+        }
+    }
+    
+    return ret;
+}
+
+static uint Interleave(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = AppendLog(bc, cnt);
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->files); i+=2)
+    {
+        ret = (FDelete(FileName(i)) == FS_SUCCEED);
+        
+        cnt->ops++;
+    }
+    
+    return ret;
+}
+
+static uint CheckFile(const char* name, uint size, uint chunk)
+{
+    static byte buf[BUF_SIZE] = {0};
+    uint fd = FOpen(name);
+    uint ret = fd && (FLength(fd) == size);
+    uint done = 0;
+    
+    while( ret && (done < size) )
+    {
+        uint n = Min(chunk, size - done);
+        
+        ret = (FRead(fd, buf, n) == n) && !memcmp(buf, gBuf, n);
+        
+        done += n;
+    }
+    
+    FClose(fd);
+    
+    return ret;
+}
+
+static uint FreeRun(const BenchCase* bc, BenchCount* cnt)
+{
+    uint ret = (FCreateRing("ring", RING_SCT) == FS_SUCCEED);
+    uint i = 0;
+    
+    cnt->ops++;
+    
+    while( ret && FDefrag() )
+    {
+        cnt->ops++;
+    }
+    
+    for(i=1; ret && (i<bc->files); i+=2)
+    {
+        ret = CheckFile(FileName(i), bc->size, bc->chunk);
+        
+        cnt->bytes += bc->size;
+    }
+    
+    return ret;
+}
+
+static uint DefragStep(const BenchCase* bc, BenchCount* cnt)
+{
+    uint most = 0;
+    uint ret = 1;
+    uint pass = 0;
+    uint i = 0;
+    FSCheckInfo info = {0};
+    
+    for(pass=0; ret && (pass<2); pass++)
+    {
+        uint more = 1;
+        
+        while( ret && more )
+        {
+            HDFileStat st = HDFileGetStat();
+            
+            more = FDefrag();
+            
+            most = Max(most, HDFileGetStat().reads - st.reads + HDFileGetStat().writes - st.writes);
+            
+            if( !pass && more && ((++cnt->ops == 20) || (cnt->ops == 100)) )
+            {
+                uint fd = FOpen(FileName(cnt->ops % bc->files));
+                
+                ret = fd && (FWrite(fd, gBuf, bc->chunk) == bc->chunk);
+                
+                FClose(fd);
+            }
+        }
+    }
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        ret = CheckFile(FileName(i), bc->size, bc->chunk);
+        
+        cnt->bytes += bc->size;
+    }
+    
+    i = HDFileGetStat().writes;
+    
+    while( ret && FDefrag() );
+    
+    ret = ret && (HDFileGetStat().writes == i) && FSCheck(&info) && !info.errors;
+    
+    if( most > DEFRAG_IOS )
+    {
+        fprintf(stderr, "defrag_step: %u sector reads and writes in one step\n", most);
+        
+        ret = 0;
+    }
+    
+    return ret;
+}
+
+static uint SameAsModel(uint fd, const byte* model, uint len)
+{
+    static byte buf[BUF_SIZE] = {0};
+    uint ret = (FLength(fd) == len) && (FSeek(fd, 0) == 0);
+    uint done = 0;
+    
+    while( ret && (done < len) )
+    {
+        uint n = Min(BUF_SIZE, len - done);
+        
+        ret = (FRead(fd, buf, n) == n) && !memcmp(buf, model + done, n);
+        
+        done += n;
+    }
+    
+    return ret;
+}
+
+static uint DedupHoles(const BenchCase* bc, BenchCount* cnt)
+{
+    uint cap = 2 * bc->size;
+    byte* model = (byte*)calloc(bc->files, cap);
+    uint* lens = (uint*)calloc(bc->files, sizeof(uint));
+    uint ret = model && lens;
+    uint saved = 0;
+    uint round = 0;
+    uint i = 0;
+    FSCheckInfo info = {0};
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        const char* name = FileName(i);
+        uint fd = 0;
+        
+        ret = (FCreate(name) == FS_SUCCEED) && (fd = FOpen(name)) && (FWrite(fd, gBuf, bc->size) == bc->size);
+        
+        memcpy(model + i * cap, gBuf, bc->size);
+        lens[i] = bc->size;
+        
+        FClose(fd);
+    }
+    
+    for(round=0; ret && (round<4); round++)
+    {
+        uint cut = 1 + Random(511);
+        uint gap = Random(3 * 512);
+        
+        for(i=0; ret && (i<bc->files); i++)
+        {
+            byte* m = model + i * cap;
+            uint fd = FOpen(FileName(i));
+            uint pos = lens[i] - cut + gap;
+            
+            ret = fd && (FErase(fd, cut) == cut) && (pos + bc->chunk <= cap);
+            ret = ret && (FSeek(fd, pos) == pos) && (FWrite(fd, gBuf + round, bc->chunk) == bc->chunk);
+            
+            memset(m + lens[i] - cut, 0, cap - lens[i] + cut);
+            memcpy(m + pos, gBuf + round, bc->chunk);
+            
+            lens[i] = pos + bc->chunk;
+            
+            ret = ret && SameAsModel(fd, m, lens[i]);
+            
+            cnt->ops += 3;
+            cnt->bytes += bc->chunk;
+            
+            FClose(fd);
+        }
+        
+        while( ret && FDedup(&saved) )
+        {
+            cnt->ops++;
+        }
+    }
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        uint fd = FOpen(FileName(i));
+        
+        ret = fd && SameAsModel(fd, model + i * cap, lens[i]);
+        
+        FClose(fd);
+    }
+    
+    ret = ret && FSCheck(&info) && !info.errors;
+    
+    free(model);
+    free(lens);
+    
+    return ret;
+}
+
+static void FillUnique(uint* buf, uint pos, uint len)
+{
+    uint i = 0;
+    
+    for(i=0; i<len/sizeof(uint); i++)
+    {
+        buf[i] = (pos / sizeof(uint) + i) * 2654435761u;
+    }
+}
+
+static uint DedupCopies(const BenchCase* bc, BenchCount* cnt)
+{
+    static uint buf[BUF_SIZE / sizeof(uint)] = {0};
+    static uint data[BUF_SIZE / sizeof(uint)] = {0};
+    uint want = (bc->files - 1) * (bc->size / 512);
+    uint saved = 0;
+    uint most = 0;
+    uint more = 1;
+    uint ret = 1;
+    uint i = 0;
+    FSCheckInfo info = {0};
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        const char* name = FileName(i);
+        uint fd = 0;
+        uint done = 0;
+        
+        ret = (FCreate(name) == FS_SUCCEED) && (fd = FOpen(name));
+        
+        while( ret && (done < bc->size) )
+        {
+            uint n = Min(bc->chunk, bc->size - done);
+            
+            FillUnique(data, done, n);
+            
+            ret = (FWrite(fd, (byte*)data, n) == n);
+            
+            done += n;
+        }
+        
+        FClose(fd);
+    }
+    
+    while( ret && more )
+    {
+        HDFileStat st = HDFileGetStat();
+        
+        more = FDedup(&saved);
+        
+        if( cnt->ops++ )
+        {
+            most = Max(most, HDFileGetStat().reads - st.reads + HDFileGetStat().writes - st.writes);
+        }
+    }
+    
+    for(i=0; ret && (i<bc->files); i++)
+    {
+        uint fd = FOpen(FileName(i));
+        uint done = 0;
+        
+        ret = fd && (FLength(fd) == bc->size);
+        
+        while( ret && (done < bc->size) )
+        {
+            uint n = Min(bc->chunk, bc->size - done);
+            
+            FillUnique(data, done, n);
+            
+            ret = (FRead(fd, (byte*)buf, n) == n) && !memcmp(buf, data, n);
+            
+            done += n;
+            cnt->bytes += n;
+        }
+        
+        FClose(fd);
+    }
+    
+    ret = ret && (saved >= want - want / 20) && FSCheck(&info) && !info.errors;
+    
+    if( !ret )
+    {
+        fprintf(stderr, "dedup_copies: %u of %u sectors reclaimed\n", saved, want);
+    }
+    
+    if( most > DEDUP_IOS )
+    {
+        fprintf(stderr, "dedup_copies: %u sector reads and writes in one step\n", most);
+        
+        ret = 0;
+    }
+    
+    return ret;
+}
+
+static uint KvKey(uint i)
+{
+    return i * 2654435761u;
+}
+
+static uint KvInsert(const BenchCase* bc, BenchCount* cnt)
+{
+    uint bt = BTreeOpen(FileName(0), 2 * sizeof(uint));
+    uint* keys = bt ? (uint*)malloc(bc->chunk * sizeof(uint)) : NULL;
+    uint* vals = keys ? (uint*)malloc(bc->chunk * 2 * sizeof(uint)) : NULL;
+    uint ret = !!vals;
+    uint i = 0;
+    
+    for(i=0; ret && (i<bc->size); i+=bc->chunk)
+    {
+        uint n = Min(bc->chunk, bc->size - i);
+        uint j = 0;
+        
+        for(j=0; j<n; j++)
+        {
+            keys[j] = KvKey(i + j);
+            vals[2 * j] = i + j;
+            vals[2 * j + 1] = keys[j];
+        }
+        
+        ret = (BTreePutBatch(bt, keys, (byte*)vals, n) == n);
+        
+        cnt->ops += n;
+        cnt->bytes += n * 2 * sizeof(uint);
+    }
+    
+    ret = ret && (BTreeCount(bt) == bc->size);
+    
+    free(keys);
+    free(vals);
+    
+    return BTreeClose(bt) && ret;
+}
+
+static uint KvLookup(const BenchCase* bc, BenchCount* cnt)
+{
+    HDFileStat st = HDFileGetStat();
+    uint bt = BTreeOpen(FileName(0), 2 * sizeof(uint));
+    uint ret = !!bt;
+    uint i = 0;
+    
+    for(i=0; ret && (i<KV_LOOKUPS); i++)
+    {
+        uint val[2] = {0};
+        uint j = Random(bc->size);
+        
+        ret = BTreeGet(bt, KvKey(j), val) && (val[0] == j);
+        
+        cnt->ops++;
+        cnt->bytes += sizeof(val);
+    }
+    
+    if( ret && ((HDFileGetStat().reads - st.reads) > KV_LOOKUPS * KV_READS) )
+    {
+        fprintf(stderr, "kv_lookup: %u sector reads for %u lookups\n", HDFileGetStat().reads - st.reads, KV_LOOKUPS);
+        
+        ret = 0;
+    }
+    
+    return BTreeClose(bt) && ret;
+}
+
+static uint KvCount(uint key, void* value, void* arg)
+{
+    uint* left = (uint*)arg;
+    
+    return --(*left) > 0;
+}
+
+static uint KvScan(const BenchCase* bc, BenchCount* cnt)
+{
+    uint bt = BTreeOpen(FileName(0), 2 * sizeof(uint));
+    uint ret = !!bt;
+    uint i = 0;
+    
+    for(i=0; ret && (i<KV_SCANS); i++)
+    {
+        uint left = KV_SCAN_LEN;
+        uint n = BTreeScan(bt, KvKey(Random(bc->size)), -1, KvCount, &left);
+        
+        cnt->ops++;
+        cnt->bytes += n * 2 * sizeof(uint);
+    }
+    
+    return BTreeClose(bt) && ret;
+}
+
+static const BenchCase gCases[] =
+{
+    {"seq_write",     NULL,       WriteFiles,   1,   4 << 20, 512},
+    {"seq_write",     NULL,       WriteFiles,   1,   4 << 20, 4096},
+    {"seq_write",     NULL,       WriteFiles,   1,   4 << 20, 65536},
+    {"seq_write",     NULL,       WriteFiles,   64,  64 << 10, 4096},
+    {"seq_read",      WriteFiles, ReadFiles,    1,   4 << 20, 512},
+    {"seq_read",      WriteFiles, ReadFiles,    1,   4 << 20, 4096},
+    {"seq_read",      WriteFiles, ReadFiles,    1,   4 << 20, 65536},
+    {"seq_read",      WriteFiles, ReadFiles,    64,  64 << 10, 4096},
+    {"seq_read",      WriteFiles, ReadFiles,    1,   4 << 20, 100},
+    {"seq_read_adv",  WriteFiles, ReadSequential, 1, 4 << 20, 100},
+    {"seq_read_adv",  WriteFiles, ReadSequential, 1, 4 << 20, 512},
+    {"rand_read",     WriteFiles, RandomRead,   1,   4 << 20, 512},
+    {"rand_read",     WriteFiles, RandomRead,   1,   4 << 20, 4096},
+    {"rand_read",     WriteFiles, RandomRead,   16,  256 << 10, 512},
+    {"create_delete", NULL,       CreateDelete, 16,  0, 0},
+    {"create_delete", NULL,       CreateDelete, 128, 0, 0},
+    {"create_delete", NULL,       CreateDelete, 512, 0, 0},
+    {"append_log",    NULL,       AppendLog,    1,   1 << 20, 100},
+    {"append_log",    NULL,       AppendLog,    16,  64 << 10, 100},
+    {"append_log",    NULL,       AppendLog,    64,  16 << 10, 100},
+    {"ring_log",      NULL,       RingLog,      1,   1 << 20, 100},
+    {"ring_log",      NULL,       RingLog,      16,  64 << 10, 100},
+    {"prealloc",      NULL,       Preallocate,  1,   4 << 20, 512},
+    {"prealloc",      NULL,       Preallocate,  16,  1 << 20, 4096},
+    {"rand_read",     Preallocate, RandomRead,  1,   4 << 20, 512},
+    {"free_run",      Interleave, FreeRun,      16,  64 << 10, 512},
+    {"defrag_step",   AppendLog,  DefragStep,   2,   8 << 20, 4096},
+    {"dedup_holes",   NULL,       DedupHoles,   4,   16 << 10, 700},
+    {"dedup_copies",  NULL,       DedupCopies,  2,   50 << 20, 65536},
+    {"kv_insert",     NULL,       KvInsert,     1,   100000, 1},
+    {"kv_insert",     NULL,       KvInsert,     1,   100000, 1000},
+    {"kv_lookup",     KvInsert,   KvLookup,     1,   100000, 1000},
+    {"kv_lookup",     KvInsert,   KvLookup,     1,   1000000, 10000},
+    {"kv_scan",       KvInsert,   KvScan,       1,   100000, 1000},
+};
+
+static uint Selected(const char* name, char* names[], int cnt)
+{
+    uint ret = !cnt;
+    int i = 0;
+    
+    for(i=0; !ret && (i<cnt); i++)
+    {
+        ret = !strcmp(name, names[i]);
+    }
+    
+    return ret;
+}
+
+static BenchResult RunCase(const BenchCase* bc, uint seed, uint log)
+{
+    BenchResult ret = {0};
+    BenchCount setup = {0};
+    double begin = 0;
+    
+    ret.bc = bc;
+    gSeed = seed;
+    
+    FSModInit();
+    
+    ret.ok = FSFormat() && (!log || FSLogMode(1)) && (!bc->setup || bc->setup(bc, &setup));
+    
+    if( ret.ok )
+    {
+        HDFileResetStat();
+        
+        begin = Now();
+        
+        ret.ok = bc->run(bc, &ret.cnt);
+        ret.usec = Now() - begin;
+        ret.stat = HDFileGetStat();
+    }
+    
+    return ret;
+}
+
+static void PrintResult(const BenchResult* r, const char* label, uint csv, uint first)
+{
+    const BenchCase* bc = r->bc;
+    
+    if( csv )
+    {
+        if( first )
+        {
+            printf("label,workload,files,size,chunk,ok,ops,bytes,sct_reads,sct_writes,sct_seeks,sct_cmds,usec\n");
+        }
+        
+        printf("%s,%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%.0f\n",
+               label, bc->name, bc->files, bc->size, bc->chunk, r->ok,
+               r->cnt.ops, r->cnt.bytes, r->stat.reads, r->stat.writes, r->stat.seeks, r->stat.cmds, r->usec);
+    }
+    else
+    {
+        printf("%s{\"label\": \"%s\", \"workload\": \"%s\", \"files\": %u, \"size\": %u, \"chunk\": %u, "
+               "\"ok\": %s, \"ops\": %u, \"bytes\": %u, \"sct_reads\": %u, \"sct_writes\": %u, \"sct_seeks\": %u, \"sct_cmds\": %u, \"usec\": %.0f}",
+               first ? "[\n  " : ",\n  ", label, bc->name, bc->files, bc->size, bc->chunk, r->ok ? "true" : "false",
+               r->cnt.ops, r->cnt.bytes, r->stat.reads, r->stat.writes, r->stat.seeks, r->stat.cmds, r->usec);
+    }
+}
+
+static void Usage(const char* app)
+{
+    printf("Usage: %s [-i image] [-s sectors] [-f json|csv] [-l label] [-r seed] [-L] [workload ...]\n", app);
+    printf("    -i  run on a file-backed image instead of memory (the image is reformatted)\n");
+    printf("    -s  disk size in sectors, default %u\n", DEF_SECTORS);
+    printf("    -f  output format, default json\n");
+    printf("    -l  label written into every record, to tell runs apart\n");
+    printf("    -r  random seed for rand_read and create_delete, default 1\n");
+    printf("    -L  run every workload on a log mode volume\n");
+    printf("Workloads: seq_write seq_read seq_read_adv rand_read create_delete append_log ring_log prealloc free_run defrag_step dedup_holes dedup_copies kv_insert kv_lookup kv_scan\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* image = NULL;
+    const char* label = "";
+    uint sectors = DEF_SECTORS;
+    uint seed = 1;
+    uint csv = 0;
+    uint log = 0;
+    uint first = 1;
+    uint ok = 1;
+    uint i = 0;
+    int opt = 0;
+    
+    while( (opt = getopt(argc, argv, "i:s:f:l:r:Lh")) != -1 )
+    {
+        switch( opt )
+        {
+            case 'i':
+                image = optarg;
+                break;
+            case 's':
+                sectors = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                csv = !strcmp(optarg, "csv");
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'r':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'L':
+                log = 1;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    
+    if( !HDFileOpen(image, sectors) )
+    {
+        fprintf(stderr, "cannot open a %u sector disk\n", sectors);
+        return 1;
+    }
+    
+    for(i=0; i<sizeof(gBuf); i++)
+    {
+        gBuf[i] = i;
+    }
+    
+    for(i=0; i<Dim(gCases); i++)
+    {
+        if( Selected(gCases[i].name, argv + optind, argc - optind) )
+        {
+            BenchResult r = RunCase(gCases + i, seed, log);
+            
+            PrintResult(&r, label, csv, first);
+            
+            ok = ok && r.ok;
+            first = 0;
+        }
+    }
+    
+    if( !csv && !first )
+    {
+        printf("\n]\n");
+    }
+    
+    HDFileClose();
+    
+    return !ok;
+}
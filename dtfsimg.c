@@ -0,0 +1,357 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "hdfile.h"
+#include "fs.h"
+
+#define CHUNK_SIZE  (1 << 20)
+#define NAME_SIZE   32
+
+static byte* gBuf = NULL;
+
+static uint ParseSize(const char* s)
+{
+    char* end = NULL;
+    unsigned long long ret = strtoull(s, &end, 0);
+    
+    switch( *end )
+    {
+        case 'K': case 'k':
+            ret <<= 10;
+            break;
+        case 'M': case 'm':
+            ret <<= 20;
+            break;
+        case 'G': case 'g':
+            ret <<= 30;
+            break;
+        case 0:
+            ret *= 512;
+            break;
+        default:
+            ret = 0;
+            break;
+    }
+    
+    ret = ret / 512;
+    
+    return (ret <= (uint)-1) ? ret : 0;
+}
+
+static int ImportFile(const char* path, const char* name)
+{
+    int ret = 0;
+    FILE* fp = fopen(path, "rb");
+    
+    if( fp )
+    {
+        uint fd = 0;
+        
+        if( FExisted(name) == FS_EXISTED )
+        {
+            FDelete(name);
+        }
+        
+        if( (FCreate(name) == FS_SUCCEED) && (fd = FOpen(name)) )
+        {
+            size_t n = 0;
+            
+            ret = 1;
+            
+            while( ret && ((n = fread(gBuf, 1, CHUNK_SIZE, fp)) > 0) )
+            {
+                ret = (FWrite(fd, gBuf, n) == n);
+            }
+            
+            ret = ret && !ferror(fp);
+            
+            FClose(fd);
+        }
+        
+        fclose(fp);
+    }
+    
+    printf("%s %s\n", ret ? "  +" : "  !", name);
+    
+    return ret;
+}
+
+static int ImportDir(const char* root, const char* rel)
+{
+    int ret = 1;
+    char path[4096] = {0};
+    DIR* dir = NULL;
+    
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    
+    if( (dir = opendir(path)) )
+    {
+        struct dirent* de = NULL;
+        
+        while( (de = readdir(dir)) )
+        {
+            char sub[4096] = {0};
+            struct stat st = {0};
+            
+            if( !strcmp(de->d_name, ".") || !strcmp(de->d_name, "..") )
+            {
+                continue;
+            }
+            
+            snprintf(sub, sizeof(sub), "%s%s%s", rel, *rel ? "/" : "", de->d_name);
+            snprintf(path, sizeof(path), "%s/%s", root, sub);
+            
+            if( stat(path, &st) )
+            {
+                ret = 0;
+            }
+            else if( S_ISDIR(st.st_mode) )
+            {
+                ret = ImportDir(root, sub) && ret;
+            }
+            else if( S_ISREG(st.st_mode) )
+            {
+                if( strlen(sub) < NAME_SIZE )
+                {
+                    ret = ImportFile(path, sub) && ret;
+                }
+                else
+                {
+                    printf("  ! %s (name longer than %d chars)\n", sub, NAME_SIZE - 1);
+                    ret = 0;
+                }
+            }
+        }
+        
+        closedir(dir);
+    }
+    else
+    {
+        ret = 0;
+    }
+    
+    return ret;
+}
+
+static int Format(const char* img, const char* size)
+{
+    uint sectors = ParseSize(size);
+    int ret = (sectors > 2) && HDFileOpen(img, sectors);
+    
+    if( ret )
+    {
+        FSModInit();
+        
+        ret = FSFormat();
+        
+        printf("%s: %u sectors %s\n", img, sectors, ret ? "formatted" : "format failed");
+    }
+    
+    return ret;
+}
+
+static int Import(const char* img, const char* dir)
+{
+    int ret = HDFileOpen(img, 0);
+    
+    if( ret )
+    {
+        FSModInit();
+        
+        ret = FSIsFormatted() && (gBuf = malloc(CHUNK_SIZE));
+        ret = ret && ImportDir(dir, "");
+        
+        free(gBuf);
+    }
+    
+    return ret;
+}
+
+static int Cat(const char* img, const char* name)
+{
+    int ret = HDFileOpen(img, 0);
+    
+    if( ret )
+    {
+        uint fd = 0;
+        uint n = 0;
+        
+        FSModInit();
+        
+        ret = FSIsFormatted() && (gBuf = malloc(CHUNK_SIZE)) && (fd = FOpen(name));
+        
+        while( ret && ((n = FRead(fd, gBuf, CHUNK_SIZE)) > 0) )
+        {
+            ret = (fwrite(gBuf, 1, n, stdout) == n);
+        }
+        
+        if( fd )
+        {
+            FClose(fd);
+        }
+        
+        free(gBuf);
+    }
+    
+    return ret;
+}
+
+static int Check(const char* img)
+{
+    int ret = HDFileOpen(img, 0);
+    FSCheckInfo info = {0};
+    
+    if( ret )
+    {
+        FSModInit();
+        
+        ret = FSCheck(&info);
+        
+        if( ret )
+        {
+            printf("%s: %u data sectors, %u files\n", img, info.sectors, info.files);
+            printf("    bad links:   %u\n", info.badLinks);
+            printf("    cross links: %u\n", info.crossLinks);
+            printf("    bad heads:   %u\n", info.badHeads);
+            printf("    bad lengths: %u\n", info.badLengths);
+            printf("    lost:        %u\n", info.lost);
+            printf("%s\n", info.errors ? "errors found" : "clean");
+        }
+        else
+        {
+            printf("%s: not a DTFS image\n", img);
+        }
+    }
+    
+    return ret && !info.errors;
+}
+
+static int Defrag(const char* img)
+{
+    int ret = HDFileOpen(img, 0);
+    
+    if( ret )
+    {
+        HDFileStat stat = {0};
+        
+        FSModInit();
+        
+        ret = FSIsFormatted();
+        
+        while( ret && FDefrag() );
+        
+        stat = HDFileGetStat();
+        
+        if( ret )
+        {
+            printf("%s: %u sectors read, %u written\n", img, stat.reads, stat.writes);
+        }
+    }
+    
+    return ret;
+}
+
+static int Dedup(const char* img)
+{
+    int ret = HDFileOpen(img, 0);
+    
+    if( ret )
+    {
+        HDFileStat stat = {0};
+        uint saved = 0;
+        
+        FSModInit();
+        
+        ret = FSIsFormatted();
+        
+        while( ret && FDedup(&saved) );
+        
+        stat = HDFileGetStat();
+        
+        if( ret )
+        {
+            printf("%s: %u sectors reclaimed, %u read, %u written\n", img, saved, stat.reads, stat.writes);
+        }
+    }
+    
+    return ret;
+}
+
+static int LogMode(const char* img, const char* mode)
+{
+    int ret = HDFileOpen(img, 0);
+    
+    if( ret )
+    {
+        FSModInit();
+        
+        ret = (!strcmp(mode, "on") || !strcmp(mode, "off")) && FSLogMode(!strcmp(mode, "on"));
+    }
+    
+    return ret;
+}
+
+static void Usage(const char* app)
+{
+    printf("Usage:\n");
+    printf("    %s format <image> <size>   size in sectors, or with K/M/G suffix\n", app);
+    printf("    %s import <image> <dir>    copy a host directory tree into the image\n", app);
+    printf("    %s cat <image> <file>      write a file of the image to stdout\n", app);
+    printf("    %s check <image>           verify chains, free list and counters\n", app);
+    printf("    %s defrag <image>          move fragmented files into contiguous runs\n", app);
+    printf("    %s dedup <image>           share identical sectors between files\n", app);
+    printf("    %s logmode <image> on|off  allocate new sectors sequentially from segments\n", app);
+}
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+    
+    if( argc == 4 )
+    {
+        if( !strcmp(argv[1], "format") )
+        {
+            ret = Format(argv[2], argv[3]);
+        }
+        else if( !strcmp(argv[1], "import") )
+        {
+            ret = Import(argv[2], argv[3]);
+        }
+        else if( !strcmp(argv[1], "cat") )
+        {
+            ret = Cat(argv[2], argv[3]);
+        }
+        else if( !strcmp(argv[1], "logmode") )
+        {
+            ret = LogMode(argv[2], argv[3]);
+        }
+        else
+        {
+            Usage(argv[0]);
+        }
+    }
+    else if( (argc == 3) && !strcmp(argv[1], "check") )
+    {
+        ret = Check(argv[2]);
+    }
+    else if( (argc == 3) && !strcmp(argv[1], "defrag") )
+    {
+        ret = Defrag(argv[2]);
+    }
+    else if( (argc == 3) && !strcmp(argv[1], "dedup") )
+    {
+        ret = Dedup(argv[2]);
+    }
+    else
+    {
+        Usage(argv[0]);
+    }
+    
+    HDFileClose();
+    
+    return !ret;
+}
@@ -9,7 +9,9 @@ enum
     NoneEvent,
     MutexEvent,
     KeyEvent,
-    TaskEvent
+    TaskEvent,
+    FileEvent,
+    DiskEvent
 };
 
 typedef struct
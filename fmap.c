@@ -0,0 +1,293 @@
+
+#include "fmap.h"
+#include "fs.h"
+#include "const.h"
+#include "list.h"
+#include "memory.h"
+#include "utility.h"
+
+#define PTE_P     0x01
+#define PTE_RW    0x02
+#define PTE_US    0x04
+#define PTE_D     0x40
+
+typedef struct
+{
+    ListNode head;
+    uint fd;
+    uint offset;
+    uint addr;
+    uint pages;
+} FMapping;
+
+extern uint gMemSize;
+
+static List gMapList = {0};
+static uint gMapEnable = 0;
+
+static uint* PageEntry(uint addr)
+{
+    return AddrOff((uint*)PageTblBase, addr / PageSize);
+}
+
+static void SetPageEntry(uint page, uint attr)
+{
+    uint* pte = PageEntry(page);
+    
+    *pte = page | attr;
+    
+    asm volatile("invlpg (%0)" : : "r"(page) : "memory");
+}
+
+static uint IsInWindow(uint addr)
+{
+    return (FMapBase <= addr) && (addr < (FMapBase + FMapSize));
+}
+
+static FMapping* FindMapping(uint addr)
+{
+    FMapping* ret = NULL;
+    ListNode* pos = NULL;
+    
+    List_ForEach(&gMapList, pos)
+    {
+        FMapping* fm = (FMapping*)pos;
+        
+        if( (fm->addr <= addr) && (addr < (fm->addr + fm->pages * PageSize)) )
+        {
+            ret = fm;
+            break;
+        }
+    }
+    
+    return ret;
+}
+
+static uint FillPage(FMapping* fm, uint page)
+{
+    uint off = fm->offset + (page - fm->addr);
+    uint len = FLength(fm->fd);
+    uint pos = FTell(fm->fd);
+    uint n = 0;
+    
+    SetPageEntry(page, PTE_P | PTE_RW);
+    
+    if( (off < len) && (FSeek(fm->fd, off) == off) )
+    {
+        n = FRead(fm->fd, (byte*)page, Min(PageSize, len - off));
+        n = (n <= PageSize) ? n : 0;
+    }
+    
+    MemSet(AddrOff((byte*)page, n), 0, PageSize - n);
+    
+    FSeek(fm->fd, pos);
+    
+    SetPageEntry(page, PTE_P | PTE_RW | PTE_US);
+    
+    return 1;
+}
+
+static uint SyncMapping(FMapping* fm)
+{
+    uint ret = 1;
+    uint pos = FTell(fm->fd);
+    uint dirty = 0;
+    uint i = 0;
+    
+    for(i=0; i<fm->pages; i++)
+    {
+        uint page = fm->addr + i * PageSize;
+        uint pte = *PageEntry(page);
+        
+        if( (pte & PTE_P) && (pte & PTE_D) )
+        {
+            uint off = fm->offset + i * PageSize;
+            uint len = FLength(fm->fd);
+            
+            if( off < len )
+            {
+                uint n = Min(PageSize, len - off);
+                
+                ret = (FSeek(fm->fd, off) == off) && (FWrite(fm->fd, (byte*)page, n) == n) && ret;
+                
+                dirty = 1;
+            }
+            
+            SetPageEntry(page, PTE_P | PTE_RW | PTE_US);
+        }
+    }
+    
+    FSeek(fm->fd, pos);
+    
+    if( dirty )
+    {
+        FNotify(fm->fd, FS_WATCH_WRITE);
+    }
+    
+    return ret;
+}
+
+static uint DoUnmap(FMapping* fm)
+{
+    uint ret = SyncMapping(fm);
+    uint i = 0;
+    
+    for(i=0; i<fm->pages; i++)
+    {
+        SetPageEntry(fm->addr + i * PageSize, 0);
+    }
+    
+    List_DelNode((ListNode*)fm);
+    
+    Free(fm);
+    
+    return ret;
+}
+
+static ListNode* FindHole(uint pages, uint* addr)
+{
+    ListNode* ret = NULL;
+    ListNode* pos = NULL;
+    uint next = FMapBase;
+    
+    List_ForEach(&gMapList, pos)
+    {
+        FMapping* fm = (FMapping*)pos;
+        
+        if( (fm->addr - next) >= pages * PageSize )
+        {
+            break;
+        }
+        
+        next = fm->addr + fm->pages * PageSize;
+    }
+    
+    if( (FMapBase + FMapSize - next) >= pages * PageSize )
+    {
+        *addr = next;
+        
+        ret = pos;
+    }
+    
+    return ret;
+}
+
+void FMapModInit()
+{
+    uint page = 0;
+    
+    List_Init(&gMapList);
+    
+    for(page=FMapBase; page<(FMapBase + FMapSize); page+=PageSize)
+    {
+        *PageEntry(page) = page;
+    }
+    
+    gMapEnable = (gMemSize >= (FMapBase + FMapSize));
+}
+
+uint FMap(uint fd, uint offset, uint length)
+{
+    uint ret = 0;
+    uint pages = (length + PageSize - 1) / PageSize;
+    
+    if( gMapEnable && pages && !(offset % PageSize) && (FLength(fd) != -1) )
+    {
+        uint addr = 0;
+        ListNode* before = FindHole(pages, &addr);
+        FMapping* fm = before ? Malloc(sizeof(FMapping)) : NULL;
+        
+        if( fm )
+        {
+            fm->fd = fd;
+            fm->offset = offset;
+            fm->addr = addr;
+            fm->pages = pages;
+            
+            List_AddBefore(before, (ListNode*)fm);
+            
+            ret = addr;
+        }
+    }
+    
+    return ret;
+}
+
+uint FUnmap(uint addr)
+{
+    uint ret = 0;
+    FMapping* fm = FindMapping(addr);
+    
+    if( fm && (fm->addr == addr) )
+    {
+        ret = DoUnmap(fm);
+    }
+    
+    return ret;
+}
+
+uint FMapSync(uint fd)
+{
+    uint ret = 1;
+    ListNode* pos = NULL;
+    
+    List_ForEach(&gMapList, pos)
+    {
+        FMapping* fm = (FMapping*)pos;
+        
+        if( fm->fd == fd )
+        {
+            ret = SyncMapping(fm) && ret;
+        }
+    }
+    
+    return ret;
+}
+
+void FMapRelease(uint fd)
+{
+    ListNode* pos = gMapList.next;
+    
+    while( !IsEqual(pos, &gMapList) )
+    {
+        FMapping* fm = (FMapping*)pos;
+        
+        pos = pos->next;
+        
+        if( fm->fd == fd )
+        {
+            DoUnmap(fm);
+        }
+    }
+}
+
+uint FMapFault(uint addr)
+{
+    uint ret = 0;
+    FMapping* fm = IsInWindow(addr) ? FindMapping(addr) : NULL;
+    
+    if( fm && !(*PageEntry(addr) & PTE_P) )
+    {
+        ret = FillPage(fm, addr - addr % PageSize);
+    }
+    
+    return ret;
+}
+
+uint FMapPrepare(byte* buf, uint len)
+{
+    uint ret = 1;
+    uint begin = (uint)buf - (uint)buf % PageSize;
+    uint end = (uint)buf + len;
+    uint page = 0;
+    
+    for(page=begin; ret && (page<end); page+=PageSize)
+    {
+        if( IsInWindow(page) && !(*PageEntry(page) & PTE_P) )
+        {
+            ret = FMapFault(page);
+        }
+    }
+    
+    return ret;
+}
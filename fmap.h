@@ -0,0 +1,15 @@
+
+#ifndef FMAP_H
+#define FMAP_H
+
+#include "type.h"
+
+void FMapModInit();
+uint FMap(uint fd, uint offset, uint length);
+uint FUnmap(uint addr);
+uint FMapSync(uint fd);
+void FMapRelease(uint fd);
+uint FMapFault(uint addr);
+uint FMapPrepare(byte* buf, uint len);
+
+#endif
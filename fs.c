@@ -9,6 +9,13 @@
 #define Free free
 #else
 #include "memory.h"
+#include "app.h"
+#include "fmap.h"
+#include "fwatch.h"
+#include "ramdisk.h"
+#include "vblk.h"
+#include "ahci.h"
+#include "stripe.h"
 #endif
 
 #define FS_MAGIC       "DTFS-v1.0"
@@ -21,6 +28,29 @@
 #define FD_BYTES       sizeof(FileDesc)
 #define FE_ITEM_CNT    (SECT_SIZE / FE_BYTES)
 #define MAP_ITEM_CNT   (SECT_SIZE / sizeof(uint))
+#define DIRECT_BATCH   32
+#define RUN_WINDOW     (SECT_SIZE * 8)
+#define SCT_ARENA_SIZE 12
+#define HOLE_ITEM_CNT  ((SECT_SIZE - sizeof(uint)) / sizeof(HoleRange))
+#define FT_SPARSE      0x01
+#define FT_RING        0x02
+#define FT_CONTIG      0x04
+#define FS_LOG_MODE    0x01
+#define SEG_SIZE       128
+#define META_SLOT_CNT  8
+#define POOL_ITEM_CNT  (SECT_SIZE / sizeof(PoolEntry))
+#define POOL_SCT_RATIO 128
+#define AHEAD_SCT_MAX  8
+#define ENTRY_SLOT_CNT 16
+#define CHECK_BITS_MAX (SECT_SIZE * 32)
+#define CHECK_BATCH    8
+#define DEFRAG_BATCH   16
+#define DEFRAG_STEP    256
+#define DEFRAG_WALK    (DEFRAG_STEP * 8)
+#define DEFRAG_SCAN    1
+#define DEFRAG_SEEK    2
+#define DEFRAG_COPY    3
+#define DEDUP_STEP     64
 
 typedef struct
 {
@@ -30,6 +60,13 @@ typedef struct
     uint mapSize;
     uint freeNum;
     uint freeBegin;
+    uint flags;
+    uint segNext;
+    uint segEnd;
+    uint poolBegin;
+    uint poolNum;
+    uint moveBegin;
+    uint moveNum;
 } FSHeader;
 
 typedef struct
@@ -52,16 +89,60 @@ typedef struct
     uint reserved[2];
 } FileEntry;
 
+typedef struct
+{
+    uint begin;
+    uint num;
+    uint sct;
+} HoleRange;
+
+typedef struct
+{
+    uint cnt;
+    HoleRange range[HOLE_ITEM_CNT];
+} HoleTable;
+
 typedef struct
 {
     ListNode head;
     FileEntry fe;
+    HoleTable* holes;
+    uint seek;
     uint objIdx;
+    uint sctIdx;
     uint offset;
     uint changed;
+    uint hint;
+    uint aheadIdx;
+    uint aheadNum;
+    uint aheadSct[AHEAD_SCT_MAX];
+    byte* ahead;
+    uint dropIdx;
+    uint dropEnd;
+    uint ringPos;
     byte cache[SECT_SIZE];
 } FileDesc;
 
+typedef struct
+{
+    uint si;
+    uint dirty;
+    byte data[SECT_SIZE];
+} MetaSlot;
+
+typedef struct
+{
+    uint hash;
+    uint sct;
+    uint refs;
+} PoolEntry;
+
+typedef struct
+{
+    uint dirty;
+    FileEntry fe;
+} EntrySlot;
+
 typedef struct
 {
     uint* pSct;
@@ -70,871 +151,3704 @@ typedef struct
     uint idxOff;
 } MapPos;
 
-static List gFDList = {0};
-
-void FSModInit()
+typedef struct
 {
-    HDRawModInit();
-
-    List_Init(&gFDList);
-}
+    uint* map;
+    uint loaded;
+    byte* bits;
+    uint base;
+    uint lo;
+    uint hi;
+} CheckPass;
 
-static void* ReadSector(uint si)
+static List gFDList = {0};
+static byte gSctArena[SCT_ARENA_SIZE][SECT_SIZE] = {0};
+static uint gSctUsed = 0;
+static uint gDefragIdx = 0;
+static uint gDefragState = 0;
+static FileEntry gDefragFe = {0};
+static uint gDefragStale = 0;
+static uint gDefragSrc = SCT_END_FLAG;
+static uint gDefragNum = 0;
+static uint gDefragLen = 0;
+static uint gDefragFrag = 0;
+static uint gDefragRun = SCT_END_FLAG;
+static uint gDefragPrev = SCT_END_FLAG;
+static uint gDefragHead = SCT_END_FLAG;
+static uint gDefragFree = 0;
+static MetaSlot gMeta[META_SLOT_CNT] = {0};
+static uint gMetaNext = 0;
+static uint gMetaEnd = 0;
+static uint gDefer = 0;
+static const BlkDev* gDev = NULL;
+static EntrySlot gEntry[ENTRY_SLOT_CNT] = {0};
+static uint gEntryNext = 0;
+static uint gDedupIdx = 0;
+static uint gDedupPass = 0;
+static FileEntry gDedupFe = {0};
+static uint gDedupStale = 1;
+static uint gDedupSi = SCT_END_FLAG;
+static uint gDedupSct = 0;
+static uint gDedupPrev = SCT_END_FLAG;
+
+static void ResetMeta(uint metaEnd)
 {
-    void* ret = NULL;
+    uint i = 0;
 
-    if( si != SCT_END_FLAG )
+    for(i=0; i<META_SLOT_CNT; i++)
     {
-        ret = Malloc(SECT_SIZE);
-
-        if( !(ret && HDRawRead(si, (byte*)ret)) )
-        {
-            Free(ret);
-            ret = NULL;
-        }
+        gMeta[i].si = SCT_END_FLAG;
+        gMeta[i].dirty = 0;
     }
 
-    return ret;
+    gMetaNext = 0;
+    gMetaEnd = metaEnd;
 }
 
-static MapPos FindInMap(uint si)
+static uint FlushMeta(uint begin, uint end)
 {
-    MapPos ret = {0};
-    FSHeader* header = (si != SCT_END_FLAG) ? ReadSector(HEADER_SCT_IDX) : NULL;
+    uint ret = 1;
+    uint i = 0;
 
-    if( header )
+    for(i=0; i<META_SLOT_CNT; i++)
     {
-        uint offset = si - header->mapSize - FIXED_SCT_SIZE;
-        uint sctOff = offset / MAP_ITEM_CNT;
-        uint idxOff = offset % MAP_ITEM_CNT;
-        uint* ps = ReadSector(sctOff + FIXED_SCT_SIZE);
+        MetaSlot* ms = &gMeta[i];
 
-        if( ps )
+        if( ms->dirty && (begin <= ms->si) && (ms->si < end) )
         {
-            ret.pSct = ps;
-            ret.sctIdx = si;
-            ret.sctOff = sctOff;
-            ret.idxOff = idxOff;
+            ms->dirty = (gDev->write(gDev, ms->si, ms->data, 1) != 1);
+
+            ret = ret && !ms->dirty;
         }
     }
 
-    Free(header);
-
     return ret;
 }
 
-static uint AllocSector()
+static uint WriteBackMeta()
 {
-    uint ret = SCT_END_FLAG;
-    FSHeader* header = ReadSector(HEADER_SCT_IDX);
+    return FlushMeta(FIXED_SCT_SIZE, gMetaEnd) &&
+           FlushMeta(ROOT_SCT_IDX, FIXED_SCT_SIZE) &&
+           FlushMeta(HEADER_SCT_IDX, ROOT_SCT_IDX);
+}
+
+static MetaSlot* FindMeta(uint si, uint load)
+{
+    MetaSlot* ret = NULL;
+    uint i = 0;
 
-    if( header && (header->freeBegin != SCT_END_FLAG) )
+    for(i=0; !ret && (i<META_SLOT_CNT); i++)
     {
-        MapPos mp = FindInMap(header->freeBegin);
+        ret = (gMeta[i].si == si) ? &gMeta[i] : NULL;
+    }
 
-        if( mp.pSct )
-        {
-            uint* pInt = AddrOff(mp.pSct, mp.idxOff);
-            uint next = *pInt;
-            uint flag = 1;
+    for(i=0; !ret && (i<META_SLOT_CNT); i++)
+    {
+        uint j = (gMetaNext + i) % META_SLOT_CNT;
 
-            ret = header->freeBegin;
+        ret = !gMeta[j].dirty ? &gMeta[j] : NULL;
+    }
 
-            header->freeBegin = next + FIXED_SCT_SIZE + header->mapSize;
-            header->freeNum--;
+    if( !ret && WriteBackMeta() )
+    {
+        ret = &gMeta[gMetaNext];
+    }
 
-            *pInt = SCT_END_FLAG;
+    if( ret && (ret->si != si) )
+    {
+        gMetaNext = (ret - gMeta + 1) % META_SLOT_CNT;
 
-            flag = flag && HDRawWrite(HEADER_SCT_IDX, (byte*)header);
-            flag = flag && HDRawWrite(mp.sctOff + FIXED_SCT_SIZE, (byte*)mp.pSct);
+        ret->si = SCT_END_FLAG;
 
-            if( !flag )
-            {
-                ret = SCT_END_FLAG;
-            }
+        if( !load || (gDev->read(gDev, si, ret->data, 1) == 1) )
+        {
+            ret->si = si;
+        }
+        else
+        {
+            ret = NULL;
         }
-
-        Free(mp.pSct);
     }
 
-    Free(header);
-
     return ret;
 }
 
-static uint FreeSector(uint si)
+static uint DiskRead(uint si, byte* buf)
 {
-    FSHeader* header = (si != SCT_END_FLAG) ? ReadSector(HEADER_SCT_IDX) : NULL;
     uint ret = 0;
+    MetaSlot* ms = (si < gMetaEnd) ? FindMeta(si, 1) : NULL;
 
-    if( header )
+    if( ms )
     {
-        MapPos mp = FindInMap(si);
-
-        if( mp.pSct )
-        {
-            uint* pInt = AddrOff(mp.pSct, mp.idxOff);
-
-            *pInt = header->freeBegin - FIXED_SCT_SIZE - header->mapSize;
+        MemCpy(buf, ms->data, SECT_SIZE);
 
-            header->freeBegin = si;
-            header->freeNum++;
-
-            ret = HDRawWrite(HEADER_SCT_IDX, (byte*)header) &&
-                  HDRawWrite(mp.sctOff + FIXED_SCT_SIZE, (byte*)mp.pSct);
-        }
-
-        Free(mp.pSct);
+        ret = 1;
+    }
+    else if( si >= gMetaEnd )
+    {
+        ret = (gDev->read(gDev, si, buf, 1) == 1);
     }
-
-    Free(header);
 
     return ret;
 }
 
-static uint NextSector(uint si)
+static uint DiskWrite(uint si, byte* buf)
 {
-    FSHeader* header = (si != SCT_END_FLAG) ? ReadSector(HEADER_SCT_IDX) : NULL;
-    uint ret = SCT_END_FLAG;
+    uint ret = 0;
+    MetaSlot* ms = (si < gMetaEnd) ? FindMeta(si, 0) : NULL;
 
-    if( header )
+    if( ms )
     {
-        MapPos mp = FindInMap(si);
-
-        if( mp.pSct )
-        {
-            uint* pInt = AddrOff(mp.pSct, mp.idxOff);
+        MemCpy(ms->data, buf, SECT_SIZE);
 
-            if( *pInt != SCT_END_FLAG )
-            {
-                ret = *pInt + header->mapSize + FIXED_SCT_SIZE;
-            }
-        }
+        ms->dirty = 1;
 
-        Free(mp.pSct);
+        ret = 1;
+    }
+    else if( si >= gMetaEnd )
+    {
+        ret = (gDev->write(gDev, si, buf, 1) == 1);
     }
-
-    Free(header);
 
     return ret;
 }
 
-static uint FindLast(uint sctBegin)
+static uint RawN(uint si, byte* buf, uint n, uint write)
 {
-    uint ret = SCT_END_FLAG;
-    uint next = sctBegin;
+    uint ret = (gDefer && gDev->queue) ? gDev->queue(gDev, si, buf, n, write) : 0;
 
-    while( next != SCT_END_FLAG )
+    if( !ret )
     {
-        ret = next;
-        next = NextSector(next);
+        ret = write ? gDev->write(gDev, si, buf, n) : gDev->read(gDev, si, buf, n);
     }
 
     return ret;
 }
 
-static uint FindPrev(uint sctBegin, uint si)
+static uint DiskReadN(uint si, byte* buf, uint n)
 {
-    uint ret = SCT_END_FLAG;
-    uint next = sctBegin;
+    uint ret = 1;
+    uint i = 0;
 
-    while( (next != SCT_END_FLAG) && (next != si) )
+    while( ret && (i < n) )
     {
-        ret = next;
-        next = NextSector(next);
-    }
+        uint k = (si + i >= gMetaEnd) ? RawN(si + i, AddrOff(buf, i * SECT_SIZE), n - i, 0) : DiskRead(si + i, AddrOff(buf, i * SECT_SIZE));
 
-    if( next == SCT_END_FLAG )
-    {
-        ret = SCT_END_FLAG;
+        ret = !!k;
+        i += k;
     }
 
     return ret;
 }
 
-static uint FindIndex(uint sctBegin, uint idx)
+static uint DiskWriteN(uint si, byte* buf, uint n)
 {
-    uint ret = sctBegin;
+    uint ret = 1;
     uint i = 0;
 
-    while( (i < idx) && (ret != SCT_END_FLAG) )
+    while( ret && (i < n) )
     {
-        ret = NextSector(ret);
+        uint k = (si + i >= gMetaEnd) ? RawN(si + i, AddrOff(buf, i * SECT_SIZE), n - i, 1) : DiskWrite(si + i, AddrOff(buf, i * SECT_SIZE));
 
-        i++;
+        ret = !!k;
+        i += k;
     }
 
     return ret;
 }
 
-static uint MarkSector(uint si)
+static uint RunLength(uint* sct, uint n)
 {
-    uint ret = (si == SCT_END_FLAG) ? 1 : 0;
-    MapPos mp = FindInMap(si);
+    uint ret = 1;
 
-    if( mp.pSct )
+    while( (ret < n) && (sct[ret] == sct[0] + ret) )
     {
-        uint *pInt = AddrOff(mp.pSct, mp.idxOff);
-
-        *pInt = SCT_END_FLAG;
-
-        ret = HDRawWrite(mp.sctOff + FIXED_SCT_SIZE, (byte*)mp.pSct);
+        ret++;
     }
 
-    Free(mp.pSct);
-
     return ret;
 }
 
-static void AddToLast(uint sctBegin, uint si)
+static void* SctAlloc()
 {
-    uint last = FindLast(sctBegin);
+    void* ret = NULL;
+    uint i = 0;
 
-    if( last != SCT_END_FLAG )
+    for(i=0; i<SCT_ARENA_SIZE; i++)
     {
-        MapPos lmp = FindInMap(last);
-        MapPos smp = FindInMap(si);
-
-        if( lmp.pSct && smp.pSct )
+        if( !(gSctUsed & (1 << i)) )
         {
-            if( lmp.sctOff == smp.sctOff )
-            {
-                uint* pInt = AddrOff(lmp.pSct, lmp.idxOff);
-
-                *pInt = lmp.sctOff * MAP_ITEM_CNT + smp.idxOff;
-
-                pInt = AddrOff(lmp.pSct, smp.idxOff);
-
-                *pInt = SCT_END_FLAG;
-
-                HDRawWrite(lmp.sctOff + FIXED_SCT_SIZE, (byte*)lmp.pSct);
-            }
-            else
-            {
-                uint* pInt = AddrOff(lmp.pSct, lmp.idxOff);
+            gSctUsed |= (1 << i);
 
-                *pInt = smp.sctOff * MAP_ITEM_CNT + smp.idxOff;
+            ret = gSctArena[i];
 
-                pInt = AddrOff(smp.pSct, smp.idxOff);
+            break;
+        }
+    }
 
-                *pInt = SCT_END_FLAG;
+    return ret;
+}
 
-                HDRawWrite(lmp.sctOff + FIXED_SCT_SIZE, (byte*)lmp.pSct);
-                HDRawWrite(smp.sctOff + FIXED_SCT_SIZE, (byte*)smp.pSct);
-            }
-        }
+static void SctFree(void* p)
+{
+    uint i = ((uint)p - (uint)gSctArena) / SECT_SIZE;
 
-        Free(lmp.pSct);
-        Free(smp.pSct);
+    if( p && (i < SCT_ARENA_SIZE) )
+    {
+        gSctUsed &= ~(1 << i);
     }
 }
 
-static uint CheckStorage(FSRoot* fe)
+static void* ReadSector(uint si)
 {
-    uint ret = 0;
+    void* ret = NULL;
 
-    if( fe->lastBytes == SECT_SIZE )
+    if( si != SCT_END_FLAG )
     {
-        uint si = AllocSector();
+        ret = SctAlloc();
 
-        if( si != SCT_END_FLAG )
+        if( !(ret && DiskRead(si, (byte*)ret)) )
         {
-            if( fe->sctBegin == SCT_END_FLAG )
-            {
-                fe->sctBegin = si;
-            }
-            else
-            {
-                AddToLast(fe->sctBegin, si);
-            }
-
-            fe->sctNum++;
-            fe->lastBytes = 0;
-
-            ret = 1;
+            SctFree(ret);
+            ret = NULL;
         }
     }
 
     return ret;
 }
 
-static uint CreateFileEntry(const char* name, uint sctBegin, uint lastBytes)
+static void ResetEntries()
 {
-    uint ret = 0;
-    uint last = FindLast(sctBegin);
-    FileEntry* feBase = NULL;
+    uint i = 0;
 
-    if( (last != SCT_END_FLAG) && (feBase = (FileEntry*)ReadSector(last)) )
+    for(i=0; i<ENTRY_SLOT_CNT; i++)
     {
-        uint offset = lastBytes / FE_BYTES;
-        FileEntry* fe = AddrOff(feBase, offset);
+        gEntry[i].fe.inSctIdx = SCT_END_FLAG;
+        gEntry[i].dirty = 0;
+    }
 
-        StrCpy(fe->name, name, sizeof(fe->name) - 1);
+    gEntryNext = 0;
+}
 
-        fe->type = 0;
-        fe->sctBegin = SCT_END_FLAG;
-        fe->sctNum = 0;
-        fe->inSctIdx = last;
-        fe->inSctOff = offset;
-        fe->lastBytes = SECT_SIZE;
+static EntrySlot* FindEntrySlot(uint si, uint off)
+{
+    EntrySlot* ret = NULL;
+    uint i = 0;
 
-        ret = HDRawWrite(last, (byte*)feBase);
-    }
+    for(i=0; !ret && (si != SCT_END_FLAG) && (i<ENTRY_SLOT_CNT); i++)
+    {
+        FileEntry* fe = &gEntry[i].fe;
 
-    Free(feBase);
+        ret = ((fe->inSctIdx == si) && (fe->inSctOff == off)) ? &gEntry[i] : NULL;
+    }
 
     return ret;
 }
 
-static uint CreateInRoot(const char* name)
+static EntrySlot* FindEntryByName(const char* name)
 {
-    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
-    uint ret = 0;
+    EntrySlot* ret = NULL;
+    uint i = 0;
 
-    if( root )
+    for(i=0; !ret && (i<ENTRY_SLOT_CNT); i++)
     {
-        CheckStorage(root);
-
-        if( CreateFileEntry(name, root->sctBegin, root->lastBytes) )
-        {
-            root->lastBytes += FE_BYTES;
+        FileEntry* fe = &gEntry[i].fe;
 
-            ret = HDRawWrite(ROOT_SCT_IDX, (byte*)root);
-        }
+        ret = ((fe->inSctIdx != SCT_END_FLAG) && StrCmp(fe->name, name, -1)) ? &gEntry[i] : NULL;
     }
 
-    Free(root);
-
     return ret;
 }
 
-static FileEntry* FindInSector(const char* name, FileEntry* feBase, uint cnt)
+static void DropEntry(uint si, uint off)
+{
+    EntrySlot* es = FindEntrySlot(si, off);
+
+    if( es )
+    {
+        es->fe.inSctIdx = SCT_END_FLAG;
+        es->dirty = 0;
+    }
+}
+
+static uint FlushEntries()
 {
-    FileEntry* ret = NULL;
+    uint ret = 1;
     uint i = 0;
+    uint j = 0;
 
-    for(i=0; i<cnt; i++)
+    for(i=0; i<ENTRY_SLOT_CNT; i++)
     {
-        FileEntry* fe = AddrOff(feBase, i);
+        uint si = gEntry[i].fe.inSctIdx;
+        FileEntry* feBase = gEntry[i].dirty ? (FileEntry*)ReadSector(si) : NULL;
 
-        if( StrCmp(fe->name, name, -1) )
+        if( feBase )
         {
-            ret = (FileEntry*)Malloc(FE_BYTES);
+            uint ok = 0;
 
-            if( ret )
+            for(j=i; j<ENTRY_SLOT_CNT; j++)
             {
-                *ret = *fe;
+                EntrySlot* es = &gEntry[j];
+
+                if( es->dirty && (es->fe.inSctIdx == si) )
+                {
+                    *((FileEntry*)AddrOff(feBase, es->fe.inSctOff)) = es->fe;
+                }
             }
 
-            break;
+            ok = DiskWrite(si, (byte*)feBase);
+
+            for(j=i; ok && (j<ENTRY_SLOT_CNT); j++)
+            {
+                gEntry[j].dirty = gEntry[j].dirty && (gEntry[j].fe.inSctIdx != si);
+            }
+
+            ret = ret && ok;
+        }
+        else
+        {
+            ret = ret && !gEntry[i].dirty;
         }
+
+        SctFree(feBase);
     }
 
     return ret;
 }
 
-static FileEntry* FindFileEntry(const char* name, uint sctBegin, uint sctNum, uint lastBytes)
+static EntrySlot* TakeEntrySlot()
 {
-    FileEntry* ret = NULL;
-    uint next = sctBegin;
+    EntrySlot* ret = NULL;
     uint i = 0;
 
-    for(i=0; i<(sctNum-1); i++)
+    for(i=0; !ret && (i<ENTRY_SLOT_CNT); i++)
     {
-        FileEntry* feBase = (FileEntry*)ReadSector(next);
+        uint j = (gEntryNext + i) % ENTRY_SLOT_CNT;
 
-        if( feBase )
-        {
-            ret = FindInSector(name, feBase, FE_ITEM_CNT);
-        }
+        ret = !gEntry[j].dirty ? &gEntry[j] : NULL;
+    }
 
-        Free(feBase);
+    if( !ret && FlushEntries() )
+    {
+        ret = &gEntry[gEntryNext];
+    }
 
-        if( !ret )
-        {
-            next = NextSector(next);
-        }
-        else
-        {
-            break;
-        }
+    if( ret )
+    {
+        gEntryNext = (ret - gEntry + 1) % ENTRY_SLOT_CNT;
     }
 
-    if( !ret )
-    {
-        uint cnt = lastBytes / FE_BYTES;
-        FileEntry* feBase = (FileEntry*)ReadSector(next);
+    return ret;
+}
 
-        if( feBase )
-        {
-            ret = FindInSector(name, feBase, cnt);
-        }
+static uint CacheEntry(FileEntry* fe, uint dirty)
+{
+    EntrySlot* es = FindEntrySlot(fe->inSctIdx, fe->inSctOff);
 
-        Free(feBase);
+    if( es || (es = TakeEntrySlot()) )
+    {
+        es->dirty = es->dirty || dirty;
+        es->fe = *fe;
     }
 
-    return ret;
+    return !!es;
 }
 
-static FileEntry* FindInRoot(const char* name)
+static uint SameEntry(FileEntry* a, FileEntry* b)
 {
-    FileEntry* ret = NULL;
-    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
+    uint ret = 1;
+    uint i = 0;
 
-    if( root && root->sctNum )
+    for(i=0; ret && (i<(FE_BYTES / sizeof(uint))); i++)
     {
-        ret = FindFileEntry(name, root->sctBegin, root->sctNum, root->lastBytes);
+        ret = (((uint*)a)[i] == ((uint*)b)[i]);
     }
 
-    Free(root);
-
     return ret;
 }
 
-uint FCreate(const char* fn)
+static uint Checkpoint()
 {
-    uint ret = FExisted(fn);
+    return FlushEntries() && WriteBackMeta();
+}
 
-    if( ret == FS_NONEXISTED )
+static uint LogMetaEnd(FSHeader* header)
+{
+    uint ret = 0;
+
+    if( StrCmp(header->magic, FS_MAGIC, -1) && (header->flags & FS_LOG_MODE) )
     {
-        ret = CreateInRoot(fn) ? FS_SUCCEED : FS_FAILED;
+        ret = FIXED_SCT_SIZE + header->mapSize;
     }
 
     return ret;
 }
 
-uint FExisted(const char* fn)
+static void ResetVolume()
 {
-    uint ret = FS_FAILED;
+    FSHeader* header = NULL;
 
-    if( fn )
+    List_Init(&gFDList);
+
+    ResetMeta(0);
+    ResetEntries();
+
+    gDefragIdx = 0;
+    gDefragState = 0;
+    gDedupIdx = 0;
+    gDedupStale = 1;
+
+    if( (header = (FSHeader*)ReadSector(HEADER_SCT_IDX)) )
     {
-        FileEntry* fe = FindInRoot(fn);
+        ResetMeta(LogMetaEnd(header));
+    }
+
+    SctFree(header);
+}
+
+void FSModInit()
+{
+    HDRawModInit();
+
+    gDev = HDRawDevice();
+
+    ResetVolume();
+}
+
+uint FSMount(const BlkDev* dev)
+{
+    uint ret = dev && dev->sectors(dev) && List_IsEmpty(&gFDList) && Checkpoint();
 
-        ret = fe ? FS_EXISTED : FS_NONEXISTED;
+    if( ret )
+    {
+        gDev = dev;
 
-        Free(fe);
+        ResetVolume();
     }
 
     return ret;
 }
 
-static uint IsOpened(const char* name)
+static MapPos FindInMap(uint si)
 {
-    uint ret = 0;
-    ListNode* pos = NULL;
+    MapPos ret = {0};
+    FSHeader* header = (si != SCT_END_FLAG) ? ReadSector(HEADER_SCT_IDX) : NULL;
 
-    List_ForEach(&gFDList, pos)
+    if( header )
     {
-        FileDesc* fd = (FileDesc*)pos;
+        uint offset = si - header->mapSize - FIXED_SCT_SIZE;
+        uint sctOff = offset / MAP_ITEM_CNT;
+        uint idxOff = offset % MAP_ITEM_CNT;
+        uint* ps = ReadSector(sctOff + FIXED_SCT_SIZE);
 
-        if( StrCmp(fd->fe.name, name, -1) )
+        if( ps )
         {
-            ret = 1;
-            break;
+            ret.pSct = ps;
+            ret.sctIdx = si;
+            ret.sctOff = sctOff;
+            ret.idxOff = idxOff;
         }
     }
 
+    SctFree(header);
+
     return ret;
 }
 
-static uint FreeFile(uint sctBegin)
+static uint FreeSector(uint si)
 {
-    uint slider = sctBegin;
+    FSHeader* header = (si != SCT_END_FLAG) ? ReadSector(HEADER_SCT_IDX) : NULL;
     uint ret = 0;
 
-    while( slider != SCT_END_FLAG )
+    if( header )
     {
-        uint next = NextSector(slider);
+        MapPos mp = FindInMap(si);
 
-        ret += FreeSector(slider);
+        if( mp.pSct )
+        {
+            uint* pInt = AddrOff(mp.pSct, mp.idxOff);
 
-        slider = next;
-    }
+            *pInt = (header->freeBegin != SCT_END_FLAG) ? (header->freeBegin - FIXED_SCT_SIZE - header->mapSize) : SCT_END_FLAG;
 
-    return ret;
-}
+            header->freeBegin = si;
+            header->freeNum++;
 
-static void MoveFileEntry(FileEntry* dst, FileEntry* src)
-{
-    uint inSctIdx = dst->inSctIdx;
-    uint inSctOff = dst->inSctOff;
+            ret = DiskWrite(HEADER_SCT_IDX, (byte*)header) &&
+                  DiskWrite(mp.sctOff + FIXED_SCT_SIZE, (byte*)mp.pSct);
+        }
 
-    *dst = *src;
+        SctFree(mp.pSct);
+    }
 
-    dst->inSctIdx = inSctIdx;
-    dst->inSctOff = inSctOff;
+    SctFree(header);
+
+    return ret;
 }
 
-static uint AdjustStorage(FSRoot* fe)
+static uint NextSector(uint si)
 {
-    uint ret = 0;
+    FSHeader* header = (si != SCT_END_FLAG) ? ReadSector(HEADER_SCT_IDX) : NULL;
+    uint ret = SCT_END_FLAG;
 
-    if( !fe->lastBytes )
+    if( header )
     {
-        uint last = FindLast(fe->sctBegin);
-        uint prev = FindPrev(fe->sctBegin, last);
+        MapPos mp = FindInMap(si);
 
-        if( FreeSector(last) && MarkSector(prev) )
+        if( mp.pSct )
         {
-            fe->sctNum--;
-            fe->lastBytes = SECT_SIZE;
+            uint* pInt = AddrOff(mp.pSct, mp.idxOff);
 
-            if( !fe->sctNum )
+            if( *pInt != SCT_END_FLAG )
             {
-                fe->sctBegin = SCT_END_FLAG;
+                ret = *pInt + header->mapSize + FIXED_SCT_SIZE;
             }
-
-            ret = 1;
         }
+
+        SctFree(mp.pSct);
     }
 
+    SctFree(header);
+
     return ret;
 }
 
-static uint EraseLast(FSRoot* fe, uint bytes)
+static uint WalkChain(uint si, uint* out, uint n)
 {
     uint ret = 0;
+    FSHeader* header = (si != SCT_END_FLAG) ? ReadSector(HEADER_SCT_IDX) : NULL;
+    uint* pSct = NULL;
+    uint loaded = SCT_END_FLAG;
 
-    while( fe->sctNum && bytes )
+    while( header && (ret < n) && (si != SCT_END_FLAG) )
     {
-        if( bytes < fe->lastBytes )
+        uint offset = si - header->mapSize - FIXED_SCT_SIZE;
+        uint sctOff = offset / MAP_ITEM_CNT;
+        uint* pInt = NULL;
+
+        if( sctOff != loaded )
         {
-            fe->lastBytes -= bytes;
+            SctFree(pSct);
 
-            ret += bytes;
+            pSct = ReadSector(sctOff + FIXED_SCT_SIZE);
+            loaded = sctOff;
+        }
 
-            bytes = 0;
+        if( pSct )
+        {
+            pInt = AddrOff(pSct, offset % MAP_ITEM_CNT);
+            si = (*pInt != SCT_END_FLAG) ? (*pInt + header->mapSize + FIXED_SCT_SIZE) : SCT_END_FLAG;
+
+            if( si != SCT_END_FLAG )
+            {
+                out[ret++] = si;
+            }
         }
         else
         {
-            bytes -= fe->lastBytes;
+            break;
+        }
+    }
 
-            ret += fe->lastBytes;
+    SctFree(pSct);
+    SctFree(header);
 
-            fe->lastBytes = 0;
+    return ret;
+}
 
-            AdjustStorage(fe);
-        }
+static uint FindLast(uint sctBegin)
+{
+    uint ret = SCT_END_FLAG;
+    uint next = sctBegin;
+
+    while( next != SCT_END_FLAG )
+    {
+        ret = next;
+        next = NextSector(next);
     }
 
     return ret;
 }
 
-static uint DeleteInRoot(const char* name)
+static uint FindPrev(uint sctBegin, uint si)
 {
-    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
-    FileEntry* fe = FindInRoot(name);
-    uint ret = 0;
+    uint ret = SCT_END_FLAG;
+    uint next = sctBegin;
+
+    while( (next != SCT_END_FLAG) && (next != si) )
+    {
+        ret = next;
+        next = NextSector(next);
+    }
 
-    if( root && fe )
+    if( next == SCT_END_FLAG )
     {
-        uint last = FindLast(root->sctBegin);
-        FileEntry* feTarget = ReadSector(fe->inSctIdx);
-        FileEntry* feLast = (last != SCT_END_FLAG) ? ReadSector(last) : NULL;
+        ret = SCT_END_FLAG;
+    }
 
-        if( feTarget && feLast )
-        {
-            uint lastOff = root->lastBytes / FE_BYTES - 1;
-            FileEntry* lastItem = AddrOff(feLast, lastOff);
-            FileEntry* targetItem = AddrOff(feTarget, fe->inSctOff);
+    return ret;
+}
 
-            FreeFile(targetItem->sctBegin);
+static uint FindIndex(uint sctBegin, uint idx)
+{
+    uint ret = sctBegin;
+    FSHeader* header = (idx && (ret != SCT_END_FLAG)) ? ReadSector(HEADER_SCT_IDX) : NULL;
+    uint* pSct = NULL;
+    uint loaded = SCT_END_FLAG;
 
-            MoveFileEntry(targetItem, lastItem);
+    while( header && idx && (ret != SCT_END_FLAG) )
+    {
+        uint offset = ret - header->mapSize - FIXED_SCT_SIZE;
+        uint sctOff = offset / MAP_ITEM_CNT;
 
-            EraseLast(root, FE_BYTES);
+        if( sctOff != loaded )
+        {
+            SctFree(pSct);
 
-            ret = HDRawWrite(ROOT_SCT_IDX, (byte*)root) &&
-                    HDRawWrite(fe->inSctIdx, (byte*)feTarget);
+            pSct = ReadSector(sctOff + FIXED_SCT_SIZE);
+            loaded = sctOff;
         }
 
-        Free(feTarget);
-        Free(feLast);
+        if( pSct )
+        {
+            uint* pInt = AddrOff(pSct, offset % MAP_ITEM_CNT);
+
+            ret = (*pInt != SCT_END_FLAG) ? (*pInt + header->mapSize + FIXED_SCT_SIZE) : SCT_END_FLAG;
+            idx--;
+        }
+        else
+        {
+            ret = SCT_END_FLAG;
+        }
     }
 
-    Free(root);
-    Free(fe);
+    SctFree(pSct);
+    SctFree(header);
 
     return ret;
 }
 
-uint FOpen(const char *fn)
+static uint MarkSector(uint si)
 {
-    FileDesc* ret = NULL;
+    uint ret = (si == SCT_END_FLAG) ? 1 : 0;
+    MapPos mp = FindInMap(si);
 
-    if( fn && !IsOpened(fn) )
+    if( mp.pSct )
     {
-        FileEntry* fe = NULL;
+        uint *pInt = AddrOff(mp.pSct, mp.idxOff);
 
-        ret = (FileDesc*)Malloc(FD_BYTES);
-        fe = ret ? FindInRoot(fn) : NULL;
+        *pInt = SCT_END_FLAG;
 
-        if( ret && fe )
-        {
-            ret->fe = *fe;
-            ret->objIdx = SCT_END_FLAG;
-            ret->offset = SECT_SIZE;
-            ret->changed = 0;
+        ret = DiskWrite(mp.sctOff + FIXED_SCT_SIZE, (byte*)mp.pSct);
+    }
 
-            List_Add(&gFDList, (ListNode*)ret);
-        }
+    SctFree(mp.pSct);
+
+    return ret;
+}
+
+static void LinkSector(uint last, uint si)
+{
+    MapPos lmp = FindInMap(last);
+    MapPos smp = FindInMap(si);
+
+    if( lmp.pSct && smp.pSct )
+    {
+        uint* pInt = AddrOff(lmp.pSct, lmp.idxOff);
+
+        *pInt = smp.sctOff * MAP_ITEM_CNT + smp.idxOff;
 
-        Free(fe);
+        DiskWrite(lmp.sctOff + FIXED_SCT_SIZE, (byte*)lmp.pSct);
     }
 
-    return (uint)ret;
+    SctFree(lmp.pSct);
+    SctFree(smp.pSct);
 }
 
-static uint IsFDValid(FileDesc* fd)
+static void AddToLast(uint sctBegin, uint si)
 {
-    uint ret = 0;
-    ListNode* pos = NULL;
+    uint last = FindLast(sctBegin);
 
-    List_ForEach(&gFDList, pos)
+    if( last != SCT_END_FLAG )
     {
-        if( IsEqual(pos, fd) )
-        {
-            ret = 1;
-            break;
-        }
+        LinkSector(last, si);
     }
+}
+
+static uint TestAndSet(byte* bits, uint i)
+{
+    uint ret = bits[i / 8] & (1 << (i % 8));
+
+    bits[i / 8] |= (1 << (i % 8));
 
     return ret;
 }
 
-static uint FlushCache(FileDesc* fd)
+static uint IsHeadRun(uint si, uint n)
 {
     uint ret = 1;
+    uint done = 1;
 
-    if( fd->changed )
+    while( ret && (done < n) )
     {
-        uint sctIdx = FindIndex(fd->fe.sctBegin, fd->objIdx);
-
-        ret = 0;
+        uint batch[DIRECT_BATCH] = {0};
+        uint cnt = WalkChain(si, batch, Min(n - done, DIRECT_BATCH));
+        uint i = 0;
 
-        if( (sctIdx != SCT_END_FLAG) && (ret = HDRawWrite(sctIdx, fd->cache)) )
+        for(i=0; ret && (i<cnt); i++)
         {
-            fd->changed = 0;
+            ret = (batch[i] == si + 1);
+            si = batch[i];
         }
+
+        ret = ret && cnt;
+        done += cnt;
     }
 
     return ret;
 }
 
-static uint FlushFileEntry(FileEntry* fe)
+static uint MarkWindow(byte* bits, uint si, uint lo, uint max)
 {
     uint ret = 0;
-    FileEntry* feBase = ReadSector(fe->inSctIdx);
-    FileEntry* feInSct = AddrOff(feBase, fe->inSctOff);
+    uint batch[DIRECT_BATCH] = {0};
+    uint cnt = DIRECT_BATCH;
+    uint i = 0;
 
-    *feInSct = *fe;
+    MemSet(bits, 0, SECT_SIZE);
 
-    ret = HDRawWrite(fe->inSctIdx, (byte*)feBase);
+    if( (lo <= si) && (si < lo + RUN_WINDOW) )
+    {
+        ret += !TestAndSet(bits, si - lo);
+    }
+
+    while( (cnt == DIRECT_BATCH) && (ret < max) )
+    {
+        cnt = WalkChain(si, batch, DIRECT_BATCH);
+
+        for(i=0; i<cnt; i++)
+        {
+            if( (lo <= batch[i]) && (batch[i] < lo + RUN_WINDOW) )
+            {
+                ret += !TestAndSet(bits, batch[i] - lo);
+            }
+        }
 
-    Free(feBase);
+        si = cnt ? batch[cnt - 1] : si;
+    }
 
     return ret;
 }
 
-static uint ToFlush(FileDesc* fd)
+static uint FindFreeRun(uint n)
 {
-    return FlushCache(fd) && FlushFileEntry(&fd->fe);
-}
+    uint ret = SCT_END_FLAG;
+    FSHeader* header = ReadSector(HEADER_SCT_IDX);
+    uint base = header ? (FIXED_SCT_SIZE + header->mapSize) : 0;
+    uint sectors = header ? (header->sctNum - base) : 0;
+    uint head = header && n && (header->freeNum >= n) && IsHeadRun(header->freeBegin, n);
+    byte* bits = (header && n && !head && (header->freeNum >= n)) ? (byte*)SctAlloc() : NULL;
 
-void FClose(uint fd)
+    if( head )
+    {
+        ret = header->freeBegin;
+    }
+    else if( bits )
+    {
+        uint left = header->freeNum;
+        uint run = 0;
+        uint lo = 0;
+        uint i = 0;
+
+        for(lo=0; (lo<sectors) && (ret == SCT_END_FLAG) && (run + left >= n); lo+=RUN_WINDOW)
+        {
+            uint cnt = MarkWindow(bits, header->freeBegin, base + lo, Min(RUN_WINDOW, sectors - lo));
+
+            for(i=0; cnt && (i<RUN_WINDOW) && (lo+i<sectors) && (ret == SCT_END_FLAG); i++)
+            {
+                run = (bits[i / 8] & (1 << (i % 8))) ? (run + 1) : 0;
+
+                if( run == n )
+                {
+                    ret = base + lo + i + 1 - n;
+                }
+            }
+
+            run = cnt ? run : 0;
+            left -= cnt;
+        }
+    }
+
+    SctFree(bits);
+    SctFree(header);
+
+    return ret;
+}
+
+static void Relink(FSHeader* header, uint prev, uint next)
+{
+    if( prev == SCT_END_FLAG )
+    {
+        header->freeBegin = next;
+    }
+    else if( next == SCT_END_FLAG )
+    {
+        MarkSector(prev);
+    }
+    else
+    {
+        LinkSector(prev, next);
+    }
+}
+
+static uint TakeFreeRun(uint begin, uint n)
+{
+    uint ret = 0;
+    FSHeader* header = ReadSector(HEADER_SCT_IDX);
+
+    if( header )
+    {
+        uint batch[DIRECT_BATCH] = {0};
+        uint prev = SCT_END_FLAG;
+        uint si = header->freeBegin;
+        uint skip = 0;
+        uint cnt = 0;
+        uint i = 0;
+
+        while( (si != SCT_END_FLAG) && (ret < n) )
+        {
+            if( (begin <= si) && (si < begin + n) )
+            {
+                ret++;
+                skip = 1;
+            }
+            else
+            {
+                if( skip )
+                {
+                    Relink(header, prev, si);
+                }
+
+                prev = si;
+                skip = 0;
+            }
+
+            if( i == cnt )
+            {
+                cnt = WalkChain(si, batch, DIRECT_BATCH);
+                i = 0;
+            }
+
+            si = (i < cnt) ? batch[i++] : SCT_END_FLAG;
+        }
+
+        if( skip )
+        {
+            Relink(header, prev, si);
+        }
+
+        header->freeNum -= ret;
+
+        ret = DiskWrite(HEADER_SCT_IDX, (byte*)header) && (ret == n);
+    }
+
+    SctFree(header);
+
+    return ret;
+}
+
+static uint InitRun(uint begin, uint n, uint link)
+{
+    uint ret = 1;
+    uint i = 0;
+
+    while( ret && (i < n) )
+    {
+        MapPos mp = FindInMap(begin + i);
+
+        if( (ret = !!mp.pSct) )
+        {
+            uint j = 0;
+
+            for(j=mp.idxOff; (j<MAP_ITEM_CNT) && (i<n); j++, i++)
+            {
+                mp.pSct[j] = (link && (i + 1 < n)) ? (mp.sctOff * MAP_ITEM_CNT + j + 1) : SCT_END_FLAG;
+            }
+
+            ret = DiskWrite(mp.sctOff + FIXED_SCT_SIZE, (byte*)mp.pSct);
+        }
+
+        SctFree(mp.pSct);
+    }
+
+    return ret;
+}
+
+static uint ReleaseChain(uint first, uint last, uint n)
+{
+    uint ret = 0;
+    FSHeader* header = ReadSector(HEADER_SCT_IDX);
+
+    if( header )
+    {
+        if( header->freeBegin != SCT_END_FLAG )
+        {
+            LinkSector(last, header->freeBegin);
+        }
+
+        header->freeBegin = first;
+        header->freeNum += n;
+
+        ret = DiskWrite(HEADER_SCT_IDX, (byte*)header);
+    }
+
+    SctFree(header);
+
+    return ret;
+}
+
+static uint SetMove(uint begin, uint n)
+{
+    uint ret = 0;
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+
+    if( header )
+    {
+        header->moveBegin = begin;
+        header->moveNum = n;
+
+        ret = DiskWrite(HEADER_SCT_IDX, (byte*)header);
+    }
+
+    SctFree(header);
+
+    return ret;
+}
+
+static uint DropMove()
+{
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+    uint begin = header ? header->moveBegin : SCT_END_FLAG;
+    uint n = header ? header->moveNum : 0;
+
+    SctFree(header);
+
+    return !n || (ReleaseChain(begin, begin + n - 1, n) && SetMove(SCT_END_FLAG, 0));
+}
+
+static uint ReserveSegment()
+{
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+    uint ret = header && (header->segNext < header->segEnd);
+    uint begin = SCT_END_FLAG;
+    uint n = SEG_SIZE;
+
+    SctFree(header);
+
+    while( !ret && n && ((begin = FindFreeRun(n)) == SCT_END_FLAG) )
+    {
+        n = n / 2;
+    }
+
+    if( !ret && (begin != SCT_END_FLAG) && TakeFreeRun(begin, n) && InitRun(begin, n, 0) &&
+        (header = (FSHeader*)ReadSector(HEADER_SCT_IDX)) )
+    {
+        header->segNext = begin;
+        header->segEnd = begin + n;
+
+        ret = DiskWrite(HEADER_SCT_IDX, (byte*)header);
+
+        SctFree(header);
+    }
+
+    return ret;
+}
+
+static uint AllocFromSegment(uint* out, uint n)
+{
+    uint ret = 0;
+    FSHeader* header = ReserveSegment() ? (FSHeader*)ReadSector(HEADER_SCT_IDX) : NULL;
+
+    if( header )
+    {
+        uint i = 0;
+
+        ret = Min(n, header->segEnd - header->segNext);
+
+        for(i=0; i<ret; i++)
+        {
+            out[i] = header->segNext + i;
+        }
+
+        header->segNext += ret;
+
+        if( !(DiskWrite(HEADER_SCT_IDX, (byte*)header) && InitRun(out[0], ret, 1)) )
+        {
+            ret = 0;
+        }
+    }
+
+    SctFree(header);
+
+    return ret;
+}
+
+static uint AllocChain(uint* out, uint n)
+{
+    uint ret = (gMetaEnd && n) ? AllocFromSegment(out, n) : 0;
+    FSHeader* header = !ret ? ReadSector(HEADER_SCT_IDX) : NULL;
+
+    if( header && n && (header->freeBegin != SCT_END_FLAG) )
+    {
+        n = (n < header->freeNum) ? n : header->freeNum;
+
+        out[0] = header->freeBegin;
+
+        if( (n == 1) || ((WalkChain(out[0], out + 1, n - 1) + 1) >= n) )
+        {
+            MapPos mp = FindInMap(out[n - 1]);
+
+            if( mp.pSct )
+            {
+                uint* pInt = AddrOff(mp.pSct, mp.idxOff);
+
+                header->freeBegin = (*pInt != SCT_END_FLAG) ? (*pInt + FIXED_SCT_SIZE + header->mapSize) : SCT_END_FLAG;
+                header->freeNum -= n;
+
+                *pInt = SCT_END_FLAG;
+
+                if( DiskWrite(HEADER_SCT_IDX, (byte*)header) && DiskWrite(mp.sctOff + FIXED_SCT_SIZE, (byte*)mp.pSct) )
+                {
+                    ret = n;
+                }
+            }
+
+            SctFree(mp.pSct);
+        }
+    }
+
+    SctFree(header);
+
+    return ret;
+}
+
+static uint AllocSector()
+{
+    uint ret = SCT_END_FLAG;
+
+    return AllocChain(&ret, 1) ? ret : SCT_END_FLAG;
+}
+
+static uint ClearRun(uint begin, uint n)
+{
+    byte* buf = (byte*)SctAlloc();
+    uint ret = !!buf;
+    uint i = 0;
+
+    if( buf )
+    {
+        MemSet(buf, 0, SECT_SIZE);
+    }
+
+    for(i=0; ret && (i<n); i++)
+    {
+        ret = DiskWrite(begin + i, buf);
+    }
+
+    SctFree(buf);
+
+    return ret;
+}
+
+static uint CreatePool()
+{
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+    uint ret = header && header->poolNum;
+    uint n = header ? Max((header->sctNum - FIXED_SCT_SIZE - header->mapSize) / POOL_SCT_RATIO, 1) : 0;
+    uint begin = SCT_END_FLAG;
+
+    SctFree(header);
+
+    while( !ret && n && ((begin = FindFreeRun(n)) == SCT_END_FLAG) )
+    {
+        n = n / 2;
+    }
+
+    if( !ret && (begin != SCT_END_FLAG) && TakeFreeRun(begin, n) && InitRun(begin, n, 1) && ClearRun(begin, n) &&
+        (header = (FSHeader*)ReadSector(HEADER_SCT_IDX)) )
+    {
+        header->poolBegin = begin;
+        header->poolNum = n;
+
+        ret = DiskWrite(HEADER_SCT_IDX, (byte*)header);
+
+        SctFree(header);
+    }
+
+    return ret;
+}
+
+static uint PoolSector(uint hash)
+{
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+    uint ret = (header && header->poolNum) ? (header->poolBegin + hash % header->poolNum) : SCT_END_FLAG;
+
+    SctFree(header);
+
+    return ret;
+}
+
+static PoolEntry* FindEntry(PoolEntry* pe, uint hash, uint sct)
+{
+    PoolEntry* ret = NULL;
+    uint k = 0;
+
+    for(k=0; pe && !ret && (k<POOL_ITEM_CNT); k++)
+    {
+        if( (pe[k].hash == hash) && (pe[k].sct == sct) )
+        {
+            ret = &pe[k];
+        }
+    }
+
+    return ret;
+}
+
+static uint SameSector(uint* a, uint* b)
+{
+    uint ret = 1;
+    uint i = 0;
+
+    for(i=0; ret && (i<MAP_ITEM_CNT); i++)
+    {
+        ret = (a[i] == b[i]);
+    }
+
+    return ret;
+}
+
+static uint Fingerprint(byte* buf)
+{
+    uint ret = 2166136261u;
+    uint i = 0;
+
+    for(i=0; i<SECT_SIZE; i++)
+    {
+        ret = (ret ^ buf[i]) * 16777619u;
+    }
+
+    return ret;
+}
+
+static uint FindShared(uint hash, byte* data)
+{
+    uint ret = SCT_END_FLAG;
+    uint si = PoolSector(hash);
+    PoolEntry* pe = (PoolEntry*)ReadSector(si);
+    byte* buf = pe ? (byte*)SctAlloc() : NULL;
+    uint k = 0;
+
+    for(k=0; buf && (k<POOL_ITEM_CNT) && (ret == SCT_END_FLAG); k++)
+    {
+        if( pe[k].refs && (pe[k].hash == hash) && DiskRead(pe[k].sct, buf) && SameSector((uint*)buf, (uint*)data) )
+        {
+            ret = pe[k].sct;
+        }
+    }
+
+    SctFree(buf);
+    SctFree(pe);
+
+    return ret;
+}
+
+static uint AddShared(uint hash, uint si)
+{
+    uint ret = 0;
+    uint ps = PoolSector(hash);
+    PoolEntry* pe = (PoolEntry*)ReadSector(ps);
+    PoolEntry* seen = FindEntry(pe, hash, SCT_END_FLAG);
+    uint k = 0;
+
+    if( seen )
+    {
+        seen->sct = si;
+        seen->refs = 1;
+
+        ret = DiskWrite(ps, (byte*)pe);
+    }
+    else
+    {
+        seen = FindEntry(pe, 0, 0);
+
+        for(k=0; pe && !seen && (k<POOL_ITEM_CNT); k++)
+        {
+            PoolEntry* e = &pe[(hash + k) % POOL_ITEM_CNT];
+
+            seen = e->refs ? NULL : e;
+        }
+
+        if( seen )
+        {
+            seen->hash = hash;
+            seen->sct = SCT_END_FLAG;
+
+            DiskWrite(ps, (byte*)pe);
+        }
+    }
+
+    SctFree(pe);
+
+    return ret;
+}
+
+static uint DropShared(uint hash, uint si)
+{
+    uint ret = 0;
+    uint ps = PoolSector(hash);
+    PoolEntry* pe = (PoolEntry*)ReadSector(ps);
+    PoolEntry* e = FindEntry(pe, hash, si);
+
+    if( e )
+    {
+        e->sct = SCT_END_FLAG;
+        e->refs = 0;
+
+        ret = DiskWrite(ps, (byte*)pe);
+    }
+
+    SctFree(pe);
+
+    return ret;
+}
+
+static uint RefShared(uint hash, uint sct, uint add)
+{
+    uint ret = 0;
+    uint ps = PoolSector(hash);
+    PoolEntry* pe = (PoolEntry*)ReadSector(ps);
+    PoolEntry* e = FindEntry(pe, hash, sct);
+
+    if( e && (add || e->refs) )
+    {
+        e->refs = add ? (e->refs + 1) : (e->refs - 1);
+
+        if( !e->refs )
+        {
+            FreeSector(e->sct);
+
+            e->hash = 0;
+            e->sct = 0;
+        }
+
+        ret = DiskWrite(ps, (byte*)pe);
+    }
+
+    SctFree(pe);
+
+    return ret;
+}
+
+static uint ReleaseShared(uint si, uint n)
+{
+    uint ret = 0;
+    byte* buf = (byte*)SctAlloc();
+    uint i = 0;
+
+    for(i=0; buf && (i<n); i++)
+    {
+        ret += DiskRead(si + i, buf) && RefShared(Fingerprint(buf), si + i, 0);
+    }
+
+    SctFree(buf);
+
+    return ret;
+}
+
+static uint AppendSector(FSRoot* fe, uint last)
+{
+    uint ret = AllocSector();
+
+    if( ret != SCT_END_FLAG )
+    {
+        if( fe->sctBegin == SCT_END_FLAG )
+        {
+            fe->sctBegin = ret;
+        }
+        else if( last != SCT_END_FLAG )
+        {
+            LinkSector(last, ret);
+        }
+        else
+        {
+            AddToLast(fe->sctBegin, ret);
+        }
+
+        fe->sctNum++;
+        fe->lastBytes = 0;
+    }
+
+    return ret;
+}
+
+static uint CheckStorage(FSRoot* fe)
+{
+    uint ret = 0;
+
+    if( fe->lastBytes == SECT_SIZE )
+    {
+        ret = (AppendSector(fe, SCT_END_FLAG) != SCT_END_FLAG);
+    }
+
+    return ret;
+}
+
+static uint CreateFileEntry(const char* name, uint sctBegin, uint lastBytes)
+{
+    uint ret = 0;
+    uint last = FindLast(sctBegin);
+    FileEntry* feBase = NULL;
+
+    if( (last != SCT_END_FLAG) && (feBase = (FileEntry*)ReadSector(last)) )
+    {
+        uint offset = lastBytes / FE_BYTES;
+        FileEntry* fe = AddrOff(feBase, offset);
+
+        StrCpy(fe->name, name, sizeof(fe->name) - 1);
+
+        fe->type = FT_CONTIG;
+        fe->reserved[0] = 0;
+        fe->reserved[1] = 0;
+        fe->sctBegin = SCT_END_FLAG;
+        fe->sctNum = 0;
+        fe->inSctIdx = last;
+        fe->inSctOff = offset;
+        fe->lastBytes = SECT_SIZE;
+
+        ret = DiskWrite(last, (byte*)feBase) && CacheEntry(fe, 0);
+    }
+
+    SctFree(feBase);
+
+    return ret;
+}
+
+static uint CreateInRoot(const char* name)
+{
+    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
+    uint ret = 0;
+
+    if( root )
+    {
+        CheckStorage(root);
+
+        if( CreateFileEntry(name, root->sctBegin, root->lastBytes) )
+        {
+            root->lastBytes += FE_BYTES;
+
+            ret = DiskWrite(ROOT_SCT_IDX, (byte*)root);
+        }
+    }
+
+    SctFree(root);
+
+    return ret;
+}
+
+static uint FindInSector(const char* name, FileEntry* feBase, uint cnt, FileEntry* out)
+{
+    uint ret = 0;
+    uint i = 0;
+
+    for(i=0; i<cnt; i++)
+    {
+        FileEntry* fe = AddrOff(feBase, i);
+
+        if( StrCmp(fe->name, name, -1) )
+        {
+            *out = *fe;
+
+            ret = 1;
+
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static uint FindFileEntry(const char* name, uint sctBegin, uint sctNum, uint lastBytes, FileEntry* out)
+{
+    uint ret = 0;
+    uint next = sctBegin;
+    uint i = 0;
+
+    for(i=0; i<(sctNum-1); i++)
+    {
+        FileEntry* feBase = (FileEntry*)ReadSector(next);
+
+        if( feBase )
+        {
+            ret = FindInSector(name, feBase, FE_ITEM_CNT, out);
+        }
+
+        SctFree(feBase);
+
+        if( !ret )
+        {
+            next = NextSector(next);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if( !ret )
+    {
+        uint cnt = lastBytes / FE_BYTES;
+        FileEntry* feBase = (FileEntry*)ReadSector(next);
+
+        if( feBase )
+        {
+            ret = FindInSector(name, feBase, cnt, out);
+        }
+
+        SctFree(feBase);
+    }
+
+    return ret;
+}
+
+static uint FindInRoot(const char* name, FileEntry* out)
+{
+    uint ret = 0;
+    EntrySlot* es = FindEntryByName(name);
+    FSRoot* root = es ? NULL : (FSRoot*)ReadSector(ROOT_SCT_IDX);
+
+    if( es )
+    {
+        *out = es->fe;
+
+        ret = 1;
+    }
+    else if( root && root->sctNum )
+    {
+        ret = FindFileEntry(name, root->sctBegin, root->sctNum, root->lastBytes, out) && CacheEntry(out, 0);
+    }
+
+    SctFree(root);
+
+    return ret;
+}
+
+uint FCreate(const char* fn)
+{
+    uint ret = FExisted(fn);
+
+    if( ret == FS_NONEXISTED )
+    {
+        ret = (CreateInRoot(fn) && Checkpoint()) ? FS_SUCCEED : FS_FAILED;
+    }
+
+    return ret;
+}
+
+uint FExisted(const char* fn)
+{
+    uint ret = FS_FAILED;
+
+    if( fn )
+    {
+        FileEntry fe = {0};
+
+        ret = FindInRoot(fn, &fe) ? FS_EXISTED : FS_NONEXISTED;
+    }
+
+    return ret;
+}
+
+static FileDesc* FindOpened(const char* name)
+{
+    FileDesc* ret = NULL;
+    ListNode* pos = NULL;
+
+    List_ForEach(&gFDList, pos)
+    {
+        FileDesc* fd = (FileDesc*)pos;
+
+        if( StrCmp(fd->fe.name, name, -1) )
+        {
+            ret = fd;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static uint FreeFile(uint sctBegin)
+{
+    uint slider = sctBegin;
+    uint ret = 0;
+
+    while( slider != SCT_END_FLAG )
+    {
+        uint next = NextSector(slider);
+
+        ret += FreeSector(slider);
+
+        slider = next;
+    }
+
+    return ret;
+}
+
+static void MoveFileEntry(FileEntry* dst, FileEntry* src)
+{
+    uint inSctIdx = dst->inSctIdx;
+    uint inSctOff = dst->inSctOff;
+
+    *dst = *src;
+
+    dst->inSctIdx = inSctIdx;
+    dst->inSctOff = inSctOff;
+}
+
+static HoleRange* FindHole(HoleTable* ht, uint idx)
+{
+    HoleRange* ret = NULL;
+    uint i = 0;
+
+    for(i=0; ht && (i<ht->cnt) && (ht->range[i].begin <= idx); i++)
+    {
+        if( idx < (ht->range[i].begin + ht->range[i].num) )
+        {
+            ret = &ht->range[i];
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static uint IsAdjacent(HoleRange* hr, uint begin, uint sct)
+{
+    return ((hr->begin + hr->num) == begin) &&
+           ((hr->sct == SCT_END_FLAG) ? (sct == SCT_END_FLAG) : (sct == (hr->sct + hr->num)));
+}
+
+static uint InsertRange(HoleTable* ht, uint begin, uint num, uint sct)
+{
+    uint ret = 1;
+    HoleRange cur = {begin, num, sct};
+    uint i = 0;
+    uint j = 0;
+
+    while( (i < ht->cnt) && (ht->range[i].begin < begin) )
+    {
+        i++;
+    }
+
+    if( i && IsAdjacent(&ht->range[i - 1], begin, sct) )
+    {
+        HoleRange* prev = &ht->range[i - 1];
+
+        prev->num += num;
+
+        if( (i < ht->cnt) && IsAdjacent(prev, ht->range[i].begin, ht->range[i].sct) )
+        {
+            prev->num += ht->range[i].num;
+
+            for(ht->cnt--; i<ht->cnt; i++)
+            {
+                ht->range[i] = ht->range[i + 1];
+            }
+        }
+    }
+    else if( (i < ht->cnt) && IsAdjacent(&cur, ht->range[i].begin, ht->range[i].sct) )
+    {
+        ht->range[i].begin = begin;
+        ht->range[i].num += num;
+        ht->range[i].sct = sct;
+    }
+    else if( ht->cnt < HOLE_ITEM_CNT )
+    {
+        for(j=ht->cnt; j>i; j--)
+        {
+            ht->range[j] = ht->range[j - 1];
+        }
+
+        ht->range[i] = cur;
+        ht->cnt++;
+    }
+    else
+    {
+        ret = 0;
+    }
+
+    return ret;
+}
+
+static uint DropHoles(HoleTable* ht, uint idx, uint n)
+{
+    uint ret = 0;
+    HoleRange* hr = FindHole(ht, idx);
+
+    if( hr && n && ((idx + n) <= (hr->begin + hr->num)) )
+    {
+        uint i = AddrIndex(hr, ht->range);
+        uint end = hr->begin + hr->num;
+        uint shared = (hr->sct != SCT_END_FLAG) ? (hr->sct + idx - hr->begin) : SCT_END_FLAG;
+
+        ret = 1;
+
+        if( idx == hr->begin )
+        {
+            hr->begin += n;
+            hr->num -= n;
+            hr->sct += (shared != SCT_END_FLAG) ? n : 0;
+        }
+        else if( (idx + n) == end )
+        {
+            hr->num -= n;
+        }
+        else if( ht->cnt < HOLE_ITEM_CNT )
+        {
+            uint j = 0;
+
+            for(j=ht->cnt; j>(i+1); j--)
+            {
+                ht->range[j] = ht->range[j - 1];
+            }
+
+            ht->range[i + 1].begin = idx + n;
+            ht->range[i + 1].num = end - idx - n;
+            ht->range[i + 1].sct = (shared != SCT_END_FLAG) ? (shared + n) : SCT_END_FLAG;
+            ht->cnt++;
+
+            hr->num = idx - hr->begin;
+        }
+        else
+        {
+            ret = 0;
+        }
+
+        if( ret && (shared != SCT_END_FLAG) )
+        {
+            ReleaseShared(shared, n);
+        }
+
+        if( ret && !hr->num )
+        {
+            for(ht->cnt--; i<ht->cnt; i++)
+            {
+                ht->range[i] = ht->range[i + 1];
+            }
+        }
+    }
+
+    return ret;
+}
+
+static void ReleaseRanges(uint si)
+{
+    HoleTable* ht = (HoleTable*)ReadSector(si);
+    uint i = 0;
+
+    for(i=0; ht && (i<ht->cnt) && (i<HOLE_ITEM_CNT); i++)
+    {
+        if( ht->range[i].sct != SCT_END_FLAG )
+        {
+            ReleaseShared(ht->range[i].sct, ht->range[i].num);
+        }
+    }
+
+    SctFree(ht);
+}
+
+static uint AdjustStorage(FSRoot* fe, HoleTable* ht)
+{
+    uint ret = 0;
+
+    if( !fe->lastBytes )
+    {
+        if( FindHole(ht, fe->sctNum - 1) )
+        {
+            ret = DropHoles(ht, fe->sctNum - 1, 1);
+        }
+        else
+        {
+            uint last = FindLast(fe->sctBegin);
+            uint prev = FindPrev(fe->sctBegin, last);
+
+            ret = FreeSector(last) && MarkSector(prev);
+
+            if( ret && (prev == SCT_END_FLAG) )
+            {
+                fe->sctBegin = SCT_END_FLAG;
+            }
+        }
+
+        if( ret )
+        {
+            fe->sctNum--;
+            fe->lastBytes = SECT_SIZE;
+        }
+    }
+
+    return ret;
+}
+
+static uint EraseLast(FSRoot* fe, uint bytes, HoleTable* ht)
+{
+    uint ret = 0;
+
+    while( fe->sctNum && bytes )
+    {
+        if( bytes < fe->lastBytes )
+        {
+            fe->lastBytes -= bytes;
+
+            ret += bytes;
+
+            bytes = 0;
+        }
+        else
+        {
+            bytes -= fe->lastBytes;
+
+            ret += fe->lastBytes;
+
+            fe->lastBytes = 0;
+
+            AdjustStorage(fe, ht);
+        }
+    }
+
+    return ret;
+}
+
+static uint DeleteInRoot(const char* name)
+{
+    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
+    FileEntry fe = {0};
+    uint ret = 0;
+
+    if( root && FindInRoot(name, &fe) && FlushEntries() )
+    {
+        uint last = FindLast(root->sctBegin);
+        FileEntry* feTarget = ReadSector(fe.inSctIdx);
+        FileEntry* feLast = (last != SCT_END_FLAG) ? ReadSector(last) : NULL;
+
+        if( feTarget && feLast )
+        {
+            FileDesc* moved = NULL;
+            uint lastOff = root->lastBytes / FE_BYTES - 1;
+            FileEntry* lastItem = AddrOff(feLast, lastOff);
+            FileEntry* targetItem = AddrOff(feTarget, fe.inSctOff);
+
+            FreeFile(targetItem->sctBegin);
+
+            if( targetItem->type & FT_SPARSE )
+            {
+                ReleaseRanges(targetItem->reserved[0]);
+                FreeSector(targetItem->reserved[0]);
+            }
+
+            DropEntry(fe.inSctIdx, fe.inSctOff);
+            DropEntry(last, lastOff);
+
+            MoveFileEntry(targetItem, lastItem);
+
+            if( (moved = FindOpened(targetItem->name)) )
+            {
+                moved->fe.inSctIdx = targetItem->inSctIdx;
+                moved->fe.inSctOff = targetItem->inSctOff;
+            }
+
+            EraseLast(root, FE_BYTES, NULL);
+
+            ret = DiskWrite(ROOT_SCT_IDX, (byte*)root) &&
+                    DiskWrite(fe.inSctIdx, (byte*)feTarget);
+        }
+
+        SctFree(feTarget);
+        SctFree(feLast);
+    }
+
+    SctFree(root);
+
+    return ret;
+}
+
+static uint LoadHoles(FileDesc* fd)
+{
+    uint ret = 1;
+
+    fd->holes = NULL;
+
+    if( fd->fe.type & FT_SPARSE )
+    {
+        fd->holes = (HoleTable*)Malloc(SECT_SIZE);
+
+        if( !(fd->holes && DiskRead(fd->fe.reserved[0], (byte*)fd->holes)) )
+        {
+            Free(fd->holes);
+
+            fd->holes = NULL;
+
+            ret = 0;
+        }
+    }
+
+    return ret;
+}
+
+uint FOpen(const char *fn)
+{
+    FileDesc* ret = NULL;
+
+    if( fn && !FindOpened(fn) )
+    {
+        ret = (FileDesc*)Malloc(FD_BYTES);
+
+        if( ret && FindInRoot(fn, &ret->fe) && LoadHoles(ret) )
+        {
+            ret->seek = 0;
+            ret->objIdx = SCT_END_FLAG;
+            ret->sctIdx = SCT_END_FLAG;
+            ret->offset = SECT_SIZE;
+            ret->changed = 0;
+            ret->hint = FS_ADV_NORMAL;
+            ret->aheadNum = 0;
+            ret->ahead = NULL;
+            ret->dropIdx = 0;
+            ret->dropEnd = 0;
+            ret->ringPos = 0;
+
+            gDefragStale = gDefragStale || StrCmp(fn, gDefragFe.name, -1);
+            gDedupStale = gDedupStale || StrCmp(fn, gDedupFe.name, -1);
+
+            List_Add(&gFDList, (ListNode*)ret);
+        }
+        else
+        {
+            Free(ret);
+
+            ret = NULL;
+        }
+    }
+
+    return (uint)ret;
+}
+
+static uint IsFDValid(FileDesc* fd)
+{
+    uint ret = 0;
+    ListNode* pos = NULL;
+
+    List_ForEach(&gFDList, pos)
+    {
+        if( IsEqual(pos, fd) )
+        {
+            ret = 1;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static uint FlushCache(FileDesc* fd)
+{
+    uint ret = 1;
+
+    if( fd->changed )
+    {
+        ret = 0;
+
+        if( (fd->sctIdx != SCT_END_FLAG) && (ret = DiskWrite(fd->sctIdx, fd->cache)) )
+        {
+            fd->changed = 0;
+        }
+    }
+
+    return ret;
+}
+
+static uint FlushFileEntry(FileEntry* fe)
+{
+    EntrySlot* es = FindEntrySlot(fe->inSctIdx, fe->inSctOff);
+
+    return (es && SameEntry(&es->fe, fe)) || CacheEntry(fe, 1);
+}
+
+static uint ToFlush(FileDesc* fd)
+{
+    return FlushCache(fd) && FlushFileEntry(&fd->fe);
+}
+
+void FClose(uint fd)
+{
+    FileDesc* pf = (FileDesc*)fd;
+
+    if( IsFDValid(pf) )
+    {
+        ToFlush(pf);
+        Checkpoint();
+
+        List_DelNode((ListNode*)pf);
+
+        Free(pf->holes);
+        Free(pf->ahead);
+        Free(pf);
+    }
+}
+
+static uint IsHole(FileDesc* fd, uint idx)
+{
+    return fd->holes && FindHole(fd->holes, idx);
+}
+
+static uint HoleRun(FileDesc* fd, uint idx)
+{
+    uint ret = fd->fe.sctNum - idx;
+    uint i = 0;
+
+    for(i=0; fd->holes && (i<fd->holes->cnt); i++)
+    {
+        HoleRange* hr = &fd->holes->range[i];
+
+        if( idx < (hr->begin + hr->num) )
+        {
+            ret = (idx < hr->begin) ? (hr->begin - idx) : (hr->begin + hr->num - idx);
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static uint SharedSector(FileDesc* fd, uint idx)
+{
+    HoleRange* hr = fd->holes ? FindHole(fd->holes, idx) : NULL;
+
+    return (hr && (hr->sct != SCT_END_FLAG)) ? (hr->sct + idx - hr->begin) : SCT_END_FLAG;
+}
+
+static uint ChainIdx(FileDesc* fd, uint idx)
+{
+    uint ret = idx;
+    uint i = 0;
+
+    for(i=0; fd->holes && (i<fd->holes->cnt) && (fd->holes->range[i].begin < idx); i++)
+    {
+        HoleRange* hr = &fd->holes->range[i];
+
+        ret -= Min(hr->num, idx - hr->begin);
+    }
+
+    return ret;
+}
+
+static uint IsFragmented(uint* chain, uint n)
+{
+    uint ret = 0;
+    uint i = 0;
+
+    for(i=1; !ret && (i<n); i++)
+    {
+        ret = (chain[i] != chain[i-1] + 1);
+    }
+
+    return ret;
+}
+
+static uint IsContig(FileDesc* fd)
+{
+    return !!(fd->fe.type & FT_CONTIG);
+}
+
+static uint ContigSector(FileDesc* fd, uint idx)
+{
+    return fd->fe.sctBegin + ChainIdx(fd, idx);
+}
+
+static void KeepContig(FileDesc* fd, uint* sct, uint n)
+{
+    if( IsContig(fd) && (IsFragmented(sct, n) || (sct[n - 1] + 1 != ContigSector(fd, fd->fe.sctNum))) )
+    {
+        fd->fe.type &= ~FT_CONTIG;
+    }
+}
+
+static uint SaveHoles(FileDesc* fd)
+{
+    return DiskWrite(fd->fe.reserved[0], (byte*)fd->holes);
+}
+
+static uint MakeSparse(FileDesc* fd)
+{
+    uint ret = !!fd->holes;
+
+    if( !ret && (fd->holes = (HoleTable*)Malloc(SECT_SIZE)) )
+    {
+        uint si = AllocSector();
+
+        MemSet(fd->holes, 0, SECT_SIZE);
+
+        if( si != SCT_END_FLAG )
+        {
+            fd->fe.type |= FT_SPARSE;
+            fd->fe.reserved[0] = si;
+
+            ret = SaveHoles(fd);
+        }
+        else
+        {
+            Free(fd->holes);
+
+            fd->holes = NULL;
+        }
+    }
+
+    return ret;
+}
+
+static uint FreeNum()
+{
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+    uint ret = header ? (header->freeNum + header->segEnd - header->segNext) : 0;
+
+    SctFree(header);
+
+    return ret;
+}
+
+static uint FillHoles(FileDesc* fd, uint idx, uint n)
+{
+    uint ret = SCT_END_FLAG;
+    HoleRange* hr = fd->holes ? FindHole(fd->holes, idx) : NULL;
+    byte* buf = hr ? (byte*)SctAlloc() : NULL;
+
+    if( buf )
+    {
+        uint sct[DIRECT_BATCH] = {0};
+        uint end = hr->begin + hr->num;
+        uint c = ChainIdx(fd, idx);
+        uint prev = c ? FindIndex(fd->fe.sctBegin, c - 1) : SCT_END_FLAG;
+        uint next = c ? NextSector(prev) : fd->fe.sctBegin;
+        uint want = n;
+        uint done = 0;
+
+        if( (idx > hr->begin) && ((idx + n) < end) && (fd->holes->cnt == HOLE_ITEM_CNT) )
+        {
+            n = end - idx;
+        }
+
+        fd->fe.type &= ~FT_CONTIG;
+
+        while( (done < n) && (FreeNum() >= (n - done)) )
+        {
+            uint k = AllocChain(sct, Min(n - done, DIRECT_BATCH));
+            uint i = 0;
+
+            if( !k )
+            {
+                break;
+            }
+
+            if( prev != SCT_END_FLAG )
+            {
+                LinkSector(prev, sct[0]);
+            }
+            else
+            {
+                fd->fe.sctBegin = sct[0];
+            }
+
+            for(i=0; i<k; i++)
+            {
+                if( (done + i) >= want )
+                {
+                    uint src = SharedSector(fd, idx + done + i);
+
+                    if( (src == SCT_END_FLAG) || !DiskRead(src, buf) )
+                    {
+                        MemSet(buf, 0, SECT_SIZE);
+                    }
+
+                    DiskWrite(sct[i], buf);
+                }
+            }
+
+            ret = done ? ret : sct[0];
+            prev = sct[k - 1];
+            done += k;
+        }
+
+        if( done && (next != SCT_END_FLAG) )
+        {
+            LinkSector(prev, next);
+        }
+
+        if( !(done && DropHoles(fd->holes, idx, done) && SaveHoles(fd)) )
+        {
+            ret = SCT_END_FLAG;
+        }
+    }
+
+    SctFree(buf);
+
+    return ret;
+}
+
+static uint SectorOf(FileDesc* fd, uint idx)
+{
+    uint ret = SCT_END_FLAG;
+
+    if( (idx < fd->fe.sctNum) && (fd->fe.type & FT_RING) )
+    {
+        ret = fd->fe.sctBegin + idx;
+    }
+    else if( (idx < fd->fe.sctNum) && IsContig(fd) && !IsHole(fd, idx) )
+    {
+        ret = ContigSector(fd, idx);
+    }
+    else if( (idx < fd->fe.sctNum) && !IsHole(fd, idx) )
+    {
+        if( idx == fd->objIdx )
+        {
+            ret = fd->sctIdx;
+        }
+        else if( (fd->sctIdx != SCT_END_FLAG) && (idx == fd->objIdx + 1) )
+        {
+            ret = NextSector(fd->sctIdx);
+        }
+        else if( (fd->sctIdx != SCT_END_FLAG) && (idx > fd->objIdx) )
+        {
+            ret = FindIndex(fd->sctIdx, ChainIdx(fd, idx) - ChainIdx(fd, fd->objIdx));
+        }
+        else
+        {
+            ret = FindIndex(fd->fe.sctBegin, ChainIdx(fd, idx));
+        }
+    }
+
+    return ret;
+}
+
+static uint FetchSector(FileDesc* fd, uint idx)
+{
+    uint ret = SectorOf(fd, idx);
+
+    if( (idx == fd->fe.sctNum) && (fd->fe.lastBytes == SECT_SIZE) )
+    {
+        uint last = ((fd->objIdx != SCT_END_FLAG) && (idx == fd->objIdx + 1)) ? fd->sctIdx : SCT_END_FLAG;
+
+        if( (last == SCT_END_FLAG) && IsContig(fd) && (fd->fe.sctBegin != SCT_END_FLAG) )
+        {
+            last = ContigSector(fd, idx) - 1;
+        }
+
+        if( (ret = AppendSector((FSRoot*)&fd->fe, last)) != SCT_END_FLAG )
+        {
+            KeepContig(fd, &ret, 1);
+        }
+    }
+
+    return ret;
+}
+
+static void SetCachePos(FileDesc* fd, uint idx, uint si, uint offset)
+{
+    fd->objIdx = idx;
+    fd->sctIdx = si;
+    fd->offset = offset;
+    fd->changed = 0;
+}
+
+static uint InAhead(FileDesc* fd, uint idx)
+{
+    return fd->ahead && (fd->aheadIdx <= idx) && (idx < (fd->aheadIdx + fd->aheadNum));
+}
+
+static uint IsDropped(FileDesc* fd, uint idx)
+{
+    return (fd->dropIdx <= idx) && (idx < fd->dropEnd);
+}
+
+static void DropAhead(FileDesc* fd)
+{
+    Free(fd->ahead);
+
+    fd->ahead = NULL;
+    fd->aheadNum = 0;
+}
+
+static uint ReadAhead(FileDesc* fd, uint idx, uint n)
+{
+    uint ret = 0;
+
+    n = (idx < fd->fe.sctNum) ? Min(Min(n, fd->fe.sctNum - idx), AHEAD_SCT_MAX) : 0;
+    n = ((idx < fd->dropEnd) && (fd->dropIdx < idx + n)) ? ((idx < fd->dropIdx) ? (fd->dropIdx - idx) : 0) : n;
+
+    fd->aheadNum = 0;
+
+    if( n && FlushCache(fd) && (fd->ahead || (fd->ahead = (byte*)Malloc(AHEAD_SCT_MAX * SECT_SIZE))) )
+    {
+        uint sct[AHEAD_SCT_MAX] = {0};
+        uint c = ChainIdx(fd, idx + n) - ChainIdx(fd, idx);
+        uint i = idx;
+        uint j = 0;
+
+        while( c && IsHole(fd, i) )
+        {
+            i++;
+        }
+
+        if( c && ((sct[0] = SectorOf(fd, i)) != SCT_END_FLAG) )
+        {
+            c = WalkChain(sct[0], sct + 1, c - 1) + 1;
+        }
+
+        for(i=0, ret=1; ret && (i<n); i++)
+        {
+            byte* p = AddrOff(fd->ahead, i * SECT_SIZE);
+            uint hole = IsHole(fd, idx + i);
+            uint src = hole ? SharedSector(fd, idx + i) : ((j < c) ? sct[j++] : SCT_END_FLAG);
+
+            fd->aheadSct[i] = hole ? SCT_END_FLAG : src;
+
+            if( src != SCT_END_FLAG )
+            {
+                ret = DiskRead(src, p);
+            }
+            else
+            {
+                ret = hole && MemSet(p, 0, SECT_SIZE);
+            }
+        }
+
+        fd->aheadIdx = idx;
+        fd->aheadNum = ret ? n : 0;
+    }
+
+    return ret;
+}
+
+static uint PrepareCache(FileDesc* fd, uint idx)
+{
+    uint ret = 0;
+    uint fresh = (idx == fd->fe.sctNum);
+    uint hole = IsHole(fd, idx);
+    uint si = SCT_END_FLAG;
+
+    if( ToFlush(fd) && (hole || ((si = FetchSector(fd, idx)) != SCT_END_FLAG)) )
+    {
+        if( hole && (SharedSector(fd, idx) != SCT_END_FLAG) )
+        {
+            ret = DiskRead(SharedSector(fd, idx), fd->cache);
+        }
+        else if( fresh || hole )
+        {
+            ret = !!MemSet(fd->cache, 0, SECT_SIZE);
+        }
+        else
+        {
+            ret = DiskRead(si, fd->cache);
+        }
+
+        if( ret )
+        {
+            SetCachePos(fd, idx, si, 0);
+        }
+    }
+
+    return ret;
+}
+
+static uint GrowChain(FileDesc* fd, uint last, uint* out, uint n)
+{
+    uint ret = AllocChain(out, n);
+
+    if( ret )
+    {
+        if( fd->fe.sctBegin == SCT_END_FLAG )
+        {
+            fd->fe.sctBegin = out[0];
+        }
+        else
+        {
+            LinkSector(last, out[0]);
+        }
+
+        fd->fe.sctNum += ret;
+        fd->fe.lastBytes = 0;
+
+        KeepContig(fd, out, ret);
+    }
+
+    return ret;
+}
+
+static uint MapSectors(FileDesc* fd, uint* out, uint n, uint grow)
+{
+    uint ret = 0;
+    uint idx = fd->objIdx + 1;
+    uint have = (idx < fd->fe.sctNum) ? HoleRun(fd, idx) : 0;
+
+    have = (have < n) ? have : n;
+
+    if( have && IsContig(fd) )
+    {
+        for(ret=0; ret<have; ret++)
+        {
+            out[ret] = ContigSector(fd, idx) + ret;
+        }
+    }
+    else if( have && (fd->sctIdx != SCT_END_FLAG) )
+    {
+        ret = WalkChain(fd->sctIdx, out, have);
+    }
+    else if( have )
+    {
+        out[0] = FindIndex(fd->fe.sctBegin, ChainIdx(fd, idx));
+
+        ret = (out[0] != SCT_END_FLAG) ? (WalkChain(out[0], out + 1, have - 1) + 1) : 0;
+    }
+
+    if( grow && (ret == have) && (ret < n) && ((idx + ret) == fd->fe.sctNum) &&
+        (ret || (fd->fe.lastBytes == SECT_SIZE)) )
+    {
+        uint last = ret ? out[ret - 1] : fd->sctIdx;
+
+        if( (last == SCT_END_FLAG) && IsContig(fd) && (fd->fe.sctBegin != SCT_END_FLAG) )
+        {
+            last = ContigSector(fd, idx) - 1;
+        }
+        else if( last == SCT_END_FLAG )
+        {
+            last = FindLast(fd->fe.sctBegin);
+        }
+
+        ret += GrowChain(fd, last, out + ret, n - ret);
+    }
+
+    return ret;
+}
+
+static uint WriteDirect(FileDesc* fd, byte* buf, uint cnt)
+{
+    uint ret = 0;
+    uint sct[DIRECT_BATCH] = {0};
+    uint n = ToFlush(fd) ? 1 : 0;
+
+    while( n && (ret < cnt * SECT_SIZE) )
+    {
+        uint i = 0;
+        uint k = Min(cnt - ret / SECT_SIZE, DIRECT_BATCH);
+
+        if( IsHole(fd, fd->objIdx + 1) )
+        {
+            k = Min(k, HoleRun(fd, fd->objIdx + 1));
+            n = (FillHoles(fd, fd->objIdx + 1, k) != SCT_END_FLAG);
+        }
+
+        n = n ? MapSectors(fd, sct, k, 1) : 0;
+
+        for(i=0; i<n; )
+        {
+            uint r = RunLength(sct + i, n - i);
+            uint idx = fd->objIdx + r;
+
+            if( DiskWriteN(sct[i], AddrOff(buf, ret), r) )
+            {
+                SetCachePos(fd, idx, sct[i + r - 1], SECT_SIZE);
+
+                if( (fd->fe.sctNum - 1) == idx )
+                {
+                    fd->fe.lastBytes = SECT_SIZE;
+                }
+
+                ret += r * SECT_SIZE;
+                i += r;
+            }
+            else
+            {
+                n = 0;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static uint ReadDirect(FileDesc* fd, byte* buf, uint cnt)
+{
+    uint ret = 0;
+    uint sct[DIRECT_BATCH] = {0};
+    uint n = ToFlush(fd) ? 1 : 0;
+
+    while( n && (ret < cnt * SECT_SIZE) )
+    {
+        uint i = 0;
+        uint k = Min(cnt - ret / SECT_SIZE, DIRECT_BATCH);
+
+        if( IsHole(fd, fd->objIdx + 1) )
+        {
+            uint src = SharedSector(fd, fd->objIdx + 1);
+
+            n = Min(k, HoleRun(fd, fd->objIdx + 1));
+
+            for(i=0; i<n; i++)
+            {
+                if( (src == SCT_END_FLAG) || !DiskRead(src + i, AddrOff(buf, ret + i * SECT_SIZE)) )
+                {
+                    MemSet(AddrOff(buf, ret + i * SECT_SIZE), 0, SECT_SIZE);
+                }
+            }
+
+            SetCachePos(fd, fd->objIdx + n, SCT_END_FLAG, SECT_SIZE);
+
+            ret += n * SECT_SIZE;
+
+            continue;
+        }
+
+        n = MapSectors(fd, sct, k, 0);
+
+        for(i=0; i<n; )
+        {
+            uint r = RunLength(sct + i, n - i);
+
+            if( DiskReadN(sct[i], AddrOff(buf, ret), r) )
+            {
+                SetCachePos(fd, fd->objIdx + r, sct[i + r - 1], SECT_SIZE);
+
+                ret += r * SECT_SIZE;
+                i += r;
+            }
+            else
+            {
+                n = 0;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static uint GetFileLen(FileDesc* fd)
+{
+    uint ret = 0;
+
+    if( fd->fe.sctNum )
+    {
+        ret = (fd->fe.sctNum - 1) * SECT_SIZE + fd->fe.lastBytes;
+    }
+
+    return ret;
+}
+
+static uint GetFilePos(FileDesc* fd)
+{
+    uint ret = 0;
+
+    if( fd->seek )
+    {
+        ret = fd->seek;
+    }
+    else if( fd->objIdx != SCT_END_FLAG )
+    {
+        ret = fd->objIdx * SECT_SIZE + fd->offset;
+    }
+
+    return ret;
+}
+
+static uint ToLocate(FileDesc* fd, uint pos)
+{
+    uint ret = -1;
+    uint len = GetFileLen(fd);
+    uint at = (pos < len) ? pos : len;
+
+    if( ToFlush(fd) )
+    {
+        uint objIdx = at / SECT_SIZE;
+        uint offset = at % SECT_SIZE;
+
+        if( objIdx && !offset )
+        {
+            objIdx--;
+            offset = SECT_SIZE;
+        }
+
+        if( !fd->fe.sctNum )
+        {
+            SetCachePos(fd, SCT_END_FLAG, SCT_END_FLAG, SECT_SIZE);
+
+            ret = 0;
+        }
+        else if( IsHole(fd, objIdx) )
+        {
+            uint src = SharedSector(fd, objIdx);
+
+            if( (src != SCT_END_FLAG) ? DiskRead(src, fd->cache) : !!MemSet(fd->cache, 0, SECT_SIZE) )
+            {
+                SetCachePos(fd, objIdx, SCT_END_FLAG, offset);
+
+                ret = at;
+            }
+        }
+        else
+        {
+            uint sctIdx = SectorOf(fd, objIdx);
+
+            if( (sctIdx != SCT_END_FLAG) && ((offset == SECT_SIZE) || DiskRead(sctIdx, fd->cache)) )
+            {
+                SetCachePos(fd, objIdx, sctIdx, offset);
+
+                ret = at;
+            }
+        }
+    }
+
+    if( ret != -1 )
+    {
+        fd->seek = (pos > len) ? pos : 0;
+
+        ret = pos;
+    }
+
+    return ret;
+}
+
+static uint ExtendFile(FileDesc* fd, uint len)
+{
+    uint ret = 0;
+    uint cur = GetFileLen(fd);
+
+    if( ToLocate(fd, cur) == cur )
+    {
+        uint num = len / SECT_SIZE + !!(len % SECT_SIZE);
+        uint shared = (fd->offset < SECT_SIZE) && (SharedSector(fd, fd->objIdx) != SCT_END_FLAG);
+
+        if( shared )
+        {
+            fd->sctIdx = FillHoles(fd, fd->objIdx, 1);
+        }
+
+        if( fd->offset < SECT_SIZE )
+        {
+            MemSet(AddrOff(fd->cache, fd->offset), 0, SECT_SIZE - fd->offset);
+
+            fd->changed = (fd->sctIdx != SCT_END_FLAG);
+        }
+
+        if( shared && (fd->sctIdx == SCT_END_FLAG) )
+        {
+            ret = 0;
+        }
+        else if( num == fd->fe.sctNum )
+        {
+            fd->fe.lastBytes = len - (num - 1) * SECT_SIZE;
+
+            ret = 1;
+        }
+        else if( MakeSparse(fd) && InsertRange(fd->holes, fd->fe.sctNum, num - fd->fe.sctNum, SCT_END_FLAG) && SaveHoles(fd) )
+        {
+            fd->fe.sctNum = num;
+            fd->fe.lastBytes = len - (num - 1) * SECT_SIZE;
+
+            ret = 1;
+        }
+        else
+        {
+            ret = 1;
+
+            while( ret && (cur < len) )
+            {
+                if( fd->offset == SECT_SIZE )
+                {
+                    ret = PrepareCache(fd, fd->objIdx + 1);
+                }
+                else if( fd->sctIdx == SCT_END_FLAG )
+                {
+                    ret = ((fd->sctIdx = FillHoles(fd, fd->objIdx, 1)) != SCT_END_FLAG);
+                }
+                else
+                {
+                    uint n = Min(len - cur, SECT_SIZE - fd->offset);
+
+                    fd->offset += n;
+                    fd->changed = 1;
+                    fd->fe.lastBytes = fd->offset;
+
+                    cur += n;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+static uint CopyToCache(FileDesc* fd, byte* buf, uint len)
+{
+    uint ret = 0;
+
+    if( (fd->objIdx != SCT_END_FLAG) && (fd->sctIdx == SCT_END_FLAG) )
+    {
+        fd->sctIdx = FillHoles(fd, fd->objIdx, 1);
+    }
+
+    if( (fd->objIdx != SCT_END_FLAG) && (fd->sctIdx != SCT_END_FLAG) )
+    {
+        uint n = SECT_SIZE - fd->offset;
+        byte* p = AddrOff(fd->cache, fd->offset);
+
+        n = (n < len) ? n : len;
+
+        MemCpy(p, buf, n);
+
+        fd->offset += n;
+        fd->changed = 1;
+
+        if( ((fd->fe.sctNum - 1) == fd->objIdx) && (fd->fe.lastBytes < fd->offset) )
+        {
+            fd->fe.lastBytes = fd->offset;
+        }
+
+        ret = n;
+    }
+
+    return ret;
+}
+
+static uint ToWrite(FileDesc* fd, byte* buf, uint len)
+{
+    uint ret = 1;
+    uint i = 0;
+    uint n = 0;
+
+    fd->aheadNum = 0;
+
+    if( fd->seek )
+    {
+        uint pos = fd->seek;
+
+        ret = ExtendFile(fd, pos) && (ToLocate(fd, pos) == pos);
+    }
+
+    while( (i < len) && ret )
+    {
+        byte* p = AddrOff(buf, i);
+        uint cnt = (len - i) / SECT_SIZE;
+
+        if( (fd->offset == SECT_SIZE) && cnt )
+        {
+            ret = n = WriteDirect(fd, p, cnt);
+        }
+        else
+        {
+            if( fd->offset == SECT_SIZE )
+            {
+                ret = PrepareCache(fd, fd->objIdx + 1);
+            }
+
+            ret = n = ret ? CopyToCache(fd, p, len - i) : 0;
+        }
+
+        i += n;
+    }
+
+    ret = i;
+
+    return ret;
+}
+
+static uint RingWrite(FileDesc* fd, byte* buf, uint len)
+{
+    uint ret = 0;
+    uint cap = fd->fe.sctNum * SECT_SIZE;
+    uint i = (len > cap) ? (len - cap) : 0;
+    uint ok = 1;
+
+    while( ok && (i < len) )
+    {
+        uint head = fd->fe.reserved[0];
+        uint used = fd->fe.reserved[1];
+        uint tail = (head + used) % cap;
+        uint n = Min(len - i, cap - tail);
+
+        ok = ((GetFilePos(fd) == tail) || (ToLocate(fd, tail) == tail)) && (ToWrite(fd, AddrOff(buf, i), n) == n);
+
+        if( ok && ((used + n) > cap) )
+        {
+            uint drop = used + n - cap;
+
+            fd->fe.reserved[0] = (head + drop) % cap;
+            fd->ringPos = (fd->ringPos > drop) ? (fd->ringPos - drop) : 0;
+
+            used = cap - n;
+        }
+
+        if( ok )
+        {
+            fd->fe.reserved[1] = used + n;
+
+            i += n;
+        }
+    }
+
+    ret = ok ? len : i;
+
+    return ret;
+}
+
+uint FWrite(uint fd, byte* buf, uint len)
+{
+    uint ret = -1;
+    FileDesc* pf = (FileDesc*)fd;
+
+    if( IsFDValid(pf) && buf )
+    {
+        ret = (pf->fe.type & FT_RING) ? RingWrite(pf, buf, len) : ToWrite(pf, buf, len);
+    }
+
+    return ret;
+}
+
+uint FDelete(const char* fn)
+{
+    return fn && !FindOpened(fn) && DeleteInRoot(fn) && Checkpoint() ? FS_SUCCEED : FS_FAILED;
+}
+
+uint FCreateRing(const char* fn, uint sctNum)
+{
+    uint ret = FExisted(fn);
+    FileEntry fe = {0};
+
+    if( (ret == FS_NONEXISTED) && sctNum && CreateInRoot(fn) && FindInRoot(fn, &fe) )
+    {
+        uint begin = FindFreeRun(sctNum);
+
+        ret = (begin != SCT_END_FLAG) && TakeFreeRun(begin, sctNum) && InitRun(begin, sctNum, 1);
+
+        if( ret )
+        {
+            fe.type = FT_RING;
+            fe.sctBegin = begin;
+            fe.sctNum = sctNum;
+            fe.lastBytes = SECT_SIZE;
+            fe.reserved[0] = 0;
+            fe.reserved[1] = 0;
+
+            ret = FlushFileEntry(&fe);
+        }
+        else
+        {
+            DeleteInRoot(fn);
+        }
+
+        ret = (ret && Checkpoint()) ? FS_SUCCEED : FS_FAILED;
+    }
+    else if( ret != FS_EXISTED )
+    {
+        ret = FS_FAILED;
+    }
+
+    return ret;
+}
+
+uint FSFormat()
+{
+    FSHeader* header = (FSHeader*)SctAlloc();
+    FSRoot* root = (FSRoot*)SctAlloc();
+    uint* p = (uint*)SctAlloc();
+    uint ret = 0;
+
+    ResetMeta(0);
+    ResetEntries();
+
+    if( header && root && p )
+    {
+        uint i = 0;
+        uint j = 0;
+        uint current = 0;
+
+        MemSet(header, 0, SECT_SIZE);
+
+        StrCpy(header->magic, FS_MAGIC, sizeof(header->magic)-1);
+
+        header->sctNum = gDev->sectors(gDev);
+        header->mapSize = (header->sctNum - FIXED_SCT_SIZE) / 129 + !!((header->sctNum - FIXED_SCT_SIZE) % 129);
+        header->freeNum = header->sctNum - header->mapSize - FIXED_SCT_SIZE;
+        header->freeBegin = FIXED_SCT_SIZE + header->mapSize;
+        header->poolBegin = SCT_END_FLAG;
+        header->moveBegin = SCT_END_FLAG;
+
+        ret = DiskWrite(HEADER_SCT_IDX, (byte*)header);
+
+        StrCpy(root->magic, ROOT_MAGIC, sizeof(root->magic)-1);
+
+        root->sctNum = 0;
+        root->sctBegin = SCT_END_FLAG;
+        root->lastBytes = SECT_SIZE;
+
+        ret = ret && DiskWrite(ROOT_SCT_IDX, (byte*)root);
+
+        for(i=0; ret && (i<header->mapSize) && (current<header->freeNum); i++)
+        {
+            for(j=0; j<MAP_ITEM_CNT; j++)
+            {
+                uint* pInt = AddrOff(p, j);
+
+                if( current < header->freeNum )
+                {
+                    *pInt = current + 1;
+
+                    if( current == (header->freeNum - 1) )
+                    {
+                        *pInt = SCT_END_FLAG;
+                    }
+
+                    current++;
+                }
+                else
+                {
+                    break;
+                }
+            }
+
+            ret = ret && DiskWrite(i + FIXED_SCT_SIZE, (byte*)p);
+        }
+    }
+
+    SctFree(header);
+    SctFree(root);
+    SctFree(p);
+
+    return ret;
+}
+
+uint FSIsFormatted()
+{
+    uint ret = 0;
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
+
+    if( header && root )
+    {
+        ret = StrCmp(header->magic, FS_MAGIC, -1) &&
+                (header->sctNum == gDev->sectors(gDev)) &&
+                StrCmp(root->magic, ROOT_MAGIC, -1);
+    }
+
+    SctFree(header);
+    SctFree(root);
+
+    return ret;
+}
+
+uint FSLogMode(uint on)
+{
+    uint ret = 0;
+    FSHeader* header = FSIsFormatted() ? (FSHeader*)ReadSector(HEADER_SCT_IDX) : NULL;
+
+    if( header )
+    {
+        uint next = header->segNext;
+        uint end = header->segEnd;
+        uint metaEnd = FIXED_SCT_SIZE + header->mapSize;
+
+        header->flags = on ? (header->flags | FS_LOG_MODE) : (header->flags & ~FS_LOG_MODE);
+        header->segNext = on ? next : 0;
+        header->segEnd = on ? end : 0;
+
+        ret = DiskWrite(HEADER_SCT_IDX, (byte*)header);
+
+        if( ret && !on && (next < end) )
+        {
+            ret = InitRun(next, end - next, 1) && ReleaseChain(next, end - 1, end - next);
+        }
+
+        ret = ret && Checkpoint();
+
+        ResetMeta(on ? metaEnd : 0);
+    }
+
+    SctFree(header);
+
+    return ret;
+}
+
+static uint MapAt(CheckPass* cp, uint i)
+{
+    uint sct = i / MAP_ITEM_CNT;
+
+    if( sct != cp->loaded )
+    {
+        cp->loaded = DiskRead(FIXED_SCT_SIZE + sct, (byte*)cp->map) ? sct : SCT_END_FLAG;
+    }
+
+    return (sct == cp->loaded) ? cp->map[i % MAP_ITEM_CNT] : SCT_END_FLAG;
+}
+
+static uint HeadIdx(CheckPass* cp, uint head, FSCheckInfo* info)
+{
+    return ((head >= cp->base) && ((head - cp->base) < info->sectors)) ? (head - cp->base) : SCT_END_FLAG;
+}
+
+static uint ChainLength(CheckPass* cp, uint i, FSCheckInfo* info)
+{
+    uint ret = 0;
+
+    while( (i < info->sectors) && (ret < info->sectors) )
+    {
+        ret++;
+        i = MapAt(cp, i);
+    }
+
+    return ret;
+}
+
+static uint CheckChain(CheckPass* cp, uint head, uint num, FSCheckInfo* info)
+{
+    uint ret = 0;
+    uint i = HeadIdx(cp, head, info);
+
+    if( i == SCT_END_FLAG )
+    {
+        info->badHeads += !cp->lo && ((head != SCT_END_FLAG) || num);
+    }
+    else if( (cp->lo <= i) && (i < cp->hi) )
+    {
+        if( TestAndSet(cp->bits, i - cp->lo) )
+        {
+            info->badHeads++;
+        }
+        else
+        {
+            ret = ChainLength(cp, i, info);
+
+            info->badLengths += (ret != num);
+        }
+    }
+
+    return ret;
+}
+
+static uint CheckLinks(CheckPass* cp, uint* batch, uint mapSize, FSCheckInfo* info)
+{
+    uint ret = 1;
+    uint i = 0;
+    uint j = 0;
+
+    for(i=0; ret && (i<mapSize); i+=CHECK_BATCH)
+    {
+        uint n = Min(CHECK_BATCH, mapSize - i);
+
+        ret = DiskReadN(FIXED_SCT_SIZE + i, (byte*)batch, n);
+
+        for(j=0; ret && (j<n * MAP_ITEM_CNT) && ((i * MAP_ITEM_CNT + j) < info->sectors); j++)
+        {
+            uint next = batch[j];
+
+            if( next == SCT_END_FLAG )
+            {
+                continue;
+            }
+            else if( next >= info->sectors )
+            {
+                info->badLinks += !cp->lo;
+            }
+            else if( (cp->lo <= next) && (next < cp->hi) && TestAndSet(cp->bits, next - cp->lo) )
+            {
+                info->crossLinks++;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static uint CountHoles(FileEntry* fe)
+{
+    uint ret = SCT_END_FLAG;
+    HoleTable* ht = (HoleTable*)ReadSector(fe->reserved[0]);
+
+    if( ht && (ht->cnt <= HOLE_ITEM_CNT) )
+    {
+        uint end = 0;
+        uint i = 0;
+
+        ret = 0;
+
+        for(i=0; (ret != SCT_END_FLAG) && (i<ht->cnt); i++)
+        {
+            HoleRange* hr = &ht->range[i];
+
+            if( hr->num && (hr->begin >= end) && ((hr->begin + hr->num) <= fe->sctNum) )
+            {
+                ret += hr->num;
+                end = hr->begin + hr->num;
+            }
+            else
+            {
+                ret = SCT_END_FLAG;
+            }
+        }
+    }
+
+    SctFree(ht);
+
+    return ret;
+}
+
+static uint IsRunChain(CheckPass* cp, uint head, FSCheckInfo* info)
 {
-    FileDesc* pf = (FileDesc*)fd;
+    uint ret = 1;
+    uint i = head - cp->base;
+    uint next = 0;
 
-    if( IsFDValid(pf) )
+    while( ret && (i < info->sectors) && ((next = MapAt(cp, i)) < info->sectors) )
     {
-        ToFlush(pf);
+        ret = (next == i + 1);
+        i = next;
+    }
 
-        List_DelNode((ListNode*)pf);
+    return ret;
+}
 
-        Free(pf);
+static uint CheckEntries(CheckPass* cp, FSRoot* root, FileEntry* feBase, FSCheckInfo* info)
+{
+    uint ret = 0;
+    uint i = root->sctBegin - cp->base;
+    uint j = 0;
+
+    for(j=0; j<root->sctNum; j++)
+    {
+        uint cnt = (j < (root->sctNum - 1)) ? FE_ITEM_CNT : (root->lastBytes / FE_BYTES);
+        uint k = 0;
+
+        if( !DiskRead(i + cp->base, (byte*)feBase) )
+        {
+            break;
+        }
+
+        for(k=0; k<cnt; k++)
+        {
+            FileEntry* fe = AddrOff(feBase, k);
+            uint holes = 0;
+
+            if( fe->type & FT_SPARSE )
+            {
+                ret += CheckChain(cp, fe->reserved[0], 1, info);
+
+                holes = (ChainLength(cp, HeadIdx(cp, fe->reserved[0], info), info) == 1) ? CountHoles(fe) : 0;
+
+                if( holes == SCT_END_FLAG )
+                {
+                    info->badLengths += !cp->lo;
+                    holes = 0;
+                }
+            }
+
+            ret += CheckChain(cp, fe->sctBegin, fe->sctNum - holes, info);
+
+            if( !cp->lo )
+            {
+                info->badLinks += (fe->type & FT_CONTIG) && !IsRunChain(cp, fe->sctBegin, info);
+                info->badLengths += (fe->lastBytes > SECT_SIZE);
+                info->badLengths += (fe->type & FT_RING) && ((fe->reserved[0] >= fe->sctNum * SECT_SIZE) || (fe->reserved[1] > fe->sctNum * SECT_SIZE));
+                info->files++;
+            }
+        }
+
+        i = MapAt(cp, i);
+    }
+
+    return ret;
+}
+
+static uint CheckPool(CheckPass* cp, FSHeader* header, PoolEntry* peBase, FSCheckInfo* info)
+{
+    uint ret = header->poolNum ? CheckChain(cp, header->poolBegin, header->poolNum, info) : 0;
+    uint i = HeadIdx(cp, header->poolBegin, info);
+    uint n = header->poolNum ? ChainLength(cp, i, info) : 0;
+    uint j = 0;
+
+    for(j=0; j<n; j++)
+    {
+        uint k = 0;
+
+        if( !DiskRead(i + cp->base, (byte*)peBase) )
+        {
+            break;
+        }
+
+        for(k=0; k<POOL_ITEM_CNT; k++)
+        {
+            ret += peBase[k].refs ? CheckChain(cp, peBase[k].sct, 1, info) : 0;
+        }
+
+        i = MapAt(cp, i);
+    }
+
+    return ret;
+}
+
+uint FSCheck(FSCheckInfo* info)
+{
+    uint ret = 0;
+    FSHeader* header = FSIsFormatted() ? (FSHeader*)ReadSector(HEADER_SCT_IDX) : NULL;
+    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
+    FileEntry* feBase = (FileEntry*)SctAlloc();
+    uint* batch = header ? (uint*)Malloc(CHECK_BATCH * SECT_SIZE) : NULL;
+    uint sectors = header ? (header->sctNum - header->mapSize - FIXED_SCT_SIZE) : 0;
+    uint size = Min(sectors / 8 + 1, CHECK_BITS_MAX);
+    CheckPass cp = {(uint*)SctAlloc(), SCT_END_FLAG, NULL, header ? (FIXED_SCT_SIZE + header->mapSize) : 0, 0, 0};
+
+    while( header && !(cp.bits = (byte*)Malloc(size)) && (size > SECT_SIZE) )
+    {
+        size = size / 2;
+    }
+
+    if( info && root && feBase && batch && cp.map && cp.bits )
+    {
+        uint reached = 0;
+        uint entries = 0;
+        uint i = 0;
+
+        MemSet(info, 0, sizeof(*info));
+
+        info->sectors = sectors;
+
+        entries = (ChainLength(&cp, HeadIdx(&cp, root->sctBegin, info), info) == root->sctNum) && (root->lastBytes <= SECT_SIZE);
+
+        ret = 1;
+
+        for(cp.lo=0; ret && (cp.lo<sectors); cp.lo=cp.hi)
+        {
+            cp.hi = cp.lo + Min(size * 8, sectors - cp.lo);
+
+            MemSet(cp.bits, 0, size);
+
+            ret = CheckLinks(&cp, batch, header->mapSize, info);
+
+            reached += CheckChain(&cp, header->freeBegin, header->freeNum, info);
+
+            for(i=header->segNext; i<header->segEnd; i++)
+            {
+                reached += CheckChain(&cp, i, 1, info);
+            }
+
+            reached += CheckPool(&cp, header, (PoolEntry*)feBase, info);
+            reached += header->moveNum ? CheckChain(&cp, header->moveBegin, header->moveNum, info) : 0;
+            reached += CheckChain(&cp, root->sctBegin, root->sctNum, info);
+            reached += entries ? CheckEntries(&cp, root, feBase, info) : 0;
+        }
+
+        info->badLengths += (root->lastBytes > SECT_SIZE);
+        info->lost = (reached < sectors) ? (sectors - reached) : 0;
+        info->errors = info->badLinks + info->crossLinks + info->badHeads + info->badLengths + info->lost;
+    }
+
+    SctFree(header);
+    SctFree(root);
+    SctFree(feBase);
+    SctFree(cp.map);
+    Free(batch);
+    Free(cp.bits);
+
+    return ret;
+}
+
+static uint EntryCount(FSRoot* root)
+{
+    return root->sctNum ? ((root->sctNum - 1) * FE_ITEM_CNT + root->lastBytes / FE_BYTES) : 0;
+}
+
+static uint ReadEntry(FSRoot* root, uint idx, FileEntry* out)
+{
+    uint ret = 0;
+    FileEntry* feBase = (FileEntry*)ReadSector(FindIndex(root->sctBegin, idx / FE_ITEM_CNT));
+
+    if( feBase )
+    {
+        *out = *((FileEntry*)AddrOff(feBase, idx % FE_ITEM_CNT));
+
+        ret = 1;
+    }
+
+    SctFree(feBase);
+
+    return ret;
+}
+
+static void EndDefrag()
+{
+    gDefragState = 0;
+    gDefragIdx++;
+}
+
+static void AbortDefrag()
+{
+    if( gDefragState == DEFRAG_COPY )
+    {
+        DropMove();
+    }
+
+    EndDefrag();
+}
+
+static void StartDefrag(FSRoot* root)
+{
+    DropMove();
+
+    gDefragState = DEFRAG_SCAN;
+    gDefragStale = 0;
+    gDefragSrc = SCT_END_FLAG;
+    gDefragNum = 0;
+    gDefragFrag = 0;
+
+    if( !ReadEntry(root, gDefragIdx, &gDefragFe) || FindOpened(gDefragFe.name) ||
+        (gDefragFe.sctBegin == SCT_END_FLAG) || (gDefragFe.type & FT_CONTIG) )
+    {
+        EndDefrag();
+    }
+}
+
+static uint IsDefragValid(FileEntry* fe)
+{
+    return !gDefragStale && FindInRoot(gDefragFe.name, fe) && (fe->sctBegin == gDefragFe.sctBegin) && (fe->sctNum == gDefragFe.sctNum);
+}
+
+static uint DefragBatch(uint head, uint* batch, uint n)
+{
+    uint ret = 0;
+
+    if( gDefragSrc == SCT_END_FLAG )
+    {
+        batch[0] = head;
+
+        ret = (head != SCT_END_FLAG) ? (1 + WalkChain(head, batch + 1, n - 1)) : 0;
+    }
+    else
+    {
+        ret = WalkChain(gDefragSrc, batch, n);
+    }
+
+    return ret;
+}
+
+static void ResetSeek(FSHeader* header)
+{
+    gDefragHead = header->freeBegin;
+    gDefragFree = header->freeNum;
+    gDefragSrc = SCT_END_FLAG;
+    gDefragNum = 0;
+}
+
+static uint ScanDefrag()
+{
+    uint batch[DEFRAG_BATCH] = {0};
+    uint cnt = DEFRAG_BATCH;
+    uint done = 0;
+    uint i = 0;
+
+    while( (cnt == DEFRAG_BATCH) && (done < DEFRAG_WALK) && (gDefragNum < gDefragFe.sctNum) )
+    {
+        cnt = DefragBatch(gDefragFe.sctBegin, batch, Min(DEFRAG_BATCH, gDefragFe.sctNum - gDefragNum));
+
+        for(i=0; i<cnt; i++)
+        {
+            gDefragFrag = gDefragFrag || (gDefragNum && (batch[i] != gDefragSrc + 1));
+            gDefragSrc = batch[i];
+            gDefragNum++;
+        }
+
+        done += cnt;
+    }
+
+    return (cnt < DEFRAG_BATCH) || (gDefragNum == gDefragFe.sctNum);
+}
+
+static void FinishScan(FileEntry* fe)
+{
+    FSHeader* header = gDefragFrag ? (FSHeader*)ReadSector(HEADER_SCT_IDX) : NULL;
+
+    if( !gDefragFrag )
+    {
+        fe->type |= FT_CONTIG;
+
+        FlushFileEntry(fe);
+        EndDefrag();
+    }
+    else if( header && (header->freeNum >= gDefragNum) )
+    {
+        gDefragState = DEFRAG_SEEK;
+        gDefragLen = gDefragNum;
+
+        ResetSeek(header);
+    }
+    else
+    {
+        EndDefrag();
+    }
+
+    SctFree(header);
+}
+
+static uint TakeRun(FSHeader* header)
+{
+    uint last = gDefragRun + gDefragLen - 1;
+
+    Relink(header, gDefragPrev, NextSector(last));
+
+    header->freeNum -= gDefragLen;
+
+    return DiskWrite(HEADER_SCT_IDX, (byte*)header) && MarkSector(last) && SetMove(gDefragRun, gDefragLen);
+}
+
+static void SeekDefrag()
+{
+    uint batch[DEFRAG_BATCH] = {0};
+    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
+    uint cnt = DEFRAG_BATCH;
+    uint done = 0;
+    uint i = 0;
+
+    if( header && ((header->freeBegin != gDefragHead) || (header->freeNum != gDefragFree)) )
+    {
+        ResetSeek(header);
+    }
+
+    while( header && (cnt == DEFRAG_BATCH) && (done < DEFRAG_WALK) && (gDefragNum < gDefragLen) )
+    {
+        cnt = DefragBatch(header->freeBegin, batch, DEFRAG_BATCH);
+
+        for(i=0; (i<cnt) && (gDefragNum < gDefragLen); i++)
+        {
+            if( gDefragNum && (batch[i] == gDefragRun + gDefragNum) )
+            {
+                gDefragNum++;
+            }
+            else
+            {
+                gDefragPrev = gDefragSrc;
+                gDefragRun = batch[i];
+                gDefragNum = 1;
+            }
+
+            gDefragSrc = batch[i];
+        }
+
+        done += cnt;
+    }
+
+    if( header && (gDefragNum == gDefragLen) && TakeRun(header) )
+    {
+        gDefragState = DEFRAG_COPY;
+        gDefragSrc = SCT_END_FLAG;
+        gDefragNum = 0;
+    }
+    else if( !header || (gDefragNum == gDefragLen) || (cnt < DEFRAG_BATCH) )
+    {
+        EndDefrag();
+    }
+
+    SctFree(header);
+}
+
+static uint CopyDefrag()
+{
+    uint batch[DEFRAG_BATCH] = {0};
+    byte* buf = (byte*)Malloc(DEFRAG_BATCH * SECT_SIZE);
+    uint ret = !!buf;
+    uint done = 0;
+
+    while( ret && (done < DEFRAG_STEP) && (gDefragNum < gDefragLen) )
+    {
+        uint cnt = DefragBatch(gDefragFe.sctBegin, batch, Min(DEFRAG_BATCH, gDefragLen - gDefragNum));
+        uint i = 0;
+
+        ret = !!cnt;
+
+        while( ret && (i < cnt) )
+        {
+            uint k = RunLength(batch + i, cnt - i);
+
+            ret = DiskReadN(batch[i], AddrOff(buf, i * SECT_SIZE), k);
+
+            i += k;
+        }
+
+        if( (ret = ret && DiskWriteN(gDefragRun + gDefragNum, buf, cnt)) )
+        {
+            gDefragSrc = batch[cnt - 1];
+            gDefragNum += cnt;
+        }
+
+        done += cnt;
     }
+
+    Free(buf);
+
+    return ret;
+}
+
+static uint CommitDefrag(FileEntry* fe)
+{
+    fe->sctBegin = gDefragRun;
+    fe->type |= FT_CONTIG;
+
+    return FlushFileEntry(fe) && ReleaseChain(gDefragFe.sctBegin, gDefragSrc, gDefragLen) && SetMove(SCT_END_FLAG, 0);
 }
 
-static uint ReadToCache(FileDesc* fd, uint idx)
-{
-    uint ret = 0;
+uint FDefrag()
+{
+    uint ret = 0;
+    FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
+
+    if( root )
+    {
+        uint cnt = EntryCount(root);
+        FileEntry fe = {0};
+
+        if( gDefragState && !IsDefragValid(&fe) )
+        {
+            AbortDefrag();
+        }
+        else if( gDefragState == DEFRAG_SCAN )
+        {
+            if( ScanDefrag() )
+            {
+                FinishScan(&fe);
+            }
+        }
+        else if( gDefragState == DEFRAG_SEEK )
+        {
+            SeekDefrag();
+        }
+        else if( gDefragState == DEFRAG_COPY )
+        {
+            if( !CopyDefrag() )
+            {
+                AbortDefrag();
+            }
+            else if( gDefragNum == gDefragLen )
+            {
+                CommitDefrag(&fe);
+                EndDefrag();
+            }
+        }
+        else if( gDefragIdx < cnt )
+        {
+            StartDefrag(root);
+        }
+
+        Checkpoint();
 
-    if( idx < fd->fe.sctNum )
-    {
-        uint sctIdx = FindIndex(fd->fe.sctBegin, idx);
+        gDefragIdx = Min(gDefragIdx, cnt);
 
-        ToFlush(fd);
+        ret = cnt - gDefragIdx + !!gDefragState;
 
-        if( (sctIdx != SCT_END_FLAG) && (ret = HDRawRead(sctIdx, fd->cache)) )
+        if( !ret )
         {
-            fd->objIdx = idx;
-            fd->offset = 0;
-            fd->changed = 0;
+            gDefragIdx = 0;
         }
     }
 
-    return ret;
-}
-
-static uint PrepareCache(FileDesc* fd, uint objIdx)
-{
-    CheckStorage(&fd->fe);
+    SctFree(root);
 
-    return ReadToCache(fd, objIdx);
+    return ret;
 }
 
-static uint CopyToCache(FileDesc* fd, byte* buf, uint len)
+static uint IsZeroSector(uint* buf)
 {
-    uint ret = -1;
+    uint ret = 1;
+    uint i = 0;
 
-    if( fd->objIdx != SCT_END_FLAG )
+    for(i=0; ret && (i<MAP_ITEM_CNT); i++)
     {
-        uint n = SECT_SIZE - fd->offset;
-        byte* p = AddrOff(fd->cache, fd->offset);
-
-        n = (n < len) ? n : len;
-
-        MemCpy(p, buf, n);
-
-        fd->offset += n;
-        fd->changed = 1;
-
-        if( ((fd->fe.sctNum - 1) == fd->objIdx) && (fd->fe.lastBytes < fd->offset) )
-        {
-            fd->fe.lastBytes = fd->offset;
-        }
-
-        ret = n;
+        ret = !buf[i];
     }
 
     return ret;
 }
 
-static uint ToWrite(FileDesc* fd, byte* buf, uint len)
+static uint DedupSector(FileDesc* fd, uint idx, uint si, byte* buf, uint* saved)
 {
-    uint ret = 1;
-    uint i = 0;
-    uint n = 0;
+    uint ret = 0;
+    uint hash = 0;
+    uint k = SCT_END_FLAG;
 
-    while( (i < len) && ret )
+    if( !DiskRead(si, buf) )
     {
-        byte* p = AddrOff(buf, i);
+        ret = 0;
+    }
+    else if( IsZeroSector((uint*)buf) )
+    {
+        ret = MakeSparse(fd) && InsertRange(fd->holes, idx, 1, SCT_END_FLAG);
+        ret = ret && FreeSector(si);
 
-        if( fd->offset == SECT_SIZE )
-        {
-            ret = PrepareCache(fd, fd->objIdx + 1);
-        }
+        *saved += ret;
+    }
+    else if( (k = FindShared(hash = Fingerprint(buf), buf)) != SCT_END_FLAG )
+    {
+        ret = MakeSparse(fd) && InsertRange(fd->holes, idx, 1, k);
+        ret = ret && RefShared(hash, k, 1) && FreeSector(si);
+
+        *saved += ret;
+    }
+    else if( AddShared(hash, si) )
+    {
+        ret = MakeSparse(fd) && InsertRange(fd->holes, idx, 1, si);
 
         if( ret )
         {
-            n = CopyToCache(fd, p, len - i);
-
-            i += n;
+            MarkSector(si);
+        }
+        else
+        {
+            DropShared(hash, si);
         }
     }
 
-    ret = i;
-
     return ret;
 }
 
-uint FWrite(uint fd, byte* buf, uint len)
+static void StartDedup(FileEntry* fe)
 {
-    uint ret = -1;
-
-    if( IsFDValid((FileDesc*)fd) && buf )
-    {
-        ret = ToWrite((FileDesc*)fd, buf, len);
-    }
-
-    return ret;
+    gDedupFe = *fe;
+    gDedupStale = 0;
+    gDedupSi = fe->sctBegin;
+    gDedupSct = 0;
+    gDedupPrev = SCT_END_FLAG;
 }
 
-uint FDelete(const char* fn)
+static uint IsDedupValid(FileEntry* fe)
 {
-    return fn && !IsOpened(fn) && DeleteInRoot(fn) ? FS_SUCCEED : FS_FAILED;
+    return !gDedupStale && StrCmp(fe->name, gDedupFe.name, -1) && (fe->sctBegin == gDedupFe.sctBegin) && (fe->sctNum == gDedupFe.sctNum);
 }
 
-uint FSFormat()
+static uint DedupFile(FileEntry* fe, uint* saved)
 {
-    FSHeader* header = (FSHeader*)Malloc(SECT_SIZE);
-    FSRoot* root = (FSRoot*)Malloc(SECT_SIZE);
-    uint* p = (uint*)Malloc(MAP_ITEM_CNT * sizeof(uint));
-    uint ret = 0;
-
-    if( header && root && p )
-    {
-        uint i = 0;
-        uint j = 0;
-        uint current = 0;
-
-        StrCpy(header->magic, FS_MAGIC, sizeof(header->magic)-1);
-
-        header->sctNum = HDRawSectors();
-        header->mapSize = (header->sctNum - FIXED_SCT_SIZE) / 129 + !!((header->sctNum - FIXED_SCT_SIZE) % 129);
-        header->freeNum = header->sctNum - header->mapSize - FIXED_SCT_SIZE;
-        header->freeBegin = FIXED_SCT_SIZE + header->mapSize;
-
-        ret = HDRawWrite(HEADER_SCT_IDX, (byte*)header);
-
-        StrCpy(root->magic, ROOT_MAGIC, sizeof(root->magic)-1);
+    uint ret = 1;
+    uint fd = (FindOpened(fe->name) || (fe->type & FT_RING)) ? 0 : FOpen(fe->name);
+    FileDesc* pf = (FileDesc*)fd;
+    byte* buf = fd ? (byte*)SctAlloc() : NULL;
 
-        root->sctNum = 0;
-        root->sctBegin = SCT_END_FLAG;
-        root->lastBytes = SECT_SIZE;
+    gDedupStale = 0;
 
-        ret = ret && HDRawWrite(ROOT_SCT_IDX, (byte*)root);
+    if( buf )
+    {
+        uint done = 0;
+        uint cnt = 0;
 
-        for(i=0; ret && (i<header->mapSize) && (current<header->freeNum); i++)
+        while( (gDedupSi != SCT_END_FLAG) && (gDedupSct < pf->fe.sctNum) && (done < DEDUP_STEP) )
         {
-            for(j=0; j<MAP_ITEM_CNT; j++)
+            uint next = NextSector(gDedupSi);
+
+            while( IsHole(pf, gDedupSct) )
             {
-                uint* pInt = AddrOff(p, j);
+                gDedupSct += HoleRun(pf, gDedupSct);
+            }
 
-                if( current < header->freeNum )
+            if( DedupSector(pf, gDedupSct, gDedupSi, buf, saved) )
+            {
+                if( gDedupPrev == SCT_END_FLAG )
                 {
-                    *pInt = current + 1;
-
-                    if( current == (header->freeNum - 1) )
-                    {
-                        *pInt = SCT_END_FLAG;
-                    }
-
-                    current++;
+                    pf->fe.sctBegin = next;
+                }
+                else if( next == SCT_END_FLAG )
+                {
+                    MarkSector(gDedupPrev);
                 }
                 else
                 {
-                    break;
+                    LinkSector(gDedupPrev, next);
                 }
+
+                cnt++;
             }
+            else
+            {
+                gDedupPrev = gDedupSi;
+            }
+
+            gDedupSi = next;
+            gDedupSct++;
+            done++;
+        }
+
+        if( cnt )
+        {
+            pf->fe.type &= ~FT_CONTIG;
 
-            ret = ret && HDRawWrite(i + FIXED_SCT_SIZE, (byte*)p);
+            SaveHoles(pf);
         }
+
+        gDedupFe = pf->fe;
+
+        ret = (gDedupSi == SCT_END_FLAG) || (gDedupSct >= pf->fe.sctNum);
     }
 
-    Free(header);
-    Free(root);
-    Free(p);
+    SctFree(buf);
+
+    if( fd )
+    {
+        FClose(fd);
+    }
 
     return ret;
 }
 
-uint FSIsFormatted()
+uint FDedup(uint* saved)
 {
     uint ret = 0;
-    FSHeader* header = (FSHeader*)ReadSector(HEADER_SCT_IDX);
     FSRoot* root = (FSRoot*)ReadSector(ROOT_SCT_IDX);
 
-    if( header && root )
+    if( root && saved )
     {
-        ret = StrCmp(header->magic, FS_MAGIC, -1) &&
-                (header->sctNum == HDRawSectors()) &&
-                StrCmp(root->magic, ROOT_MAGIC, -1);
+        uint cnt = EntryCount(root);
+        FileEntry fe = {0};
+
+        CreatePool();
+
+        if( (gDedupIdx < cnt) && ReadEntry(root, gDedupIdx, &fe) )
+        {
+            if( !IsDedupValid(&fe) )
+            {
+                StartDedup(&fe);
+            }
+
+            if( DedupFile(&fe, saved) )
+            {
+                gDedupIdx++;
+                gDedupStale = 1;
+            }
+
+            Checkpoint();
+        }
+        else
+        {
+            gDedupIdx = cnt;
+        }
+
+        ret = cnt - gDedupIdx + (gDedupPass ? 0 : cnt);
+
+        if( gDedupIdx == cnt )
+        {
+            gDedupIdx = 0;
+            gDedupPass = !gDedupPass;
+        }
     }
 
-    Free(header);
-    Free(root);
+    SctFree(root);
 
     return ret;
 }
@@ -943,47 +3857,46 @@ uint FRename(const char* ofn, const char* nfn)
 {
     uint ret = FS_FAILED;
 
-    if( ofn && !IsOpened(ofn) && nfn )
+    if( ofn && !FindOpened(ofn) && nfn )
     {
-        FileEntry* ofe = FindInRoot(ofn);
-        FileEntry* nfe = FindInRoot(nfn);
+        FileEntry ofe = {0};
+        FileEntry nfe = {0};
 
-        if( ofe && !nfe )
+        if( FindInRoot(ofn, &ofe) && !FindInRoot(nfn, &nfe) )
         {
-            StrCpy(ofe->name, nfn, sizeof(ofe->name) - 1);
+            StrCpy(ofe.name, nfn, sizeof(ofe.name) - 1);
 
-            if( FlushFileEntry(ofe) )
+            if( FlushFileEntry(&ofe) && Checkpoint() )
             {
                 ret = FS_SUCCEED;
             }
         }
-
-        Free(ofe);
-        Free(nfe);
     }
 
     return ret;
 }
 
-static uint GetFileLen(FileDesc* fd)
+static uint ReadCache(FileDesc* fd, uint idx)
 {
     uint ret = 0;
 
-    if( fd->fe.sctBegin != SCT_END_FLAG )
+    if( (fd->hint == FS_ADV_SEQUENTIAL) && !InAhead(fd, idx) && !IsDropped(fd, idx) )
     {
-        ret = (fd->fe.sctNum - 1) * SECT_SIZE + fd->fe.lastBytes;
+        ReadAhead(fd, idx, AHEAD_SCT_MAX);
     }
 
-    return ret;
-}
+    if( InAhead(fd, idx) && FlushCache(fd) )
+    {
+        uint i = idx - fd->aheadIdx;
 
-static uint GetFilePos(FileDesc* fd)
-{
-    uint ret = 0;
+        MemCpy(fd->cache, AddrOff(fd->ahead, i * SECT_SIZE), SECT_SIZE);
+        SetCachePos(fd, idx, fd->aheadSct[i], 0);
 
-    if( fd->objIdx != SCT_END_FLAG )
+        ret = 1;
+    }
+    else
     {
-        ret = fd->objIdx * SECT_SIZE + fd->offset;
+        ret = PrepareCache(fd, idx);
     }
 
     return ret;
@@ -1013,7 +3926,7 @@ static uint CopyFromCache(FileDesc* fd, byte* buf, uint len)
 static uint ToRead(FileDesc* fd, byte* buf, uint len)
 {
     uint ret = -1;
-    uint n = GetFileLen(fd) - GetFilePos(fd);
+    uint n = fd->seek ? 0 : (GetFileLen(fd) - GetFilePos(fd));
     uint i = 0;
 
     len = (len < n) ? len : n;
@@ -1021,15 +3934,22 @@ static uint ToRead(FileDesc* fd, byte* buf, uint len)
     while( (i < len) && ret )
     {
         byte* p = AddrOff(buf, i);
+        uint cnt = (len - i) / SECT_SIZE;
+
+        uint ahead = InAhead(fd, fd->objIdx + 1) || ((fd->hint == FS_ADV_SEQUENTIAL) && (cnt < AHEAD_SCT_MAX) && !IsDropped(fd, fd->objIdx + 1));
 
-        if( fd->offset == SECT_SIZE )
+        if( (fd->offset == SECT_SIZE) && cnt && !ahead )
         {
-            ret = PrepareCache(fd, fd->objIdx + 1);
+            ret = n = ReadDirect(fd, p, cnt);
         }
-
-        if( ret )
+        else
         {
-            n = CopyFromCache(fd, p, len - i);
+            if( fd->offset == SECT_SIZE )
+            {
+                ret = ReadCache(fd, fd->objIdx + 1);
+            }
+
+            n = ret ? CopyFromCache(fd, p, len - i) : 0;
         }
 
         i += n;
@@ -1040,39 +3960,36 @@ static uint ToRead(FileDesc* fd, byte* buf, uint len)
     return ret;
 }
 
-uint FRead(uint fd, byte* buf, uint len)
+static uint RingRead(FileDesc* fd, byte* buf, uint len)
 {
-    uint ret = -1;
+    uint ret = 0;
+    uint cap = fd->fe.sctNum * SECT_SIZE;
+    uint n = 1;
+
+    len = Min(len, fd->fe.reserved[1] - fd->ringPos);
 
-    if( IsFDValid((FileDesc*)fd) && buf )
+    while( n && (ret < len) )
     {
-        ret = ToRead((FileDesc*)fd, buf, len);
+        uint at = (fd->fe.reserved[0] + fd->ringPos) % cap;
+
+        n = Min(len - ret, cap - at);
+        n = ((GetFilePos(fd) == at) || (ToLocate(fd, at) == at)) ? ToRead(fd, AddrOff(buf, ret), n) : 0;
+
+        fd->ringPos += n;
+        ret += n;
     }
 
     return ret;
 }
 
-static uint ToLocate(FileDesc* fd, uint pos)
+uint FRead(uint fd, byte* buf, uint len)
 {
     uint ret = -1;
-    uint len = GetFileLen(fd);
-
-    pos = (pos < len) ? pos : len;
+    FileDesc* pf = (FileDesc*)fd;
 
+    if( IsFDValid(pf) && buf )
     {
-        uint objIdx = pos / SECT_SIZE;
-        uint offset = pos % SECT_SIZE;
-        uint sctIdx = FindIndex(fd->fe.sctBegin, objIdx);
-
-        ToFlush(fd);
-
-        if( (sctIdx != SCT_END_FLAG) && HDRawRead(sctIdx, fd->cache) )
-        {
-            fd->objIdx = objIdx;
-            fd->offset = offset;
-
-            ret = pos;
-        }
+        ret = (pf->fe.type & FT_RING) ? RingRead(pf, buf, len) : ToRead(pf, buf, len);
     }
 
     return ret;
@@ -1083,18 +4000,33 @@ uint FErase(uint fd, uint bytes)
     uint ret = 0;
     FileDesc* pf = (FileDesc*)fd;
 
-    if( IsFDValid(pf) )
+    if( IsFDValid(pf) && !(pf->fe.type & FT_RING) )
     {
         uint pos = GetFilePos(pf);
         uint len = GetFileLen(pf);
+        uint lost = 0;
+
+        ret = EraseLast(&pf->fe, bytes, pf->holes);
 
-        ret = EraseLast(&pf->fe, bytes);
+        pf->aheadNum = 0;
+
+        if( ret && pf->holes )
+        {
+            SaveHoles(pf);
+        }
 
         len -= ret;
 
-        if( ret && (pos > len) )
+        lost = (pf->objIdx != SCT_END_FLAG) && (pf->objIdx >= pf->fe.sctNum);
+
+        if( lost )
+        {
+            pf->changed = 0;
+        }
+
+        if( ret && (lost || (pos > len)) )
         {
-            ToLocate(pf, len);
+            ToLocate(pf, (pos < len) ? pos : len);
         }
     }
 
@@ -1106,7 +4038,11 @@ uint FSeek(uint fd, uint pos)
     uint ret = -1;
     FileDesc* pf = (FileDesc*)fd;
 
-    if( IsFDValid(pf) )
+    if( IsFDValid(pf) && (pf->fe.type & FT_RING) )
+    {
+        ret = pf->ringPos = Min(pos, pf->fe.reserved[1]);
+    }
+    else if( IsFDValid(pf) )
     {
         ret = ToLocate(pf, pos);
     }
@@ -1121,7 +4057,7 @@ uint FLength(uint fd)
 
     if( IsFDValid(pf) )
     {
-        ret = GetFileLen(pf);
+        ret = (pf->fe.type & FT_RING) ? pf->fe.reserved[1] : GetFileLen(pf);
     }
 
     return ret;
@@ -1134,7 +4070,7 @@ uint FTell(uint fd)
 
     if( IsFDValid(pf) )
     {
-        ret = GetFilePos(pf);
+        ret = (pf->fe.type & FT_RING) ? pf->ringPos : GetFilePos(pf);
     }
 
     return ret;
@@ -1147,8 +4083,227 @@ uint FFlush(uint fd)
 
     if( IsFDValid(pf) )
     {
-        ret = ToFlush(pf);
+        ret = ToFlush(pf) && Checkpoint() && (!gDev->flush || gDev->flush(gDev));
+    }
+
+    return ret;
+}
+
+uint FAdvise(uint fd, uint offset, uint len, uint hint)
+{
+    uint ret = FS_FAILED;
+    FileDesc* pf = (FileDesc*)fd;
+
+    if( IsFDValid(pf) )
+    {
+        uint idx = offset / SECT_SIZE;
+        uint end = (len && ((offset + len) > offset)) ? ((offset + len - 1) / SECT_SIZE + 1) : (idx + AHEAD_SCT_MAX);
+
+        switch( hint )
+        {
+            case FS_ADV_NORMAL:
+            case FS_ADV_SEQUENTIAL:
+                pf->hint = hint;
+                ret = FS_SUCCEED;
+                break;
+            case FS_ADV_RANDOM:
+                pf->hint = hint;
+                DropAhead(pf);
+                ret = FS_SUCCEED;
+                break;
+            case FS_ADV_WILLNEED:
+                pf->dropEnd = 0;
+                ret = ReadAhead(pf, idx, end - idx) ? FS_SUCCEED : FS_FAILED;
+                break;
+            case FS_ADV_DONTNEED:
+                pf->dropIdx = idx;
+                pf->dropEnd = len ? end : -1;
+                DropAhead(pf);
+                ret = (ToFlush(pf) && Checkpoint()) ? FS_SUCCEED : FS_FAILED;
+                break;
+            default:
+                break;
+        }
     }
 
     return ret;
 }
+
+#ifndef DTFSER
+
+static void NotifyWrite(uint fd, uint len, uint ret)
+{
+    FileDesc* pf = (FileDesc*)fd;
+
+    if( ret && (ret != -1) && IsFDValid(pf) )
+    {
+        FWatchNotify(pf->fe.name, ((pf->fe.type & FT_RING) || (FLength(fd) > len)) ? FS_WATCH_APPEND : FS_WATCH_WRITE);
+    }
+}
+
+void FNotify(uint fd, uint what)
+{
+    FileDesc* pf = (FileDesc*)fd;
+
+    if( IsFDValid(pf) )
+    {
+        FWatchNotify(pf->fe.name, what);
+    }
+}
+
+static void NotifyName(const char* fn, uint what, uint ret)
+{
+    if( ret == FS_SUCCEED )
+    {
+        FWatchNotify(fn, what);
+    }
+}
+
+static void WaitDevice(uint* ret)
+{
+    if( gDev->submit )
+    {
+        gDev->submit(gDev, ret, *ret);
+    }
+}
+
+static const BlkDev* StripeDisks(uint chunk)
+{
+    const BlkDev* member[STRIPE_MEMBER_MAX] = {0};
+    uint count = 0;
+
+    while( (count < STRIPE_MEMBER_MAX) && (member[count] = HDRawDisk(count)) )
+    {
+        count++;
+    }
+
+    return (gDev != StripeDevice()) ? StripeCreate(member, count, chunk) : NULL;
+}
+
+static uint MountDevice(uint which, uint chunk)
+{
+    const BlkDev* dev = HDRawDevice();
+
+    if( which == FS_DEV_RAM )
+    {
+        dev = RamDiskDevice();
+    }
+    else if( which == FS_DEV_VIRTIO )
+    {
+        dev = VBlkDevice();
+    }
+    else if( which == FS_DEV_AHCI )
+    {
+        dev = AHCIDevice();
+    }
+    else if( which == FS_DEV_STRIPE )
+    {
+        dev = StripeDisks(chunk);
+    }
+
+    return dev && FSMount(dev) && (FSIsFormatted() || FSFormat());
+}
+
+void FSCallHandler(uint cmd, uint param1, uint param2)
+{
+    FileParam* fp = (FileParam*)param1;
+    uint len = 0;
+
+    if( fp )
+    {
+        switch(cmd)
+        {
+            case 0:
+                fp->ret = FOpen(fp->name);
+                break;
+            case 1:
+                FMapRelease(fp->fd);
+                FClose(fp->fd);
+                break;
+            case 2:
+                gDefer = FMapPrepare(fp->buf, fp->len);
+                fp->ret = gDefer ? FRead(fp->fd, fp->buf, fp->len) : -1;
+                gDefer = 0;
+                WaitDevice(&fp->ret);
+                break;
+            case 3:
+                len = FLength(fp->fd);
+                gDefer = FMapPrepare(fp->buf, fp->len);
+                fp->ret = gDefer ? FWrite(fp->fd, fp->buf, fp->len) : -1;
+                gDefer = 0;
+                NotifyWrite(fp->fd, len, fp->ret);
+                WaitDevice(&fp->ret);
+                break;
+            case 4:
+                fp->ret = FSeek(fp->fd, fp->pos);
+                break;
+            case 5:
+                fp->ret = FTell(fp->fd);
+                break;
+            case 6:
+                fp->ret = FLength(fp->fd);
+                break;
+            case 7:
+                len = FLength(fp->fd);
+                fp->ret = FErase(fp->fd, fp->len);
+                NotifyWrite(fp->fd, len, fp->ret);
+                break;
+            case 8:
+                FMapSync(fp->fd);
+                fp->ret = FFlush(fp->fd);
+                break;
+            case 9:
+                fp->ret = FCreate(fp->name);
+                NotifyName(fp->name, FS_WATCH_CREATE, fp->ret);
+                break;
+            case 10:
+                fp->ret = FExisted(fp->name);
+                break;
+            case 11:
+                fp->ret = FDelete(fp->name);
+                NotifyName(fp->name, FS_WATCH_DELETE, fp->ret);
+                break;
+            case 12:
+                fp->ret = FRename(fp->name, fp->other);
+                NotifyName(fp->name, FS_WATCH_DELETE, fp->ret);
+                NotifyName(fp->other, FS_WATCH_CREATE, fp->ret);
+                break;
+            case 13:
+                fp->ret = FMap(fp->fd, fp->pos, fp->len);
+                break;
+            case 14:
+                fp->ret = FUnmap((uint)fp->buf);
+                break;
+            case 15:
+                fp->ret = FDefrag();
+                break;
+            case 16:
+                fp->len = 0;
+                fp->ret = FDedup(&fp->len);
+                break;
+            case 17:
+                fp->ret = FAdvise(fp->fd, fp->pos, fp->len, param2);
+                break;
+            case 18:
+                fp->ret = FCreateRing(fp->name, fp->len);
+                NotifyName(fp->name, FS_WATCH_CREATE, fp->ret);
+                break;
+            case 19:
+                fp->ret = FWatch(fp->name, fp->len);
+                break;
+            case 20:
+                FWatchWait(fp->fd, &fp->ret);
+                break;
+            case 21:
+                FUnwatch(fp->fd);
+                break;
+            case 22:
+                fp->ret = MountDevice(fp->fd, fp->len);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+#endif
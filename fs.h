@@ -2,20 +2,32 @@
 #define FS_H
 
 #include "type.h"
+#include "blkdev.h"
+#include "app.h"
 
-enum
+typedef struct
 {
-    FS_FAILED,
-    FS_SUCCEED,
-    FS_EXISTED,
-    FS_NONEXISTED
-};
+    uint sectors;
+    uint files;
+    uint badLinks;
+    uint crossLinks;
+    uint badHeads;
+    uint badLengths;
+    uint lost;
+    uint errors;
+} FSCheckInfo;
 
 void FSModInit();
+uint FSMount(const BlkDev* dev);
 uint FSFormat();
 uint FSIsFormatted();
+uint FSLogMode(uint on);
+uint FSCheck(FSCheckInfo* info);
+uint FDefrag();
+uint FDedup(uint* saved);
 
 uint FCreate(const char* fn);
+uint FCreateRing(const char* fn, uint sctNum);
 uint FExisted(const char* fn);
 uint FDelete(const char* fn);
 uint FRename(const char* ofn, const char* nfn);
@@ -29,6 +41,10 @@ uint FSeek(uint fd, uint pos);
 uint FLength(uint fd);
 uint FTell(uint fd);
 uint FFlush(uint fd);
+uint FAdvise(uint fd, uint offset, uint len, uint hint);
+
+void FNotify(uint fd, uint what);
+void FSCallHandler(uint cmd, uint param1, uint param2);
 
 
 #endif
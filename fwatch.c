@@ -0,0 +1,168 @@
+
+#include "fwatch.h"
+#include "fs.h"
+#include "list.h"
+#include "queue.h"
+#include "memory.h"
+#include "utility.h"
+#include "task.h"
+#include "event.h"
+
+#define NAME_SIZE 32
+
+typedef struct
+{
+    ListNode head;
+    char name[NAME_SIZE];
+    uint owner;
+    uint mask;
+    uint pending;
+    Queue wait;
+} FileWatch;
+
+static List gWatchList = {0};
+
+static FileWatch* FindWatch(uint wd)
+{
+    FileWatch* ret = NULL;
+    ListNode* pos = NULL;
+    
+    List_ForEach(&gWatchList, pos)
+    {
+        if( IsEqual(pos, wd) )
+        {
+            ret = (FileWatch*)pos;
+            break;
+        }
+    }
+    
+    return (ret && (ret->owner == CurrentTaskId())) ? ret : NULL;
+}
+
+static uint IsWatched(FileWatch* fw, const char* fn)
+{
+    uint n = StrLen(fw->name);
+    uint ret = !n || StrCmp(fw->name, fn, -1);
+    
+    if( !ret && (fw->name[n - 1] == '/') )
+    {
+        uint i = 0;
+        
+        while( (i < n) && (fw->name[i] == fn[i]) )
+        {
+            i++;
+        }
+        
+        ret = (i == n);
+    }
+    
+    return ret;
+}
+
+static void WakeWatch(FileWatch* fw, uint what)
+{
+    Event evt = {FileEvent, (uint)&fw->wait, what, 0};
+    
+    EventSchedule(NOTIFY, &evt);
+}
+
+static void DropWatch(FileWatch* fw)
+{
+    WakeWatch(fw, 0);
+    
+    List_DelNode((ListNode*)fw);
+    
+    Free(fw);
+}
+
+void FWatchModInit()
+{
+    List_Init(&gWatchList);
+}
+
+uint FWatch(const char* fn, uint mask)
+{
+    FileWatch* ret = (fn && mask && (StrLen(fn) < NAME_SIZE)) ? Malloc(sizeof(FileWatch)) : NULL;
+    
+    if( ret )
+    {
+        StrCpy(ret->name, fn, NAME_SIZE - 1);
+        Queue_Init(&ret->wait);
+        
+        ret->owner = CurrentTaskId();
+        ret->mask = mask;
+        ret->pending = 0;
+        
+        List_Add(&gWatchList, (ListNode*)ret);
+    }
+    
+    return (uint)ret;
+}
+
+void FWatchWait(uint wd, uint* result)
+{
+    FileWatch* fw = FindWatch(wd);
+    Event* evt = NULL;
+    
+    *result = 0;
+    
+    if( fw && fw->pending )
+    {
+        *result = fw->pending;
+        
+        fw->pending = 0;
+    }
+    else if( fw && (evt = CreateEvent(FileEvent, (uint)&fw->wait, (uint)result, 0)) )
+    {
+        EventSchedule(WAIT, evt);
+    }
+}
+
+void FUnwatch(uint wd)
+{
+    FileWatch* fw = FindWatch(wd);
+    
+    if( fw )
+    {
+        DropWatch(fw);
+    }
+}
+
+void FWatchRelease(uint owner)
+{
+    ListNode* pos = gWatchList.next;
+    
+    while( !IsEqual(pos, &gWatchList) )
+    {
+        FileWatch* fw = (FileWatch*)pos;
+        
+        pos = pos->next;
+        
+        if( fw->owner == owner )
+        {
+            DropWatch(fw);
+        }
+    }
+}
+
+void FWatchNotify(const char* fn, uint what)
+{
+    ListNode* pos = NULL;
+    
+    List_ForEach(&gWatchList, pos)
+    {
+        FileWatch* fw = (FileWatch*)pos;
+        
+        if( (fw->mask & what) && IsWatched(fw, fn) )
+        {
+            if( Queue_Length(&fw->wait) )
+            {
+                WakeWatch(fw, fw->mask & what);
+            }
+            else
+            {
+                fw->pending |= (fw->mask & what);
+            }
+        }
+    }
+}
@@ -0,0 +1,14 @@
+
+#ifndef FWATCH_H
+#define FWATCH_H
+
+#include "type.h"
+
+void FWatchModInit();
+uint FWatch(const char* fn, uint mask);
+void FWatchWait(uint wd, uint* result);
+void FUnwatch(uint wd);
+void FWatchRelease(uint owner);
+void FWatchNotify(const char* fn, uint what);
+
+#endif
@@ -0,0 +1,194 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "hdraw.h"
+#include "hdfile.h"
+
+static int gFd = -1;
+static byte* gMem = NULL;
+static uint gSectors = 0;
+static HDFileStat gStat = {0};
+static uint gLast = 0;
+
+uint HDFileOpen(const char* path, uint sectors)
+{
+    uint ret = 0;
+    
+    HDFileClose();
+    
+    if( !path )
+    {
+        void* mem = mmap(NULL, (size_t)sectors * SECT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        
+        if( sectors && (mem != MAP_FAILED) )
+        {
+            gMem = (byte*)mem;
+            gSectors = sectors;
+            ret = 1;
+        }
+    }
+    else if( (gFd = open(path, O_RDWR | (sectors ? O_CREAT : 0), 0644)) >= 0 )
+    {
+        struct stat st = {0};
+        
+        if( sectors )
+        {
+            ret = !ftruncate(gFd, (off_t)sectors * SECT_SIZE);
+        }
+        else if( !fstat(gFd, &st) )
+        {
+            sectors = st.st_size / SECT_SIZE;
+            ret = !!sectors;
+        }
+        
+        if( ret )
+        {
+            gSectors = sectors;
+        }
+        else
+        {
+            HDFileClose();
+        }
+    }
+    
+    return ret;
+}
+
+void HDFileClose()
+{
+    if( gFd >= 0 )
+    {
+        fsync(gFd);
+        close(gFd);
+    }
+    
+    if( gMem )
+    {
+        munmap(gMem, (size_t)gSectors * SECT_SIZE);
+    }
+    
+    gFd = -1;
+    gMem = NULL;
+    gSectors = 0;
+}
+
+HDFileStat HDFileGetStat()
+{
+    return gStat;
+}
+
+void HDFileResetStat()
+{
+    gStat.reads = 0;
+    gStat.writes = 0;
+    gStat.seeks = 0;
+    gStat.cmds = 0;
+}
+
+void HDRawModInit()
+{
+    
+}
+
+uint HDRawSectors()
+{
+    return gSectors;
+}
+
+uint HDRawWriteN(uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        if( gMem )
+        {
+            memcpy(gMem + (size_t)si * SECT_SIZE, buf, (size_t)n * SECT_SIZE);
+            ret = n;
+        }
+        else
+        {
+            ret = (pwrite(gFd, buf, (size_t)n * SECT_SIZE, (off_t)si * SECT_SIZE) == (ssize_t)n * SECT_SIZE) ? n : 0;
+        }
+        
+        gStat.writes += n;
+        gStat.seeks += (si != gLast + 1);
+        gStat.cmds++;
+        
+        gLast = si + n - 1;
+    }
+    
+    return ret;
+}
+
+uint HDRawReadN(uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        if( gMem )
+        {
+            memcpy(buf, gMem + (size_t)si * SECT_SIZE, (size_t)n * SECT_SIZE);
+            ret = n;
+        }
+        else
+        {
+            ret = (pread(gFd, buf, (size_t)n * SECT_SIZE, (off_t)si * SECT_SIZE) == (ssize_t)n * SECT_SIZE) ? n : 0;
+        }
+        
+        gStat.reads += n;
+        gStat.seeks += (si != gLast + 1);
+        gStat.cmds++;
+        
+        gLast = si + n - 1;
+    }
+    
+    return ret;
+}
+
+uint HDRawWrite(uint si, byte* buf)
+{
+    return HDRawWriteN(si, buf, 1) == 1;
+}
+
+uint HDRawRead(uint si, byte* buf)
+{
+    return HDRawReadN(si, buf, 1) == 1;
+}
+
+uint HDRawFlush()
+{
+    return gMem ? 1 : !fsync(gFd);
+}
+
+static uint FileSectors(const BlkDev* dev)
+{
+    return HDRawSectors();
+}
+
+static uint FileRead(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    return HDRawReadN(si, buf, n);
+}
+
+static uint FileWrite(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    return HDRawWriteN(si, buf, n);
+}
+
+static uint FileFlush(const BlkDev* dev)
+{
+    return HDRawFlush();
+}
+
+static const BlkDev gHDDev = {"hd", NULL, FileSectors, FileRead, FileWrite, FileFlush, NULL, NULL, NULL};
+
+const BlkDev* HDRawDevice()
+{
+    return &gHDDev;
+}
@@ -0,0 +1,19 @@
+#ifndef HDFILE_H
+#define HDFILE_H
+
+#include "type.h"
+
+typedef struct
+{
+    uint reads;
+    uint writes;
+    uint seeks;
+    uint cmds;
+} HDFileStat;
+
+uint HDFileOpen(const char* path, uint sectors);
+void HDFileClose();
+HDFileStat HDFileGetStat();
+void HDFileResetStat();
+
+#endif
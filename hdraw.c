@@ -1,21 +1,49 @@
 #include "hdraw.h"
 #include "memory.h"
+#include "utility.h"
+#include "task.h"
+#include "pci.h"
+#include "interrupt.h"
+#include "iostat.h"
 
 #define ATA_IDENTIFY    0xEC
 #define ATA_READ        0x20
 #define ATA_WRITE       0x30
+#define ATA_READ_MULTI  0xC4
+#define ATA_WRITE_MULTI 0xC5
+#define ATA_SET_MULTI   0xC6
+#define ATA_READ_DMA    0xC8
+#define ATA_WRITE_DMA   0xCA
+#define ATA_READ_EXT          0x24
+#define ATA_READ_DMA_EXT      0x25
+#define ATA_READ_MULTI_EXT    0x29
+#define ATA_WRITE_EXT         0x34
+#define ATA_WRITE_DMA_EXT     0x35
+#define ATA_WRITE_MULTI_EXT   0x39
+#define ATA_FLUSH             0xE7
+#define ATA_FLUSH_EXT         0xEA
 
-#define REG_DEV_CTRL  0x3F6
-#define REG_DATA      0x1F0
-#define REG_FEATURES  0x1F1
-#define REG_ERROR     0x1F1
-#define REG_NSECTOR   0x1F2
-#define REG_LBA_LOW   0x1F3
-#define REG_LBA_MID   0x1F4
-#define REG_LBA_HIGH  0x1F5
-#define REG_DEVICE    0x1F6
-#define REG_STATUS    0x1F7
-#define REG_COMMAND   0x1F7
+#define ATA_MAX_SECTORS 256
+#define ATA_MAX_SECTORS_EXT 65536
+#define LBA28_SECTORS   0x10000000
+#define PRD_MAX         8
+#define HD_SPIN_MAX     1000000
+#define HD_REQ_MAX      32
+#define HD_BATCH_MAX    8
+#define HD_MERGE_MAX    8
+#define HD_WRITE_AGE    8
+#define HD_CHANNEL_MAX  2
+
+#define REG_DATA      0x00
+#define REG_FEATURES  0x01
+#define REG_ERROR     0x01
+#define REG_NSECTOR   0x02
+#define REG_LBA_LOW   0x03
+#define REG_LBA_MID   0x04
+#define REG_LBA_HIGH  0x05
+#define REG_DEVICE    0x06
+#define REG_STATUS    0x07
+#define REG_COMMAND   0x07
 
 #define	STATUS_BSY  0x80
 #define	STATUS_DRDY 0x40
@@ -26,6 +54,17 @@
 #define	STATUS_IDX  0x02
 #define	STATUS_ERR  0x01
 
+#define BM_COMMAND  0x00
+#define BM_STATUS   0x02
+#define BM_PRDT     0x04
+
+#define BM_START    0x01
+#define BM_TO_MEM   0x08
+#define BM_ACTIVE   0x01
+#define BM_ERROR    0x02
+#define BM_IRQ      0x04
+#define PRD_EOT     0x8000
+
 extern byte ReadPort(ushort port);
 extern void WritePort(ushort port, byte value);
 extern void ReadPortW(ushort port, ushort* buf, uint n);
@@ -33,134 +72,1036 @@ extern void WritePortW(ushort port, ushort* buf, uint n);
 
 typedef struct
 {
+    byte nsector;
     byte lbaLow;
     byte lbaMid;
     byte lbaHigh;
     byte device;
     byte command;
+    byte ext;
+    byte nsectorHob;
+    byte lbaLowHob;
 } HDRegValue;
 
-static uint IsBusy()
+typedef struct
+{
+    uint addr;
+    ushort count;
+    ushort flags;
+} PRDEntry;
+
+typedef struct _HDDisk HDDisk;
+
+typedef struct
 {
+    HDDisk* disk;
+    uint si;
+    byte* buf;
+    uint n;
+    uint write;
+    uint batch;
+    uint stamp;
+    uint busy;
+    IOSpan span;
+} HDReq;
+
+typedef struct
+{
+    Queue wait;
+    uint value;
+    uint left;
+    uint failed;
+    uint state;
+    BlkDone done;
+    void* arg;
+} HDBatch;
+
+typedef struct
+{
+    HDDisk* disk;
+    HDReq* req[HD_MERGE_MAX];
+    uint cnt;
+    uint si;
+    uint n;
+    uint done;
+    uint write;
+    uint dma;
+    uint failed;
+} HDCmd;
+
+typedef struct
+{
+    PRDEntry prd[PRD_MAX] __attribute__((aligned(64)));
+    ushort base;
+    ushort ctrl;
+    uint irq;
+    uint bmBase;
+    HDReq req[HD_REQ_MAX];
+    HDCmd cmd;
+    uint active;
+    uint head;
+    uint tick;
+} HDChannel;
+
+struct _HDDisk
+{
+    HDChannel* chl;
+    uint drive;
+    uint sectors;
+    uint multi;
+    uint lba48;
+    uint dma;
+    uint open;
+    uint stat;
+    BlkDev dev;
+};
+
+static HDChannel gChannel[HD_CHANNEL_MAX] =
+{
+    {{{0}}, 0x1F0, 0x3F6, 14},
+    {{{0}}, 0x170, 0x376, 15}
+};
+
+static HDDisk gDisk[HD_DISK_MAX] = {0};
+static HDBatch gBatch[HD_BATCH_MAX] = {0};
+
+static uint IsBusy(HDDisk* d)
+{
+    IOSpan sp = {0};
     uint ret = 0;
     uint i = 0;
     
-    while( (i < 500) && (ret = (ReadPort(REG_STATUS) & STATUS_BSY)) )
+    IOStatMark(&sp);
+    
+    while( (i < 500) && (ret = (ReadPort(d->chl->base + REG_STATUS) & STATUS_BSY)) )
     {
         i++;
     }
     
+    IOStatWait(d->stat, &sp, ret);
+    
     return ret;
 }
 
-static uint IsDevReady()
+static uint IsIdle(HDChannel* c)
 {
-    return !(ReadPort(REG_STATUS) & STATUS_DRDY);
+    return !(ReadPort(c->base + REG_STATUS) & STATUS_BSY);
 }
 
-static uint IsDataReady()
+static uint IsDataReady(HDChannel* c)
 {
-    return ReadPort(REG_STATUS) & STATUS_DRQ;
+    return ReadPort(c->base + REG_STATUS) & STATUS_DRQ;
 }
 
-static uint MakeDevRegVal(uint si)
+static uint MakeDevRegVal(HDDisk* d, uint si)
 {
-    return 0xE0 | ((si >> 24) & 0x0F);
+    return 0xE0 | (d->drive << 4) | ((si >> 24) & 0x0F);
 }
 
-static HDRegValue MakeRegVals(uint si, uint action)
+static uint ExtCommand(uint action)
+{
+    uint ret = action;
+    
+    switch( action )
+    {
+        case ATA_READ:
+            ret = ATA_READ_EXT;
+            break;
+        case ATA_WRITE:
+            ret = ATA_WRITE_EXT;
+            break;
+        case ATA_READ_MULTI:
+            ret = ATA_READ_MULTI_EXT;
+            break;
+        case ATA_WRITE_MULTI:
+            ret = ATA_WRITE_MULTI_EXT;
+            break;
+        case ATA_READ_DMA:
+            ret = ATA_READ_DMA_EXT;
+            break;
+        case ATA_WRITE_DMA:
+            ret = ATA_WRITE_DMA_EXT;
+            break;
+        default:
+            break;
+    }
+    
+    return ret;
+}
+
+static HDRegValue MakeRegVals(HDDisk* d, uint si, uint n, uint action)
 {
     HDRegValue ret = {0};
     
+    ret.ext = d->lba48 && ((n > ATA_MAX_SECTORS) || (si > LBA28_SECTORS - n)) && (ExtCommand(action) != action);
+    ret.nsector = n & 0xFF;
     ret.lbaLow = si & 0xFF;
     ret.lbaMid = (si >> 8) & 0xFF;
     ret.lbaHigh = (si >> 16) & 0xFF;
-    ret.device = MakeDevRegVal(si);
-    ret.command = action;
+    ret.device = ret.ext ? (0x40 | (d->drive << 4)) : MakeDevRegVal(d, si);
+    ret.command = ret.ext ? ExtCommand(action) : action;
+    ret.nsectorHob = (n >> 8) & 0xFF;
+    ret.lbaLowHob = (si >> 24) & 0xFF;
     
     return ret;
 }
 
-static void WritePorts(HDRegValue hdrv)
+static void WritePorts(HDChannel* c, HDRegValue hdrv)
+{
+    if( hdrv.ext )
+    {
+        WritePort(c->base + REG_FEATURES, 0);
+        WritePort(c->base + REG_NSECTOR, hdrv.nsectorHob);
+        WritePort(c->base + REG_LBA_LOW, hdrv.lbaLowHob);
+        WritePort(c->base + REG_LBA_MID, 0);
+        WritePort(c->base + REG_LBA_HIGH, 0);
+    }
+    
+    WritePort(c->base + REG_FEATURES, 0);
+    WritePort(c->base + REG_NSECTOR, hdrv.nsector);
+    WritePort(c->base + REG_LBA_LOW, hdrv.lbaLow);
+    WritePort(c->base + REG_LBA_MID, hdrv.lbaMid);
+    WritePort(c->base + REG_LBA_HIGH, hdrv.lbaHigh);
+    WritePort(c->base + REG_DEVICE, hdrv.device);
+    WritePort(c->base + REG_COMMAND, hdrv.command);
+    
+    WritePort(c->ctrl, 0);
+}
+
+static uint SetMultiple(HDDisk* d, uint n)
 {
-    WritePort(REG_FEATURES, 0);
-    WritePort(REG_NSECTOR, 1);
-    WritePort(REG_LBA_LOW, hdrv.lbaLow);
-    WritePort(REG_LBA_MID, hdrv.lbaMid);
-    WritePort(REG_LBA_HIGH, hdrv.lbaHigh);
-    WritePort(REG_DEVICE, hdrv.device);
-    WritePort(REG_COMMAND, hdrv.command);
+    uint ret = 0;
+    
+    if( n && !IsBusy(d) )
+    {
+        HDRegValue hdrv = MakeRegVals(d, 0, n, ATA_SET_MULTI);
+        
+        WritePorts(d->chl, hdrv);
         
-    WritePort(REG_DEV_CTRL, 0);
+        ret = !IsBusy(d) && !(ReadPort(d->chl->base + REG_STATUS) & STATUS_ERR);
+    }
+    
+    return ret ? n : 0;
 }
 
-void HDRawModInit()
+static void Identify(HDDisk* d)
+{
+    HDChannel* c = d->chl;
+    HDRegValue hdrv = MakeRegVals(d, 0, 1, ATA_IDENTIFY);
+    byte* buf = Malloc(SECT_SIZE);
+    uint multi = 0;
+    
+    WritePorts(c, hdrv);
+    
+    if( !IsBusy(d) && IsDataReady(c) && buf )
+    {
+        ushort* data = (ushort*)buf;
+        
+        ReadPortW(c->base + REG_DATA, data, SECT_SIZE >> 1);
+        
+        d->lba48 = !!(data[83] & 0x400);
+        d->sectors = d->lba48 ? ((data[101] << 16) | data[100]) : ((data[61] << 16) | data[60]);
+        d->dma = !!(data[49] & 0x100);
+        multi = data[47] & 0xFF;
+        
+        if( d->lba48 && (data[102] || data[103] || (d->sectors == -1)) )
+        {
+            d->sectors = -2;
+        }
+    }
+    
+    Free(buf);
+    
+    d->multi = d->sectors ? SetMultiple(d, multi) : 0;
+}
+
+static uint Probe(HDChannel* c, uint drive)
 {
+    byte status = 0;
+    uint i = 0;
+    
+    WritePort(c->base + REG_DEVICE, 0xA0 | (drive << 4));
+    
+    for(i=0; i<5; i++)
+    {
+        status = ReadPort(c->base + REG_STATUS);
+    }
+    
+    return (status != 0xFF) && (status & (STATUS_DRDY | STATUS_BSY));
+}
 
+static uint MaxRun(HDDisk* d, byte* buf, uint n)
+{
+    uint ret = Min(n, d->lba48 ? ATA_MAX_SECTORS_EXT : ATA_MAX_SECTORS);
+    
+    if( d->dma && d->chl->bmBase && ((uint)buf + ret * SECT_SIZE <= FMapBase) )
+    {
+        ret = Min(ret, (0x10000 - ((uint)buf & 0xFFFF) + (PRD_MAX - 1) * 0x10000) / SECT_SIZE);
+    }
+    
+    return ret;
 }
 
-uint HDRawSectors()
+static uint Command(HDDisk* d, uint write)
+{
+    return d->multi ? (write ? ATA_WRITE_MULTI : ATA_READ_MULTI) : (write ? ATA_WRITE : ATA_READ);
+}
+
+static uint CanDma(HDReq* req)
 {
-    static uint ret = -1;
+    HDDisk* d = req->disk;
     
-    if( (ret == -1) && IsDevReady() )
+    return d->dma && d->chl->bmBase && !((uint)req->buf & 1) && ((uint)req->buf + req->n * SECT_SIZE <= FMapBase);
+}
+
+static uint PrdCount(HDReq* req)
+{
+    return (((uint)req->buf & 0xFFFF) + req->n * SECT_SIZE + 0xFFFF) >> 16;
+}
+
+static byte* CmdSector(HDCmd* cmd, uint off)
+{
+    byte* ret = NULL;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<cmd->cnt); i++)
+    {
+        if( off < cmd->req[i]->n )
+        {
+            ret = AddrOff(cmd->req[i]->buf, off * SECT_SIZE);
+        }
+        else
+        {
+            off -= cmd->req[i]->n;
+        }
+    }
+    
+    return ret;
+}
+
+static uint Block(HDChannel* c)
+{
+    HDCmd* cmd = &c->cmd;
+    uint k = Min(cmd->disk->multi ? cmd->disk->multi : 1, cmd->n - cmd->done);
+    uint i = 0;
+    
+    for(i=0; i<k; i++)
     {
-        HDRegValue hdrv = MakeRegVals(0, ATA_IDENTIFY);
-        byte* buf = Malloc(SECT_SIZE);
+        ushort* data = (ushort*)CmdSector(cmd, cmd->done + i);
         
-        WritePorts(hdrv);
+        if( cmd->write )
+        {
+            WritePortW(c->base + REG_DATA, data, SECT_SIZE >> 1);
+        }
+        else
+        {
+            ReadPortW(c->base + REG_DATA, data, SECT_SIZE >> 1);
+        }
+    }
+    
+    cmd->done += k;
+    
+    return k;
+}
+
+static void DmaStop(HDChannel* c)
+{
+    WritePort(c->bmBase + BM_COMMAND, 0);
+    WritePort(c->bmBase + BM_STATUS, BM_ERROR | BM_IRQ);
+}
+
+static void DmaStart(HDChannel* c)
+{
+    HDCmd* cmd = &c->cmd;
+    uint i = 0;
+    uint j = 0;
+    
+    for(i=0; i<cmd->cnt; i++)
+    {
+        uint addr = (uint)cmd->req[i]->buf;
+        uint len = cmd->req[i]->n * SECT_SIZE;
         
-        if( !IsBusy() && IsDataReady() && buf )
+        while( len )
         {
-            ushort* data = (ushort*)buf;
+            uint k = Min(len, 0x10000 - (addr & 0xFFFF));
             
-            ReadPortW(REG_DATA, data, SECT_SIZE >> 1);
+            c->prd[j].addr = addr;
+            c->prd[j].count = k & 0xFFFF;
+            c->prd[j].flags = 0;
             
-            ret = (data[61] << 16) | (data[60]);
+            addr += k;
+            len -= k;
+            j++;
         }
+    }
+    
+    c->prd[j - 1].flags = PRD_EOT;
+    
+    DmaStop(c);
+    WritePortL(c->bmBase + BM_PRDT, (uint)c->prd);
+    
+    WritePorts(c, MakeRegVals(cmd->disk, cmd->si, cmd->n, cmd->write ? ATA_WRITE_DMA : ATA_READ_DMA));
+    
+    WritePort(c->bmBase + BM_COMMAND, cmd->write ? BM_START : (BM_START | BM_TO_MEM));
+}
+
+static uint DmaEnd(HDChannel* c, uint* ok)
+{
+    uint ret = 0;
+    byte bm = ReadPort(c->bmBase + BM_STATUS);
+    
+    if( bm & (BM_IRQ | BM_ERROR) )
+    {
+        DmaStop(c);
+        
+        *ok = !(bm & BM_ERROR) && !(ReadPort(c->base + REG_STATUS) & STATUS_ERR);
         
-        Free(buf);
+        ret = 1;
     }
     
     return ret;
 }
 
-uint HDRawWrite(uint si, byte* buf)
+static void Wake(HDBatch* b)
 {
+    Event evt = {DiskEvent, (uint)&b->wait, b->failed ? -1 : b->value, 0};
+    
+    b->state = 0;
+    
+    if( b->done )
+    {
+        b->done(b->arg, !b->failed);
+    }
+    else
+    {
+        EventSchedule(NOTIFY, &evt);
+    }
+}
+
+static void Complete(HDChannel* c)
+{
+    HDCmd* cmd = &c->cmd;
+    uint i = 0;
+    
+    c->active = 0;
+    c->head = cmd->si + cmd->n;
+    
+    for(i=0; i<cmd->cnt; i++)
+    {
+        HDReq* req = cmd->req[i];
+        
+        if( req->batch < HD_BATCH_MAX )
+        {
+            HDBatch* b = &gBatch[req->batch];
+            
+            IOStatEnd(req->disk->stat, &req->span, req->si, req->n, (req->write ? IO_WRITE : IO_READ) | IO_ASYNC, !cmd->failed);
+            
+            b->failed = b->failed || cmd->failed;
+            b->left--;
+            
+            if( !b->left && (b->state == 2) )
+            {
+                Wake(b);
+            }
+        }
+        
+        req->n = 0;
+        req->busy = 0;
+    }
+}
+
+static void Issue(HDChannel* c)
+{
+    HDCmd* cmd = &c->cmd;
+    uint ret = 0;
+    
+    c->active = 1;
+    cmd->done = 0;
+    cmd->failed = 0;
+    
+    if( IsIdle(c) )
+    {
+        if( cmd->dma )
+        {
+            DmaStart(c);
+            
+            ret = 1;
+        }
+        else
+        {
+            WritePorts(c, MakeRegVals(cmd->disk, cmd->si, cmd->n, Command(cmd->disk, cmd->write)));
+            
+            ret = !cmd->write || (!IsBusy(cmd->disk) && IsDataReady(c) && Block(c));
+        }
+    }
+    
+    if( !ret )
+    {
+        cmd->failed = 1;
+        Complete(c);
+    }
+}
+
+static uint Step(HDChannel* c)
+{
+    HDCmd* cmd = &c->cmd;
     uint ret = 0;
+    uint done = 0;
+    byte status = ReadPort(c->base + REG_STATUS);
     
-    if( (si < HDRawSectors()) && buf && !IsBusy() )
+    if( cmd->dma )
     {
-        HDRegValue hdrv = MakeRegVals(si, ATA_WRITE);
+        uint ok = 0;
         
-        WritePorts(hdrv);
+        if( (done = DmaEnd(c, &ok)) )
+        {
+            cmd->failed = !ok;
+        }
+    }
+    else if( !(status & STATUS_BSY) )
+    {
+        if( status & STATUS_ERR )
+        {
+            cmd->failed = 1;
+            done = 1;
+        }
+        else if( (status & STATUS_DRQ) && (cmd->done < cmd->n) )
+        {
+            ret = Block(c);
+            done = !cmd->write && (cmd->done == cmd->n);
+        }
+        else
+        {
+            done = cmd->write && (cmd->done == cmd->n);
+        }
+    }
+    
+    if( done )
+    {
+        Complete(c);
+        
+        ret = 1;
+    }
+    
+    return ret;
+}
+
+static HDReq* Pick(HDChannel* c)
+{
+    HDReq* ret = NULL;
+    HDReq* low = NULL;
+    uint reads = 0;
+    uint aged = 0;
+    uint i = 0;
+    
+    for(i=0; i<HD_REQ_MAX; i++)
+    {
+        HDReq* req = &c->req[i];
+        
+        if( req->n && !req->busy )
+        {
+            reads = reads || !req->write;
+            aged = aged || (req->write && (c->tick - req->stamp > HD_WRITE_AGE));
+        }
+    }
+    
+    for(i=0; i<HD_REQ_MAX; i++)
+    {
+        HDReq* req = &c->req[i];
         
-        if( ret = (!IsBusy() && IsDataReady()) )
+        if( req->n && !req->busy && (!req->write || !reads || aged) )
         {
-            ushort* data = (ushort*)buf;
+            if( (req->si >= c->head) && (!ret || (req->si < ret->si)) )
+            {
+                ret = req;
+            }
             
-            WritePortW(REG_DATA, data, SECT_SIZE >> 1);
+            if( !low || (req->si < low->si) )
+            {
+                low = req;
+            }
+        }
+    }
+    
+    return ret ? ret : low;
+}
+
+static HDReq* Follow(HDChannel* c, uint prd)
+{
+    HDCmd* cmd = &c->cmd;
+    HDReq* ret = NULL;
+    uint max = cmd->disk->lba48 ? ATA_MAX_SECTORS_EXT : ATA_MAX_SECTORS;
+    uint i = 0;
+    
+    for(i=0; !ret && (cmd->cnt < HD_MERGE_MAX) && (i<HD_REQ_MAX); i++)
+    {
+        HDReq* req = &c->req[i];
+        
+        if( req->n && !req->busy && (req->disk == cmd->disk) && (req->si == cmd->si + cmd->n) && (req->write == cmd->write) &&
+            (req->n <= max - cmd->n) && (CanDma(req) == cmd->dma) && (!cmd->dma || (prd + PrdCount(req) <= PRD_MAX)) )
+        {
+            ret = req;
         }
     }
     
     return ret;
 }
 
-uint HDRawRead(uint si, byte* buf)
+static void Dispatch(HDChannel* c)
+{
+    HDCmd* cmd = &c->cmd;
+    HDReq* req = Pick(c);
+    uint prd = 0;
+    
+    if( req )
+    {
+        cmd->disk = req->disk;
+        cmd->cnt = 0;
+        cmd->si = req->si;
+        cmd->n = 0;
+        cmd->write = req->write;
+        cmd->dma = CanDma(req);
+        
+        c->tick++;
+        
+        while( req )
+        {
+            req->busy = 1;
+            prd += PrdCount(req);
+            
+            cmd->req[cmd->cnt++] = req;
+            cmd->n += req->n;
+            
+            req = Follow(c, prd);
+        }
+        
+        Issue(c);
+    }
+}
+
+static uint Pending(HDChannel* c)
 {
     uint ret = 0;
+    uint i = 0;
     
-    if( (si < HDRawSectors()) && buf && !IsBusy() )
+    for(i=0; !ret && (i<HD_REQ_MAX); i++)
     {
-        HDRegValue hdrv = MakeRegVals(si, ATA_READ);
+        ret = c->req[i].n && !c->req[i].busy;
+    }
+    
+    return ret;
+}
+
+static void Poll(HDChannel* c, uint all)
+{
+    uint idle = 0;
+    
+    while( c->active || (all && Pending(c)) )
+    {
+        if( !c->active )
+        {
+            Dispatch(c);
+        }
+        else if( Step(c) )
+        {
+            idle = 0;
+        }
+        else if( ++idle > HD_SPIN_MAX )
+        {
+            IOStatWait(c->cmd.disk->stat, NULL, 1);
+            
+            if( c->cmd.dma )
+            {
+                DmaStop(c);
+            }
+            
+            c->cmd.failed = 1;
+            Complete(c);
+        }
+    }
+}
+
+static uint IsQueued(HDDisk* d, uint si, uint n)
+{
+    HDReq* req = d->chl->req;
+    uint ret = 0;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<HD_REQ_MAX); i++)
+    {
+        ret = req[i].n && (req[i].disk == d) && (si < req[i].si + req[i].n) && (req[i].si < si + n);
+    }
+    
+    return ret;
+}
+
+static uint Transfer(HDDisk* d, uint si, byte* buf, uint n, uint write)
+{
+    HDChannel* c = d->chl;
+    uint ret = 0;
+    
+    n = MaxRun(d, buf, n);
+    
+    if( n && (si < d->sectors) && (n <= d->sectors - si) && buf )
+    {
+        HDReq req = {d, si, buf, n, write, HD_BATCH_MAX, 0, 1};
+        
+        IOStatBegin(d->stat, &req.span);
+        
+        Poll(c, IsQueued(d, si, n));
+        
+        c->cmd.disk = d;
+        c->cmd.cnt = 1;
+        c->cmd.req[0] = &req;
+        c->cmd.si = si;
+        c->cmd.n = n;
+        c->cmd.write = write;
+        c->cmd.dma = CanDma(&req);
+        
+        Issue(c);
+        
+        Poll(c, 0);
+        
+        ret = c->cmd.failed ? 0 : n;
+        
+        IOStatEnd(d->stat, &req.span, si, n, write ? IO_WRITE : IO_READ, ret);
+        
+        Dispatch(c);
+    }
+    
+    return ret;
+}
+
+static uint NewBatch()
+{
+    uint ret = 0;
+    
+    while( (ret < HD_BATCH_MAX) && gBatch[ret].state )
+    {
+        ret++;
+    }
+    
+    if( ret < HD_BATCH_MAX )
+    {
+        gBatch[ret].state = 1;
+        gBatch[ret].left = 0;
+        gBatch[ret].failed = 0;
+        gBatch[ret].done = NULL;
+    }
+    
+    return ret;
+}
+
+static HDReq* NewReq(HDChannel* c)
+{
+    HDReq* ret = NULL;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<HD_REQ_MAX); i++)
+    {
+        ret = c->req[i].n ? NULL : &c->req[i];
+    }
+    
+    return ret;
+}
+
+static uint Enqueue(HDDisk* d, uint si, byte* buf, uint n, uint write)
+{
+    uint ret = 0;
+    HDReq* req = NULL;
+    
+    n = MaxRun(d, buf, n);
+    
+    if( n && (si < d->sectors) && (n <= d->sectors - si) && buf )
+    {
+        if( IsQueued(d, si, n) )
+        {
+            Poll(d->chl, 1);
+        }
+        
+        if( (d->open < HD_BATCH_MAX) || ((d->open = NewBatch()) < HD_BATCH_MAX) )
+        {
+            req = NewReq(d->chl);
+        }
+    }
+    
+    if( req )
+    {
+        req->disk = d;
+        req->si = si;
+        req->buf = buf;
+        req->n = n;
+        req->write = write;
+        req->batch = d->open;
+        req->stamp = d->chl->tick;
+        req->busy = 0;
+        
+        IOStatBegin(d->stat, &req->span);
+        
+        gBatch[d->open].left++;
+        
+        ret = n;
+    }
+    
+    return ret;
+}
+
+static uint Submit(HDDisk* d, uint* result, uint value)
+{
+    uint ret = 0;
+    HDChannel* c = d->chl;
+    HDBatch* b = (d->open < HD_BATCH_MAX) ? &gBatch[d->open] : NULL;
+    Event* evt = NULL;
+    
+    d->open = HD_BATCH_MAX;
+    
+    if( b && b->left && result && (evt = CreateEvent(DiskEvent, (uint)&b->wait, (uint)result, 0)) )
+    {
+        b->value = value;
+        b->state = 2;
+        
+        EventSchedule(WAIT, evt);
+        
+        if( !c->active )
+        {
+            Dispatch(c);
+        }
+        
+        ret = 1;
+    }
+    else if( b )
+    {
+        Poll(c, b->left);
+        
+        if( result && b->failed )
+        {
+            *result = -1;
+        }
+        
+        b->state = 0;
+    }
+    
+    return ret;
+}
+
+static void Start(HDDisk* d, BlkDone done, void* arg)
+{
+    HDChannel* c = d->chl;
+    HDBatch* b = (d->open < HD_BATCH_MAX) ? &gBatch[d->open] : NULL;
+    
+    d->open = HD_BATCH_MAX;
+    
+    if( b && b->left )
+    {
+        b->done = done;
+        b->arg = arg;
+        b->state = 2;
+        
+        if( !c->active )
+        {
+            Dispatch(c);
+        }
+    }
+    else
+    {
+        if( b )
+        {
+            b->state = 0;
+        }
         
-        WritePorts(hdrv);
+        done(arg, !(b && b->failed));
+    }
+}
+
+static uint Flush(HDDisk* d)
+{
+    HDChannel* c = d->chl;
+    uint ret = 0;
+    uint i = 0;
+    
+    Poll(c, 1);
+    
+    if( !IsBusy(d) )
+    {
+        WritePorts(c, MakeRegVals(d, 0, 0, d->lba48 ? ATA_FLUSH_EXT : ATA_FLUSH));
         
-        if( ret = (!IsBusy() && IsDataReady()) )
+        while( (ReadPort(c->base + REG_STATUS) & STATUS_BSY) && (++i < HD_SPIN_MAX) );
+        
+        IOStatWait(d->stat, NULL, i >= HD_SPIN_MAX);
+        
+        ret = !(ReadPort(c->base + REG_STATUS) & (STATUS_BSY | STATUS_ERR));
+    }
+    
+    return ret;
+}
+
+static uint DiskSectors(const BlkDev* dev)
+{
+    return ((HDDisk*)dev->data)->sectors;
+}
+
+static uint DiskRead(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    return Transfer(dev->data, si, buf, n, 0);
+}
+
+static uint DiskWrite(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    return Transfer(dev->data, si, buf, n, 1);
+}
+
+static uint DiskFlush(const BlkDev* dev)
+{
+    return Flush(dev->data);
+}
+
+static uint DiskQueue(const BlkDev* dev, uint si, byte* buf, uint n, uint write)
+{
+    return Enqueue(dev->data, si, buf, n, write);
+}
+
+static uint DiskSubmit(const BlkDev* dev, uint* result, uint value)
+{
+    return Submit(dev->data, result, value);
+}
+
+static void DiskStart(const BlkDev* dev, BlkDone done, void* arg)
+{
+    Start(dev->data, done, arg);
+}
+
+static const char* const gName[HD_DISK_MAX] = {"hd", "hd1", "hd2", "hd3"};
+
+void HDRawModInit()
+{
+    uint dev = PCIFind(0x01, 0x01);
+    uint bmBase = 0;
+    uint i = 0;
+    uint j = 0;
+    
+    if( dev && (PCIRead(dev, PCI_CLASS) & 0x8000) && (PCIRead(dev, PCI_BAR4) & 1) )
+    {
+        bmBase = PCIRead(dev, PCI_BAR4) & 0xFFFC;
+        
+        PCIWrite(dev, PCI_COMMAND, PCIRead(dev, PCI_COMMAND) | 0x05);
+    }
+    
+    for(i=0; i<HD_CHANNEL_MAX; i++)
+    {
+        HDChannel* c = &gChannel[i];
+        
+        c->bmBase = bmBase ? (bmBase + i * 8) : 0;
+        
+        for(j=0; j<2; j++)
         {
-            ushort* data = (ushort*)buf;
+            HDDisk* d = &gDisk[i * 2 + j];
+            BlkDev blk = {gName[i * 2 + j], d, DiskSectors, DiskRead, DiskWrite, DiskFlush, DiskQueue, DiskSubmit, DiskStart};
+            
+            d->chl = c;
+            d->drive = j;
+            d->open = HD_BATCH_MAX;
+            d->stat = IOSTAT_DEV_MAX;
+            d->dev = blk;
+            
+            if( Probe(c, j) )
+            {
+                Identify(d);
+            }
             
-            ReadPortW(REG_DATA, data, SECT_SIZE >> 1);
+            if( d->sectors )
+            {
+                d->stat = IOStatAdd(blk.name);
+                
+                AddDiskIrq(c->irq);
+            }
+        }
+    }
+    
+    for(i=0; i<HD_BATCH_MAX; i++)
+    {
+        Queue_Init(&gBatch[i].wait);
+    }
+}
+
+uint HDRawSectors()
+{
+    return gDisk[0].sectors;
+}
+
+uint HDRawWrite(uint si, byte* buf)
+{
+    return Transfer(&gDisk[0], si, buf, 1, 1) == 1;
+}
+
+uint HDRawRead(uint si, byte* buf)
+{
+    return Transfer(&gDisk[0], si, buf, 1, 0) == 1;
+}
+
+uint HDRawWriteN(uint si, byte* buf, uint n)
+{
+    return Transfer(&gDisk[0], si, buf, n, 1);
+}
+
+uint HDRawReadN(uint si, byte* buf, uint n)
+{
+    return Transfer(&gDisk[0], si, buf, n, 0);
+}
+
+uint HDRawQueue(uint si, byte* buf, uint n, uint write)
+{
+    return Enqueue(&gDisk[0], si, buf, n, write);
+}
+
+uint HDRawSubmit(uint* result, uint value)
+{
+    return Submit(&gDisk[0], result, value);
+}
+
+void HDRawIrq()
+{
+    uint i = 0;
+    
+    for(i=0; i<HD_CHANNEL_MAX; i++)
+    {
+        HDChannel* c = &gChannel[i];
+        
+        if( c->active )
+        {
+            Step(c);
+        }
+        else
+        {
+            ReadPort(c->base + REG_STATUS);
+        }
+        
+        if( !c->active )
+        {
+            Dispatch(c);
+        }
+    }
+}
+
+uint HDRawFlush()
+{
+    return Flush(&gDisk[0]);
+}
+
+const BlkDev* HDRawDevice()
+{
+    return &gDisk[0].dev;
+}
+
+const BlkDev* HDRawDisk(uint i)
+{
+    const BlkDev* ret = NULL;
+    uint j = 0;
+    
+    for(j=0; !ret && (j<HD_DISK_MAX); j++)
+    {
+        if( gDisk[j].sectors && !i-- )
+        {
+            ret = &gDisk[j].dev;
         }
     }
     
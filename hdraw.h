@@ -1,13 +1,21 @@
 #ifndef HDRAW_H
 #define HDRAW_H
 
-#include "type.h"
+#include "blkdev.h"
 
-#define SECT_SIZE    512
+#define HD_DISK_MAX  4
 
 void HDRawModInit();
 uint HDRawSectors();
 uint HDRawWrite(uint si, byte* buf);
 uint HDRawRead(uint si, byte* buf);
+uint HDRawWriteN(uint si, byte* buf, uint n);
+uint HDRawReadN(uint si, byte* buf, uint n);
+uint HDRawQueue(uint si, byte* buf, uint n, uint write);
+uint HDRawSubmit(uint* result, uint value);
+void HDRawIrq();
+uint HDRawFlush();
+const BlkDev* HDRawDevice();
+const BlkDev* HDRawDisk(uint i);
 
 #endif
@@ -5,6 +5,11 @@
 #include "mutex.h"
 #include "screen.h"
 #include "sysinfo.h"
+#include "fs.h"
+#include "fmap.h"
+#include "hdraw.h"
+#include "vblk.h"
+#include "ahci.h"
 
 extern byte ReadPort(ushort port);
 
@@ -33,6 +38,16 @@ void KeyboardHandler()
     SendEOI(MASTER_EOI_PORT);
 }
 
+void DiskHandler()
+{
+    HDRawIrq();
+    VBlkIrq();
+    AHCIIrq();
+    
+    SendEOI(SLAVE_EOI_PORT);
+    SendEOI(MASTER_EOI_PORT);
+}
+
 void SysCallHandler(uint type, uint cmd, uint param1, uint param2)   // __cdecl__
 {  
     switch(type)
@@ -49,19 +64,34 @@ void SysCallHandler(uint type, uint cmd, uint param1, uint param2)   // __cdecl_
         case 3:
             SysInfoCallHandler(cmd, param1, param2);
             break;
+        case 4:
+            FSCallHandler(cmd, param1, param2);
+            break;
         default:
             break;
     }
 }
 
-void PageFaultHandler()
+static uint FaultAddr()
 {
-    SetPrintPos(ERR_START_W, ERR_START_H);
+    uint ret = 0;
     
-    PrintString("Page Fault: kill ");
-    PrintString(CurrentTaskName());
+    asm volatile("movl %%cr2, %0" : "=r"(ret));
     
-    KillTask();
+    return ret;
+}
+
+void PageFaultHandler()
+{
+    if( !FMapFault(FaultAddr()) )
+    {
+        SetPrintPos(ERR_START_W, ERR_START_H);
+        
+        PrintString("Page Fault: kill ");
+        PrintString(CurrentTaskName());
+        
+        KillTask();
+    }
 }
 
 void SegmentFaultHandler()
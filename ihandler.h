@@ -9,6 +9,7 @@ DeclHandler(SegmentFaultHandler);
 DeclHandler(PageFaultHandler);                             
 DeclHandler(TimerHandler);
 DeclHandler(KeyboardHandler);
+DeclHandler(DiskHandler);
 DeclHandler(SysCallHandler);
 
 #endif
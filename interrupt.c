@@ -5,15 +5,41 @@
 void (* const InitInterrupt)() = NULL;
 void (* const SendEOI)(uint port) = NULL;
 
+extern byte ReadPort(ushort port);
+extern void WritePort(ushort port, byte value);
+
+static uint gDiskIrq = 1 << 14;
+
+void AddDiskIrq(uint irq)
+{
+    if( (2 < irq) && (irq < 16) )
+    {
+        gDiskIrq |= 1 << irq;
+    }
+}
+
 void IntModInit()
 {
+    uint i = 0;
+    
     SetIntHandler(AddrOff(gIdtInfo.entry, 0x0D), (uint)SegmentFaultHandlerEntry);
     SetIntHandler(AddrOff(gIdtInfo.entry, 0x0E), (uint)PageFaultHandlerEntry);
     SetIntHandler(AddrOff(gIdtInfo.entry, 0x20), (uint)TimerHandlerEntry);
     SetIntHandler(AddrOff(gIdtInfo.entry, 0x21), (uint)KeyboardHandlerEntry);
     SetIntHandler(AddrOff(gIdtInfo.entry, 0x80), (uint)SysCallHandlerEntry);
     
+    for(i=0; i<16; i++)
+    {
+        if( gDiskIrq & (1 << i) )
+        {
+            SetIntHandler(AddrOff(gIdtInfo.entry, 0x20 + i), (uint)DiskHandlerEntry);
+        }
+    }
+    
     InitInterrupt();
+    
+    WritePort(MASTER_IMR_PORT, ReadPort(MASTER_IMR_PORT) & ~((gDiskIrq & 0xFF) | 0x04));
+    WritePort(SLAVE_IMR_PORT, ReadPort(SLAVE_IMR_PORT) & ~(gDiskIrq >> 8));
 }
 
 int SetIntHandler(Gate* pGate, uint ifunc)
@@ -8,6 +8,7 @@ extern void (* const EnableTimer)();
 extern void (* const SendEOI)(uint port);
 
 void IntModInit();
+void AddDiskIrq(uint irq);
 int SetIntHandler(Gate* pGate, uint ifunc);
 int GetIntHandler(Gate* pGate, uint* pIFunc);
 
@@ -0,0 +1,248 @@
+#include "iostat.h"
+#include "memory.h"
+#include "utility.h"
+
+#define PIT_CH2         0x42
+#define PIT_MODE        0x43
+#define PIT_GATE        0x61
+#define PIT_OUT2        0x20
+#define PIT_HZ          1193182
+#define CALIBRATE_MS    10
+#define CALIBRATE_SPIN  10000000
+#define DEFAULT_MHZ     1000
+
+extern byte ReadPort(ushort port);
+extern void WritePort(ushort port, byte value);
+
+static IOStat* gStat[IOSTAT_DEV_MAX] = {0};
+static IOTrace* gTrace = NULL;
+static uint gSeq = 0;
+static uint gMhz = DEFAULT_MHZ;
+
+static void Clock(uint* lo, uint* hi)
+{
+    asm volatile("rdtsc" : "=a"(*lo), "=d"(*hi));
+}
+
+static uint Div(uint hi, uint lo, uint m)
+{
+    uint ret = 0;
+    uint i = 0;
+    
+    for(i=0; i<32; i++)
+    {
+        uint top = hi >> 31;
+        
+        hi = (hi << 1) | (lo >> 31);
+        lo <<= 1;
+        ret <<= 1;
+        
+        if( top || (hi >= m) )
+        {
+            hi -= m;
+            ret |= 1;
+        }
+    }
+    
+    return ret;
+}
+
+static uint Elapsed(IOSpan* sp)
+{
+    uint lo = 0;
+    uint hi = 0;
+    
+    Clock(&lo, &hi);
+    
+    hi = hi - sp->hi - (lo < sp->lo);
+    lo = lo - sp->lo;
+    
+    return (hi < gMhz) ? Div(hi, lo, gMhz) : -1;
+}
+
+static uint Bucket(uint us)
+{
+    uint ret = 0;
+    
+    while( us && (ret < IOSTAT_BUCKETS - 1) )
+    {
+        us >>= 1;
+        ret++;
+    }
+    
+    return ret;
+}
+
+static void Calibrate()
+{
+    uint lo = 0;
+    uint hi = 0;
+    uint latch = PIT_HZ / 1000 * CALIBRATE_MS;
+    uint i = 0;
+    IOSpan sp = {0};
+    
+    WritePort(PIT_GATE, (ReadPort(PIT_GATE) & ~0x02) | 0x01);
+    WritePort(PIT_MODE, 0xB0);
+    WritePort(PIT_CH2, latch & 0xFF);
+    WritePort(PIT_CH2, (latch >> 8) & 0xFF);
+    
+    IOStatMark(&sp);
+    
+    while( !(ReadPort(PIT_GATE) & PIT_OUT2) && (++i < CALIBRATE_SPIN) );
+    
+    Clock(&lo, &hi);
+    
+    lo = (lo - sp.lo) / (CALIBRATE_MS * 1000);
+    
+    gMhz = ((i < CALIBRATE_SPIN) && lo) ? lo : DEFAULT_MHZ;
+}
+
+static void Trace(uint id, uint si, uint n, uint kind, uint us, uint ok)
+{
+    IOTrace* t = &gTrace[gSeq % IOTRACE_MAX];
+    
+    t->seq = ++gSeq;
+    t->dev = id;
+    t->kind = kind;
+    t->si = si;
+    t->n = n;
+    t->us = us;
+    t->ok = ok;
+}
+
+void IOStatModInit()
+{
+    Calibrate();
+}
+
+uint IOStatAdd(const char* name)
+{
+    uint ret = 0;
+    
+    while( (ret < IOSTAT_DEV_MAX) && gStat[ret] )
+    {
+        ret++;
+    }
+    
+    if( (ret < IOSTAT_DEV_MAX) && (gStat[ret] = Malloc(sizeof(IOStat))) )
+    {
+        MemSet(gStat[ret], 0, sizeof(IOStat));
+        StrCpy(gStat[ret]->name, name, IOSTAT_NAME_LEN - 1);
+    }
+    else
+    {
+        ret = IOSTAT_DEV_MAX;
+    }
+    
+    return ret;
+}
+
+void IOStatMark(IOSpan* sp)
+{
+    Clock(&sp->lo, &sp->hi);
+}
+
+void IOStatBegin(uint id, IOSpan* sp)
+{
+    if( id < IOSTAT_DEV_MAX )
+    {
+        IOStat* st = gStat[id];
+        
+        st->depth++;
+        st->maxDepth = Max(st->maxDepth, st->depth);
+        
+        IOStatMark(sp);
+    }
+}
+
+void IOStatEnd(uint id, IOSpan* sp, uint si, uint n, uint kind, uint ok)
+{
+    if( id < IOSTAT_DEV_MAX )
+    {
+        IOStat* st = gStat[id];
+        IOKindStat* ks = &st->kind[kind % IO_KIND_MAX];
+        uint us = Elapsed(sp);
+        
+        st->depth--;
+        
+        ks->count++;
+        ks->errors += !ok;
+        ks->sectors += ok ? n : 0;
+        ks->maxUs = Max(ks->maxUs, us);
+        ks->hist[Bucket(us)]++;
+        
+        if( gTrace )
+        {
+            Trace(id, si, n, kind, us, ok);
+        }
+    }
+}
+
+void IOStatWait(uint id, IOSpan* sp, uint timeout)
+{
+    if( id < IOSTAT_DEV_MAX )
+    {
+        IOStat* st = gStat[id];
+        
+        st->timeouts += !!timeout;
+        
+        if( sp )
+        {
+            uint us = Elapsed(sp);
+            
+            st->waits++;
+            st->maxWaitUs = Max(st->maxWaitUs, us);
+            st->waitHist[Bucket(us)]++;
+        }
+    }
+}
+
+uint IOStatCopy(uint id, IOStat* st)
+{
+    uint ret = (id < IOSTAT_DEV_MAX) && gStat[id];
+    
+    if( ret )
+    {
+        MemCpy(st, gStat[id], sizeof(IOStat));
+    }
+    else
+    {
+        MemSet(st, 0, sizeof(IOStat));
+    }
+    
+    return ret;
+}
+
+uint IOTraceCopy(IOTrace* buf, uint max)
+{
+    uint ret = 0;
+    uint i = 0;
+    
+    max = Min(max, IOTRACE_MAX);
+    
+    for(i=0; gTrace && (i<max) && (i<gSeq); i++)
+    {
+        MemCpy(&buf[ret++], &gTrace[(gSeq - 1 - i) % IOTRACE_MAX], sizeof(IOTrace));
+    }
+    
+    if( ret < max )
+    {
+        MemSet(&buf[ret], 0, (max - ret) * sizeof(IOTrace));
+    }
+    
+    return ret;
+}
+
+void IOTraceEnable(uint on)
+{
+    if( on && !gTrace && (gTrace = Malloc(IOTRACE_MAX * sizeof(IOTrace))) )
+    {
+        gSeq = 0;
+    }
+    else if( !on && gTrace )
+    {
+        Free(gTrace);
+        
+        gTrace = NULL;
+    }
+}
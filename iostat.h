@@ -0,0 +1,67 @@
+#ifndef IOSTAT_H
+#define IOSTAT_H
+
+#include "type.h"
+
+#define IOSTAT_DEV_MAX   8
+#define IOSTAT_NAME_LEN  8
+#define IOSTAT_BUCKETS   20
+#define IOTRACE_MAX      64
+
+enum
+{
+    IO_READ     = 0x00,
+    IO_ASYNC    = 0x01,
+    IO_WRITE    = 0x02,
+    IO_KIND_MAX = 0x04
+};
+
+typedef struct
+{
+    uint count;
+    uint errors;
+    uint sectors;
+    uint maxUs;
+    uint hist[IOSTAT_BUCKETS];
+} IOKindStat;
+
+typedef struct
+{
+    char name[IOSTAT_NAME_LEN];
+    IOKindStat kind[IO_KIND_MAX];
+    uint depth;
+    uint maxDepth;
+    uint waits;
+    uint timeouts;
+    uint maxWaitUs;
+    uint waitHist[IOSTAT_BUCKETS];
+} IOStat;
+
+typedef struct
+{
+    uint seq;
+    uint dev;
+    uint kind;
+    uint si;
+    uint n;
+    uint us;
+    uint ok;
+} IOTrace;
+
+typedef struct
+{
+    uint lo;
+    uint hi;
+} IOSpan;
+
+void IOStatModInit();
+uint IOStatAdd(const char* name);
+void IOStatMark(IOSpan* sp);
+void IOStatBegin(uint id, IOSpan* sp);
+void IOStatEnd(uint id, IOSpan* sp, uint si, uint n, uint kind, uint ok);
+void IOStatWait(uint id, IOSpan* sp, uint timeout);
+uint IOStatCopy(uint id, IOStat* st);
+uint IOTraceCopy(IOTrace* buf, uint max);
+void IOTraceEnable(uint on);
+
+#endif
@@ -3,15 +3,19 @@
 global _start
 global TimerHandlerEntry
 global KeyboardHandlerEntry
+global DiskHandlerEntry
 global SysCallHandlerEntry
 global PageFaultHandlerEntry
 global SegmentFaultHandlerEntry
 
 global ReadPort
 global WritePort
+global ReadPortW
+global WritePortW
 
 extern TimerHandler
 extern KeyboardHandler
+extern DiskHandler
 extern SysCallHandler
 extern PageFaultHandler
 extern SegmentFaultHandler
@@ -167,6 +171,58 @@ WritePort:
     ret
 
 
+;
+; void ReadPortW(ushort port, ushort* buf, uint n)
+;
+ReadPortW:
+    push ebp
+    mov  ebp, esp
+    
+    push edi
+    
+    mov dx,  [ebp + 8]
+    mov edi, [ebp + 12]
+    mov ecx, [ebp + 16]
+    
+    cld
+    rep insw
+    
+    nop
+    nop
+    nop
+    
+    pop edi
+    
+    leave
+    
+    ret
+
+;
+; void WritePortW(ushort port, ushort* buf, uint n)
+;
+WritePortW:
+    push ebp
+    mov  ebp, esp
+    
+    push esi
+    
+    mov dx,  [ebp + 8]
+    mov esi, [ebp + 12]
+    mov ecx, [ebp + 16]
+    
+    cld
+    rep outsw
+    
+    nop
+    nop
+    nop
+    
+    pop esi
+    
+    leave
+    
+    ret
+
 ;
 ;
 TimerHandlerEntry:
@@ -181,6 +237,13 @@ BeginISR
     call KeyboardHandler
 EndISR
 
+;
+;
+DiskHandlerEntry:
+BeginISR
+    call DiskHandler
+EndISR
+
 ;
 ;
 SysCallHandlerEntry:
@@ -49,5 +49,15 @@ void ConfigPageTable()
         
         *addr = value;
     }
+    
+    for(i=KernelHeapBase / PageSize; i<FMapBase / PageSize; i++)
+    {
+        if( (i < 0xA0) || (0x100 <= i) )
+        {
+            uint* addr = TblBase + i;
+            
+            *addr = *addr & 0xFFFFFFFB;
+        }
+    }
 }
 
@@ -4,10 +4,18 @@
 #include "memory.h"
 #include "mutex.h"
 #include "keyboard.h"
+#include "fs.h"
+#include "fmap.h"
+#include "fwatch.h"
+#include "ramdisk.h"
+#include "vblk.h"
+#include "ahci.h"
+#include "iostat.h"
 
 void KMain()
 {
     void (*AppModInit)() = (void*)BaseOfApp;
+    FSCheckInfo fsck = {0};
     
     PrintString("F.Y.OS\n");
     
@@ -29,10 +37,46 @@ void KMain()
     
     MemModInit((byte*)KernelHeapBase, HeapSize);
     
+    IOStatModInit();
+    
     KeyboardModInit();
     
     MutexModInit();
     
+    FSModInit();
+    
+    RamDiskModInit();
+    
+    VBlkModInit();
+    
+    AHCIModInit();
+    
+    if( VBlkDevice() )
+    {
+        FSMount(VBlkDevice());
+    }
+    else if( AHCIDevice() )
+    {
+        FSMount(AHCIDevice());
+    }
+    
+    FWatchModInit();
+    
+    if( !FSIsFormatted() )
+    {
+        FSFormat();
+    }
+    else if( !FSCheck(&fsck) )
+    {
+        PrintString("DTFS check skipped\n");
+    }
+    else if( fsck.errors )
+    {
+        PrintString("DTFS Errors: ");
+        PrintIntDec(fsck.errors);
+        PrintChar('\n');
+    }
+    
     AppModInit();
     
     TaskModInit();
@@ -41,6 +85,8 @@ void KMain()
     
     ConfigPageTable();
     
+    FMapModInit();
+    
     LaunchTask();
     
 }
@@ -92,7 +92,7 @@ BLMain:
     ; load app
     push word Buffer
     push word BaseOfApp / 0x10
-    push word BaseOfApp
+    push word BaseOfKernel   ; FAT buffer goes below BaseOfKernel, BaseOfApp is above 64K
     push word AppLen
     push word App
     
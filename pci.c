@@ -0,0 +1,88 @@
+
+#include "pci.h"
+
+#define PCI_ADDR_PORT  0xCF8
+#define PCI_DATA_PORT  0xCFC
+#define PCI_ENABLE     0x80000000
+
+uint ReadPortL(ushort port)
+{
+    uint ret = 0;
+    
+    asm volatile("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    
+    return ret;
+}
+
+void WritePortL(ushort port, uint value)
+{
+    asm volatile("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+ushort ReadPortS(ushort port)
+{
+    ushort ret = 0;
+    
+    asm volatile("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    
+    return ret;
+}
+
+void WritePortS(ushort port, ushort value)
+{
+    asm volatile("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+uint PCIRead(uint dev, uint reg)
+{
+    WritePortL(PCI_ADDR_PORT, dev | (reg & 0xFC));
+    
+    return ReadPortL(PCI_DATA_PORT);
+}
+
+void PCIWrite(uint dev, uint reg, uint value)
+{
+    WritePortL(PCI_ADDR_PORT, dev | (reg & 0xFC));
+    WritePortL(PCI_DATA_PORT, value);
+}
+
+static uint Scan(uint reg, uint mask, uint value)
+{
+    uint ret = 0;
+    uint bus = 0;
+    uint slot = 0;
+    uint func = 0;
+    
+    for(bus=0; !ret && (bus<256); bus++)
+    {
+        for(slot=0; !ret && (slot<32); slot++)
+        {
+            for(func=0; !ret && (func<8); func++)
+            {
+                uint dev = PCI_ENABLE | (bus << 16) | (slot << 11) | (func << 8);
+                uint id = PCIRead(dev, 0);
+                
+                if( (id & 0xFFFF) != 0xFFFF )
+                {
+                    ret = ((PCIRead(dev, reg) & mask) == value) ? dev : 0;
+                }
+                else if( !func )
+                {
+                    func = 8;
+                }
+            }
+        }
+    }
+    
+    return ret;
+}
+
+uint PCIFind(uint cls, uint sub)
+{
+    return Scan(PCI_CLASS, 0xFFFF0000, (cls << 24) | (sub << 16));
+}
+
+uint PCIFindId(uint vendor, uint device)
+{
+    return Scan(0, 0xFFFFFFFF, (device << 16) | vendor);
+}
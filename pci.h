@@ -0,0 +1,23 @@
+
+#ifndef PCI_H
+#define PCI_H
+
+#include "type.h"
+
+#define PCI_COMMAND   0x04
+#define PCI_CLASS     0x08
+#define PCI_BAR0      0x10
+#define PCI_BAR4      0x20
+#define PCI_BAR5      0x24
+#define PCI_IRQ_LINE  0x3C
+
+uint PCIFind(uint cls, uint sub);
+uint PCIFindId(uint vendor, uint device);
+uint PCIRead(uint dev, uint reg);
+void PCIWrite(uint dev, uint reg, uint value);
+uint ReadPortL(ushort port);
+void WritePortL(ushort port, uint value);
+ushort ReadPortS(ushort port);
+void WritePortS(ushort port, ushort value);
+
+#endif
@@ -0,0 +1,59 @@
+#include "ramdisk.h"
+#include "kernel.h"
+#include "utility.h"
+
+extern uint gMemSize;
+
+static byte* gBase = NULL;
+static uint gSectors = 0;
+
+static uint RamSectors(const BlkDev* dev)
+{
+    return gSectors;
+}
+
+static uint RamRead(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        MemCpy(buf, AddrOff(gBase, si * SECT_SIZE), n * SECT_SIZE);
+        
+        ret = n;
+    }
+    
+    return ret;
+}
+
+static uint RamWrite(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        MemCpy(AddrOff(gBase, si * SECT_SIZE), buf, n * SECT_SIZE);
+        
+        ret = n;
+    }
+    
+    return ret;
+}
+
+static const BlkDev gRamDisk = {"ram", NULL, RamSectors, RamRead, RamWrite, NULL, NULL, NULL, NULL};
+
+void RamDiskModInit()
+{
+    uint base = FMapBase + FMapSize;
+    
+    if( gMemSize > base )
+    {
+        gBase = (byte*)base;
+        gSectors = (gMemSize - base) / SECT_SIZE;
+    }
+}
+
+const BlkDev* RamDiskDevice()
+{
+    return gSectors ? &gRamDisk : NULL;
+}
@@ -0,0 +1,9 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "blkdev.h"
+
+void RamDiskModInit();
+const BlkDev* RamDiskDevice();
+
+#endif
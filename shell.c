@@ -5,15 +5,25 @@
 #include "list.h"
 #include "demo1.h"
 #include "demo2.h"
+#include "app.h"
 
 #define BUFF_SIZE     64
 #define PROMPT        "F.Y.OS >> "
 #define KEY_ENTER     0x0D
 #define KEY_BACKSPACE 0x08
+#define TRACE_LINES   12
 
 static char gKBuf[BUFF_SIZE] = {0};
 static int gKIndex = 0;
 static List gCmdList = {0};
+static IOStat gIOStat = {0};
+static IOTrace gIOTrace[TRACE_LINES] = {0};
+static uint gIOStatNext = 0;
+static uint gTraceOn = 0;
+static uint gDedupSaved = 0;
+static uint gDedupRuns = 0;
+
+static const char* const gIOKind[IO_KIND_MAX] = {"rd sync ", "rd async", "wr sync ", "wr async"};
 
 typedef struct
 {
@@ -37,19 +47,29 @@ static byte GetKeyCode(uint kc)
     return (byte)(kc >> 8);
 }
 
-static void Mem()
+static void ClearLines(uint n)
 {
-    uint ms = GetMemSize() >> 20;
+    int h = 0;
     int w = 0;
     
-    SetPrintPos(CMD_START_W, CMD_START_H + 1);
-    
-    for(w=CMD_START_W; w<SCREEN_WIDTH; w++)
+    for(h=CMD_START_H + 1; (h<=CMD_START_H + n) && (h<SCREEN_HEIGHT); h++)
     {
-        PrintChar(' ');
+        SetPrintPos(CMD_START_W, h);
+        
+        for(w=CMD_START_W; w<SCREEN_WIDTH; w++)
+        {
+            PrintChar(' ');
+        }
     }
     
     SetPrintPos(CMD_START_W, CMD_START_H + 1);
+}
+
+static void Mem()
+{
+    uint ms = GetMemSize() >> 20;
+    
+    ClearLines(1);
     PrintString("Physical Memory: ");
     PrintIntDec(ms);
     PrintString(" MB\n");
@@ -113,16 +133,7 @@ static int DoCmd(const char* cmd)
 
 static void Unknown(const char* s)
 {
-    int w = 0;
-    
-    SetPrintPos(CMD_START_W, CMD_START_H + 1);
-    
-    for(w=CMD_START_W; w<SCREEN_WIDTH; w++)
-    {
-        PrintChar(' ');
-    }
-    
-    SetPrintPos(CMD_START_W, CMD_START_H + 1);
+    ClearLines(1);
     PrintString("Unknown Command: ");
     PrintString(s);
 }
@@ -201,6 +212,223 @@ static void Handle(char ch, byte vk)
     }
 }
 
+static void DefragTask()
+{
+    while( FDefrag() );
+}
+
+static void Defrag()
+{
+    ClearLines(1);
+    
+    RegBackgroundApp("Defrag", DefragTask);
+    
+    PrintString("Defrag: running in background\n");
+}
+
+static void DedupTask()
+{
+    uint saved = 0;
+    
+    while( FDedup(&saved) );
+    
+    gDedupSaved = saved;
+    gDedupRuns++;
+}
+
+static void Mount(uint dev, const char* name)
+{
+    ClearLines(1);
+    
+    PrintString(name);
+    PrintString(FMount(dev) ? ": mounted\n" : ": mount failed\n");
+}
+
+static void RamFs()
+{
+    Mount(FS_DEV_RAM, "RAM disk");
+}
+
+static void HdFs()
+{
+    Mount(FS_DEV_HD, "Hard disk");
+}
+
+static void VdFs()
+{
+    Mount(FS_DEV_VIRTIO, "Virtio disk");
+}
+
+static void SdFs()
+{
+    Mount(FS_DEV_AHCI, "SATA disk");
+}
+
+static void RaidFs()
+{
+    Mount(FS_DEV_STRIPE, "Striped disks");
+}
+
+static void PrintHist(const uint* hist)
+{
+    uint i = 0;
+    
+    PrintString("    ");
+    
+    for(i=0; i<IOSTAT_BUCKETS; i++)
+    {
+        if( hist[i] && (GetPrintPosW() < SCREEN_WIDTH - 14) )
+        {
+            uint us = i ? (1 << (i - 1)) : 0;
+            
+            PrintIntDec((us < 1024) ? us : (us >> 10));
+            PrintString((us < 1024) ? "us:" : "ms:");
+            PrintIntDec(hist[i]);
+            PrintChar(' ');
+        }
+    }
+    
+    PrintChar('\n');
+}
+
+static void IOStatShow()
+{
+    uint found = 0;
+    uint i = 0;
+    
+    ClearLines(SCREEN_HEIGHT - CMD_START_H - 1);
+    
+    for(i=0; !found && (i<IOSTAT_DEV_MAX); i++)
+    {
+        found = GetIOStat(gIOStatNext, &gIOStat);
+        
+        gIOStatNext = (gIOStatNext + 1) % IOSTAT_DEV_MAX;
+    }
+    
+    if( found )
+    {
+        PrintString(gIOStat.name);
+        PrintString(": depth ");
+        PrintIntDec(gIOStat.depth);
+        PrintString("/");
+        PrintIntDec(gIOStat.maxDepth);
+        PrintString(", waits ");
+        PrintIntDec(gIOStat.waits);
+        PrintString(" max ");
+        PrintIntDec(gIOStat.maxWaitUs);
+        PrintString("us, timeouts ");
+        PrintIntDec(gIOStat.timeouts);
+        PrintChar('\n');
+        
+        for(i=0; i<IO_KIND_MAX; i++)
+        {
+            IOKindStat* ks = &gIOStat.kind[i];
+            
+            if( ks->count )
+            {
+                PrintString(gIOKind[i]);
+                PrintString(": ");
+                PrintIntDec(ks->count);
+                PrintString(" reqs, ");
+                PrintIntDec(ks->errors);
+                PrintString(" errs, ");
+                PrintIntDec(ks->sectors >> 1);
+                PrintString(" KB, max ");
+                PrintIntDec(ks->maxUs);
+                PrintString("us\n");
+                
+                PrintHist(ks->hist);
+            }
+        }
+        
+        if( gIOStat.waits )
+        {
+            PrintString("busy wait:\n");
+            
+            PrintHist(gIOStat.waitHist);
+        }
+    }
+    else
+    {
+        PrintString("I/O stats: no disks\n");
+    }
+}
+
+static void IOTraceShow()
+{
+    uint n = 0;
+    uint i = 0;
+    
+    ClearLines(TRACE_LINES + 1);
+    
+    if( gTraceOn )
+    {
+        n = GetIOTrace(gIOTrace, TRACE_LINES);
+        
+        for(i=0; i<n; i++)
+        {
+            IOTrace* t = &gIOTrace[i];
+            
+            GetIOStat(t->dev, &gIOStat);
+            
+            PrintIntDec(t->seq);
+            PrintChar(' ');
+            PrintString(gIOStat.name);
+            PrintChar(' ');
+            PrintString(gIOKind[t->kind % IO_KIND_MAX]);
+            PrintString(" si ");
+            PrintIntDec(t->si);
+            PrintString(" n ");
+            PrintIntDec(t->n);
+            PrintChar(' ');
+            PrintIntDec(t->us);
+            PrintString(t->ok ? "us\n" : "us FAILED\n");
+        }
+        
+        if( !n )
+        {
+            PrintString("I/O trace: empty\n");
+        }
+    }
+    else
+    {
+        SetIOTrace(1);
+        
+        gTraceOn = 1;
+        
+        PrintString("I/O trace: on\n");
+    }
+}
+
+static void IOTraceOff()
+{
+    ClearLines(1);
+    
+    SetIOTrace(0);
+    
+    gTraceOn = 0;
+    
+    PrintString("I/O trace: off\n");
+}
+
+static void Dedup()
+{
+    ClearLines(1);
+    
+    RegBackgroundApp("Dedup", DedupTask);
+    
+    PrintString("Dedup: running in background");
+    
+    if( gDedupRuns )
+    {
+        PrintString(", last run reclaimed ");
+        PrintIntDec(gDedupSaved);
+        PrintString(" sectors");
+    }
+    
+    PrintChar('\n');
+}
+
 static void DoWait()
 {
     Delay(5);
@@ -228,6 +456,16 @@ void Shell()
     AddCmdEntry("clear", Clear);
     AddCmdEntry("demo1", Demo1);
     AddCmdEntry("demo2", Demo2);
+    AddCmdEntry("defrag", Defrag);
+    AddCmdEntry("dedup", Dedup);
+    AddCmdEntry("ramfs", RamFs);
+    AddCmdEntry("hdfs", HdFs);
+    AddCmdEntry("vdfs", VdFs);
+    AddCmdEntry("sdfs", SdFs);
+    AddCmdEntry("raidfs", RaidFs);
+    AddCmdEntry("iostat", IOStatShow);
+    AddCmdEntry("iotrace", IOTraceShow);
+    AddCmdEntry("iotraceoff", IOTraceOff);
     
     SetPrintPos(CMD_START_W, CMD_START_H);
     PrintString(PROMPT);
@@ -0,0 +1,274 @@
+#include "stripe.h"
+#include "utility.h"
+#include "task.h"
+
+#define STRIPE_BATCH_MAX  8
+
+typedef struct
+{
+    Queue wait;
+    uint value;
+    uint left;
+    uint failed;
+    uint state;
+} StripeBatch;
+
+typedef struct
+{
+    const BlkDev* member[STRIPE_MEMBER_MAX];
+    uint count;
+    uint chunk;
+    uint sectors;
+    uint pending;
+} Stripe;
+
+static Stripe gStripe = {0};
+static StripeBatch gBatch[STRIPE_BATCH_MAX] = {0};
+static uint gReady = 0;
+
+static uint Map(Stripe* s, uint si, uint* member)
+{
+    uint unit = si / s->chunk;
+    
+    *member = unit % s->count;
+    
+    return (unit / s->count) * s->chunk + si % s->chunk;
+}
+
+static uint Piece(Stripe* s, uint si, uint n)
+{
+    return Min(n, s->chunk - si % s->chunk);
+}
+
+static uint Valid(Stripe* s, uint si, byte* buf, uint n)
+{
+    return n && (si < s->sectors) && (n <= s->sectors - si) && buf;
+}
+
+static uint Transfer(Stripe* s, uint si, byte* buf, uint n, uint write)
+{
+    uint ret = 0;
+    uint ok = Valid(s, si, buf, n);
+    uint k = 0;
+    
+    for(ret=0; ok && (ret<n); ret+=k)
+    {
+        uint m = 0;
+        uint psi = Map(s, si + ret, &m);
+        const BlkDev* dev = s->member[m];
+        byte* p = AddrOff(buf, ret * SECT_SIZE);
+        
+        k = Piece(s, si + ret, n - ret);
+        k = write ? dev->write(dev, psi, p, k) : dev->read(dev, psi, p, k);
+        
+        ok = !!k;
+    }
+    
+    return ok ? n : 0;
+}
+
+static uint StripeSectors(const BlkDev* dev)
+{
+    return ((Stripe*)dev->data)->sectors;
+}
+
+static uint StripeRead(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    return Transfer(dev->data, si, buf, n, 0);
+}
+
+static uint StripeWrite(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    return Transfer(dev->data, si, buf, n, 1);
+}
+
+static uint StripeFlush(const BlkDev* dev)
+{
+    Stripe* s = dev->data;
+    uint ret = 1;
+    uint i = 0;
+    
+    for(i=0; i<s->count; i++)
+    {
+        const BlkDev* m = s->member[i];
+        
+        ret = (!m->flush || m->flush(m)) && ret;
+    }
+    
+    return ret;
+}
+
+static uint StripeQueue(const BlkDev* dev, uint si, byte* buf, uint n, uint write)
+{
+    Stripe* s = dev->data;
+    uint ret = 0;
+    uint ok = Valid(s, si, buf, n);
+    uint k = 0;
+    
+    for(ret=0; ok && (ret<n); ret+=k)
+    {
+        uint m = 0;
+        uint psi = Map(s, si + ret, &m);
+        const BlkDev* mem = s->member[m];
+        byte* p = AddrOff(buf, ret * SECT_SIZE);
+        uint q = 0;
+        
+        k = Piece(s, si + ret, n - ret);
+        
+        if( mem->queue && mem->start && (q = mem->queue(mem, psi, p, k, write)) )
+        {
+            s->pending |= 1 << m;
+            
+            k = q;
+        }
+        else
+        {
+            k = write ? mem->write(mem, psi, p, k) : mem->read(mem, psi, p, k);
+            
+            ok = !!k;
+        }
+    }
+    
+    return ok ? n : 0;
+}
+
+static void Done(void* arg, uint ok)
+{
+    StripeBatch* b = arg;
+    
+    b->failed = b->failed || !ok;
+    b->left--;
+    
+    if( !b->left && (b->state == 2) )
+    {
+        Event evt = {DiskEvent, (uint)&b->wait, b->failed ? -1 : b->value, 0};
+        
+        b->state = 0;
+        
+        EventSchedule(NOTIFY, &evt);
+    }
+}
+
+static StripeBatch* NewBatch()
+{
+    StripeBatch* ret = NULL;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<STRIPE_BATCH_MAX); i++)
+    {
+        ret = gBatch[i].state ? NULL : &gBatch[i];
+    }
+    
+    if( ret )
+    {
+        ret->state = 1;
+        ret->left = 1;
+        ret->failed = 0;
+    }
+    
+    return ret;
+}
+
+static uint StripeSubmit(const BlkDev* dev, uint* result, uint value)
+{
+    Stripe* s = dev->data;
+    StripeBatch* b = s->pending ? NewBatch() : NULL;
+    Event* evt = (b && result) ? CreateEvent(DiskEvent, (uint)&b->wait, (uint)result, 0) : NULL;
+    uint ret = 0;
+    uint i = 0;
+    
+    for(i=0; i<s->count; i++)
+    {
+        const BlkDev* m = s->member[i];
+        
+        if( s->pending & (1 << i) )
+        {
+            if( evt )
+            {
+                b->left++;
+                
+                m->start(m, Done, b);
+            }
+            else
+            {
+                m->submit(m, NULL, 0);
+            }
+        }
+    }
+    
+    s->pending = 0;
+    
+    if( evt )
+    {
+        b->value = value;
+        
+        if( --b->left )
+        {
+            b->state = 2;
+            
+            EventSchedule(WAIT, evt);
+            
+            ret = 1;
+        }
+        else
+        {
+            *result = b->failed ? -1 : *result;
+            
+            DestroyEvent(evt);
+        }
+    }
+    
+    if( b && !ret )
+    {
+        b->state = 0;
+    }
+    
+    return ret;
+}
+
+static const BlkDev gStripeDev = {"md", &gStripe, StripeSectors, StripeRead, StripeWrite, StripeFlush, StripeQueue, StripeSubmit, NULL};
+
+const BlkDev* StripeCreate(const BlkDev** member, uint count, uint chunk)
+{
+    const BlkDev* ret = NULL;
+    uint min = -1;
+    uint i = 0;
+    
+    if( !gReady )
+    {
+        for(i=0; i<STRIPE_BATCH_MAX; i++)
+        {
+            Queue_Init(&gBatch[i].wait);
+        }
+        
+        gReady = 1;
+    }
+    
+    chunk = chunk ? Min(chunk, STRIPE_CHUNK_MAX) : STRIPE_CHUNK;
+    
+    for(i=0; (count>=2) && (i<count) && (i<STRIPE_MEMBER_MAX); i++)
+    {
+        min = Min(min, member[i]->sectors(member[i]));
+    }
+    
+    if( (count >= 2) && (count <= STRIPE_MEMBER_MAX) && (min >= chunk) && !gStripe.pending )
+    {
+        for(i=0; i<count; i++)
+        {
+            gStripe.member[i] = member[i];
+        }
+        
+        gStripe.count = count;
+        gStripe.chunk = chunk;
+        gStripe.sectors = Min(min / chunk, 0xFFFFFFFE / (chunk * count)) * chunk * count;
+        
+        ret = &gStripeDev;
+    }
+    
+    return ret;
+}
+
+const BlkDev* StripeDevice()
+{
+    return gStripe.count ? &gStripeDev : NULL;
+}
@@ -0,0 +1,13 @@
+#ifndef STRIPE_H
+#define STRIPE_H
+
+#include "blkdev.h"
+
+#define STRIPE_MEMBER_MAX  4
+#define STRIPE_CHUNK       128
+#define STRIPE_CHUNK_MAX   65536
+
+const BlkDev* StripeCreate(const BlkDev** member, uint count, uint chunk);
+const BlkDev* StripeDevice();
+
+#endif
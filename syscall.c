@@ -41,6 +41,20 @@ void RegApp(const char* name, void(*tmain)(), byte pri)
     }
 }
 
+void RegBackgroundApp(const char* name, void(*tmain)())
+{
+    if( name && tmain )
+    {
+        AppInfo info = {0};
+        
+        info.name = name;
+        info.tmain = tmain;
+        info.background = 1;
+        
+        SysCall(0, 2, &info, 0);
+    }
+}
+
 
 uint CreateMutex(uint type)
 {
@@ -94,3 +108,311 @@ uint GetMemSize()
     return ret;
 }
 
+uint GetIOStat(uint dev, IOStat* st)
+{
+    uint ret = 0;
+    
+    if( st )
+    {
+        SysCall(3, 1, st, dev);
+        
+        ret = !!st->name[0];
+    }
+    
+    return ret;
+}
+
+uint GetIOTrace(IOTrace* buf, uint max)
+{
+    uint ret = 0;
+    
+    if( buf )
+    {
+        SysCall(3, 2, buf, max);
+        
+        while( (ret < max) && (ret < IOTRACE_MAX) && buf[ret].seq )
+        {
+            ret++;
+        }
+    }
+    
+    return ret;
+}
+
+void SetIOTrace(uint on)
+{
+    SysCall(3, 3, on, 0);
+}
+
+uint FOpen(const char* fn)
+{
+    volatile FileParam param = {0};
+    
+    param.name = fn;
+    
+    SysCall(4, 0, &param, 0);
+    
+    return param.ret;
+}
+
+void FClose(uint fd)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    
+    SysCall(4, 1, &param, 0);
+}
+
+uint FRead(uint fd, byte* buf, uint len)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    param.buf = buf;
+    param.len = len;
+    
+    SysCall(4, 2, &param, 0);
+    
+    return param.ret;
+}
+
+uint FWrite(uint fd, byte* buf, uint len)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    param.buf = buf;
+    param.len = len;
+    
+    SysCall(4, 3, &param, 0);
+    
+    return param.ret;
+}
+
+uint FSeek(uint fd, uint pos)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    param.pos = pos;
+    
+    SysCall(4, 4, &param, 0);
+    
+    return param.ret;
+}
+
+uint FTell(uint fd)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    
+    SysCall(4, 5, &param, 0);
+    
+    return param.ret;
+}
+
+uint FLength(uint fd)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    
+    SysCall(4, 6, &param, 0);
+    
+    return param.ret;
+}
+
+uint FErase(uint fd, uint bytes)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    param.len = bytes;
+    
+    SysCall(4, 7, &param, 0);
+    
+    return param.ret;
+}
+
+uint FFlush(uint fd)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    
+    SysCall(4, 8, &param, 0);
+    
+    return param.ret;
+}
+
+uint FAdvise(uint fd, uint offset, uint len, uint hint)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    param.pos = offset;
+    param.len = len;
+    
+    SysCall(4, 17, &param, hint);
+    
+    return param.ret;
+}
+
+uint FCreate(const char* fn)
+{
+    volatile FileParam param = {0};
+    
+    param.name = fn;
+    
+    SysCall(4, 9, &param, 0);
+    
+    return param.ret;
+}
+
+uint FCreateRing(const char* fn, uint sctNum)
+{
+    volatile FileParam param = {0};
+    
+    param.name = fn;
+    param.len = sctNum;
+    
+    SysCall(4, 18, &param, 0);
+    
+    return param.ret;
+}
+
+uint FExisted(const char* fn)
+{
+    volatile FileParam param = {0};
+    
+    param.name = fn;
+    
+    SysCall(4, 10, &param, 0);
+    
+    return param.ret;
+}
+
+uint FDelete(const char* fn)
+{
+    volatile FileParam param = {0};
+    
+    param.name = fn;
+    
+    SysCall(4, 11, &param, 0);
+    
+    return param.ret;
+}
+
+uint FRename(const char* ofn, const char* nfn)
+{
+    volatile FileParam param = {0};
+    
+    param.name = ofn;
+    param.other = nfn;
+    
+    SysCall(4, 12, &param, 0);
+    
+    return param.ret;
+}
+
+void* FMap(uint fd, uint offset, uint length)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = fd;
+    param.pos = offset;
+    param.len = length;
+    
+    SysCall(4, 13, &param, 0);
+    
+    return (void*)param.ret;
+}
+
+uint FUnmap(void* addr)
+{
+    volatile FileParam param = {0};
+    
+    param.buf = addr;
+    
+    SysCall(4, 14, &param, 0);
+    
+    return param.ret;
+}
+
+uint FWatch(const char* fn, uint mask)
+{
+    volatile FileParam param = {0};
+    
+    param.name = fn;
+    param.len = mask;
+    
+    SysCall(4, 19, &param, 0);
+    
+    return param.ret;
+}
+
+uint FWatchWait(uint wd)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = wd;
+    
+    SysCall(4, 20, &param, 0);
+    
+    return param.ret;
+}
+
+void FUnwatch(uint wd)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = wd;
+    
+    SysCall(4, 21, &param, 0);
+}
+
+uint FMount(uint dev)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = dev;
+    
+    SysCall(4, 22, &param, 0);
+    
+    return param.ret;
+}
+
+uint FMountStripe(uint chunk)
+{
+    volatile FileParam param = {0};
+    
+    param.fd = FS_DEV_STRIPE;
+    param.len = chunk;
+    
+    SysCall(4, 22, &param, 0);
+    
+    return param.ret;
+}
+
+uint FDefrag()
+{
+    volatile FileParam param = {0};
+    
+    SysCall(4, 15, &param, 0);
+    
+    return param.ret;
+}
+
+uint FDedup(uint* saved)
+{
+    volatile FileParam param = {0};
+    
+    SysCall(4, 16, &param, 0);
+    
+    *saved += param.len;
+    
+    return param.ret;
+}
+
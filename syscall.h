@@ -2,6 +2,8 @@
 #define SYSCALL_H
 
 #include "type.h"
+#include "iostat.h"
+#include "app.h"
 
 enum
 {
@@ -12,6 +14,7 @@ enum
 void Exit();
 void Wait(const char* name);
 void RegApp(const char* name, void(*tmain)(), byte pri);
+void RegBackgroundApp(const char* name, void(*tmain)());
 
 uint CreateMutex(uint type);
 void EnterCritical(uint mutex);
@@ -20,5 +23,38 @@ uint DestroyMutex(uint mutex);
 
 uint ReadKey();
 uint GetMemSize();
+uint GetIOStat(uint dev, IOStat* st);
+uint GetIOTrace(IOTrace* buf, uint max);
+void SetIOTrace(uint on);
+
+uint FCreate(const char* fn);
+uint FCreateRing(const char* fn, uint sctNum);
+uint FExisted(const char* fn);
+uint FDelete(const char* fn);
+uint FRename(const char* ofn, const char* nfn);
+
+uint FOpen(const char* fn);
+uint FWrite(uint fd, byte* buf, uint len);
+uint FRead(uint fd, byte* buf, uint len);
+void FClose(uint fd);
+uint FErase(uint fd, uint bytes);
+uint FSeek(uint fd, uint pos);
+uint FLength(uint fd);
+uint FTell(uint fd);
+uint FFlush(uint fd);
+uint FAdvise(uint fd, uint offset, uint len, uint hint);
+
+void* FMap(uint fd, uint offset, uint length);
+uint FUnmap(void* addr);
+
+uint FWatch(const char* fn, uint mask);
+uint FWatchWait(uint wd);
+void FUnwatch(uint wd);
+
+uint FMount(uint dev);
+uint FMountStripe(uint chunk);
+
+uint FDefrag();
+uint FDedup(uint* saved);
 
 #endif
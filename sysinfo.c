@@ -1,5 +1,6 @@
 
 #include "sysinfo.h"
+#include "iostat.h"
 
 uint gMemSize = 0;
 
@@ -11,4 +12,16 @@ void SysInfoCallHandler(uint cmd, uint param1, uint param2)
         
         *pRet = gMemSize;
     }
+    else if( cmd == 1 )
+    {
+        IOStatCopy(param2, (IOStat*)param1);
+    }
+    else if( cmd == 2 )
+    {
+        IOTraceCopy((IOTrace*)param1, param2);
+    }
+    else if( cmd == 3 )
+    {
+        IOTraceEnable(param1);
+    }
 }
@@ -3,6 +3,7 @@
 #include "mutex.h"
 #include "queue.h"
 #include "app.h"
+#include "fwatch.h"
 
 #define MAX_TASK_NUM        16
 #define MAX_RUNNING_TASK    8
@@ -11,6 +12,8 @@
 #define PID_BASE            0x10
 #define MAX_TIME_SLICE      260
 
+#define IsBackground(t)     ((t)->background)
+
 void (* const RunTask)(volatile Task* pt) = NULL;
 void (* const LoadTask)(volatile Task* pt) = NULL;
 
@@ -21,6 +24,7 @@ static Queue gAppToRun = {0};
 static Queue gFreeTaskNode = {0};
 static Queue gReadyTask = {0};
 static Queue gRunningTask = {0};
+static Queue gBackgroundTask = {0};
 static TSS gTSS = {0};
 static TaskNode* gIdleTask = NULL;
 static uint gPid = PID_BASE;
@@ -44,7 +48,7 @@ static void IdleTask()
     while(1);
 }
 
-static void InitTask(Task* pt, uint id, const char* name, void(*entry)(), ushort pri)
+static void InitTask(Task* pt, uint id, const char* name, void(*entry)(), ushort pri, byte bg)
 {
     pt->rv.cs = LDT_CODE32_SELECTOR;
     pt->rv.gs = LDT_VIDEO_SELECTOR;
@@ -62,6 +66,7 @@ static void InitTask(Task* pt, uint id, const char* name, void(*entry)(), ushort
     pt->current = 0;
     pt->total = MAX_TIME_SLICE - pri;
     pt->event = NULL;
+    pt->background = bg;
     
     if( name )
     {
@@ -76,7 +81,7 @@ static void InitTask(Task* pt, uint id, const char* name, void(*entry)(), ushort
     
     SetDescValue(AddrOff(pt->ldt, LDT_VIDEO_INDEX),  0xB8000, 0x07FFF, DA_DRWA + DA_32 + DA_DPL3);
     SetDescValue(AddrOff(pt->ldt, LDT_CODE32_INDEX), 0x00,    KernelHeapBase - 1, DA_C + DA_32 + DA_DPL3);
-    SetDescValue(AddrOff(pt->ldt, LDT_DATA32_INDEX), 0x00,    KernelHeapBase - 1, DA_DRW + DA_32 + DA_DPL3);
+    SetDescValue(AddrOff(pt->ldt, LDT_DATA32_INDEX), 0x00,    (FMapBase + FMapSize) / PageSize - 1, DA_DRW + DA_32 + DA_LIMIT_4K + DA_DPL3);
     
     pt->ldtSelector = GDT_TASK_LDT_SELECTOR;
     pt->tssSelector = GDT_TASK_TSS_SELECTOR;
@@ -126,9 +131,9 @@ static void CreateTask()
         {
             AppNode* an = (AppNode*)Queue_Remove(&gAppToRun); 
             
-            InitTask(&tn->task, gPid++, an->app.name, an->app.tmain, an->app.priority);
+            InitTask(&tn->task, gPid++, an->app.name, an->app.tmain, an->app.priority, an->app.background);
             
-            Queue_Add(&gReadyTask, (QueueNode*)tn);
+            Queue_Add(IsBackground(&tn->task) ? &gBackgroundTask : &gReadyTask, (QueueNode*)tn);
             
             Free((void*)an->app.name);
             Free(an);
@@ -144,13 +149,27 @@ static void CheckRunningTask()
 {
     if( Queue_Length(&gRunningTask) == 0 )
     {
-        Queue_Add(&gRunningTask, (QueueNode*)gIdleTask);
+        TaskNode* tn = (TaskNode*)Queue_Remove(&gBackgroundTask);
+        
+        if( tn )
+        {
+            tn->task.current = 0;
+        }
+        
+        Queue_Add(&gRunningTask, tn ? (QueueNode*)tn : (QueueNode*)gIdleTask);
     }
     else if( Queue_Length(&gRunningTask) > 1 )
     {
-        if( IsEqual(Queue_Front(&gRunningTask), (QueueNode*)gIdleTask) )
+        TaskNode* tn = (TaskNode*)Queue_Front(&gRunningTask);
+        
+        if( IsEqual(tn, (QueueNode*)gIdleTask) )
+        {
+            Queue_Remove(&gRunningTask);
+        }
+        else if( IsBackground(&tn->task) )
         {
             Queue_Remove(&gRunningTask);
+            Queue_Add(&gBackgroundTask, (QueueNode*)tn);
         }
     }
 }
@@ -185,7 +204,7 @@ static void RunningToReady()
             if( tn->task.current == tn->task.total )
             {
                 Queue_Remove(&gRunningTask);
-                Queue_Add(&gReadyTask, (QueueNode*)tn);
+                Queue_Add(IsBackground(&tn->task) ? &gBackgroundTask : &gReadyTask, (QueueNode*)tn);
             }
         }
     }
@@ -217,11 +236,11 @@ static void WaittingToReady(Queue* wq)
         tn->task.event = NULL;
         
         Queue_Remove(wq);
-        Queue_Add(&gReadyTask, (QueueNode*)tn);
+        Queue_Add(IsBackground(&tn->task) ? &gBackgroundTask : &gReadyTask, (QueueNode*)tn);
     }
 }
 
-static void AppInfoToRun(const char* name, void(*tmain)(), byte pri)
+static void AppInfoToRun(const char* name, void(*tmain)(), byte pri, byte bg)
 {
     AppNode* an = (AppNode*)Malloc(sizeof(AppNode));
     
@@ -232,6 +251,7 @@ static void AppInfoToRun(const char* name, void(*tmain)(), byte pri)
         an->app.name = s ? StrCpy(s, name, -1) : NULL;
         an->app.tmain = tmain;
         an->app.priority = pri;
+        an->app.background = bg;
         
         Queue_Add(&gAppToRun, (QueueNode*)an);
     }
@@ -239,7 +259,7 @@ static void AppInfoToRun(const char* name, void(*tmain)(), byte pri)
 
 static void AppMainToRun()
 {
-    AppInfoToRun("AppMain", (void*)(*((uint*)AppMainEntry)), 200);
+    AppInfoToRun("AppMain", (void*)(*((uint*)AppMainEntry)), 200, 0);
 }
 
 void TaskModInit()
@@ -260,6 +280,7 @@ void TaskModInit()
     Queue_Init(&gFreeTaskNode);
     Queue_Init(&gRunningTask);
     Queue_Init(&gReadyTask);
+    Queue_Init(&gBackgroundTask);
     
     for(i=0; i<MAX_TASK_NUM; i++)
     {
@@ -268,7 +289,7 @@ void TaskModInit()
     
     SetDescValue(AddrOff(gGdtInfo.entry, GDT_TASK_TSS_INDEX), (uint)&gTSS, sizeof(gTSS)-1, DA_386TSS + DA_DPL0);
     
-    InitTask(&gIdleTask->task, 0, "IdleTask", IdleTask, 255);
+    InitTask(&gIdleTask->task, 0, "IdleTask", IdleTask, 255, 0);
     
     AppMainToRun();
     
@@ -376,6 +397,8 @@ void EventSchedule(uint action, Event* event)
     switch(event->type)
     {
         case KeyEvent:
+        case FileEvent:
+        case DiskEvent:
             KeySchedule(action, event);
             break;
         case TaskEvent:
@@ -397,6 +420,8 @@ void KillTask()
     
     EventSchedule(NOTIFY, &evt);
     
+    FWatchRelease(task->id);
+    
     task->id = 0;
     
     Queue_Add(&gFreeTaskNode, node);
@@ -430,7 +455,7 @@ void TaskCallHandler(uint cmd, uint param1, uint param2)
             WaitTask((char*)param1);
             break;
         case 2:
-            AppInfoToRun(((AppInfo*)param1)->name, ((AppInfo*)param1)->tmain, ((AppInfo*)param1)->priority);
+            AppInfoToRun(((AppInfo*)param1)->name, ((AppInfo*)param1)->tmain, ((AppInfo*)param1)->priority, ((AppInfo*)param1)->background);
             break;
         default:
             break;
@@ -53,6 +53,7 @@ typedef struct
     Queue      wait;
     byte*      stack;
     Event*     event;
+    byte       background;
 } Task;
 
 typedef struct
@@ -75,5 +75,29 @@ int StrCmp(const char* left, const char* right, uint n)
     return ret;
 }
 
+void* MemCpy(void* dst, const void* src, uint n)
+{
+    byte* d = (byte*)dst;
+    const byte* s = (const byte*)src;
+    uint i = 0;
+    
+    for(i=0; i<n; i++)
+    {
+        d[i] = s[i];
+    }
+    
+    return dst;
+}
 
-
+void* MemSet(void* dst, byte v, uint n)
+{
+    byte* d = (byte*)dst;
+    uint i = 0;
+    
+    for(i=0; i<n; i++)
+    {
+        d[i] = v;
+    }
+    
+    return dst;
+}
@@ -31,4 +31,6 @@ void Delay(int n);
 char* StrCpy(char* dst, const char* src, uint n);
 int StrLen(const char* s);
 int StrCmp(const char* left, const char* right, uint n);
+void* MemCpy(void* dst, const void* src, uint n);
+void* MemSet(void* dst, byte v, uint n);
 #endif
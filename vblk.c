@@ -0,0 +1,692 @@
+#include "vblk.h"
+#include "pci.h"
+#include "memory.h"
+#include "utility.h"
+#include "task.h"
+#include "interrupt.h"
+#include "iostat.h"
+
+#define VIRTIO_VENDOR       0x1AF4
+#define VIRTIO_BLK_LEGACY   0x1001
+
+#define VIO_DEV_FEATURES    0x00
+#define VIO_GUEST_FEATURES  0x04
+#define VIO_QUEUE_PFN       0x08
+#define VIO_QUEUE_SIZE      0x0C
+#define VIO_QUEUE_SEL       0x0E
+#define VIO_QUEUE_NOTIFY    0x10
+#define VIO_STATUS          0x12
+#define VIO_ISR             0x13
+#define VIO_BLK_CAPACITY    0x14
+
+#define VIO_ACK             0x01
+#define VIO_DRIVER          0x02
+#define VIO_DRIVER_OK       0x04
+
+#define VBLK_F_FLUSH        (1 << 9)
+
+#define VBLK_T_IN           0
+#define VBLK_T_OUT          1
+#define VBLK_T_FLUSH        4
+
+#define VRING_F_NEXT        1
+#define VRING_F_WRITE       2
+#define VRING_ALIGN         4096
+
+#define VB_DESC_MAX         64
+#define VB_BATCH_MAX        8
+#define VB_SEG_MAX          8
+#define VB_SPIN_MAX         1000000
+#define VB_NONE             0xFFFF
+
+extern byte ReadPort(ushort port);
+extern void WritePort(ushort port, byte value);
+
+typedef struct
+{
+    uint addr;
+    uint addrHi;
+    uint len;
+    ushort flags;
+    ushort next;
+} VRingDesc;
+
+typedef struct
+{
+    uint id;
+    uint len;
+} VRingUsed;
+
+typedef struct
+{
+    uint type;
+    uint reserved;
+    uint sector;
+    uint sectorHi;
+} VBlkHeader;
+
+typedef struct
+{
+    uint si;
+    uint n;
+    uint write;
+    uint batch;
+    uint tail;
+    uint segs;
+    uint state;
+    IOSpan span;
+} VBlkReq;
+
+typedef struct
+{
+    Queue wait;
+    uint value;
+    uint left;
+    uint failed;
+    uint state;
+    BlkDone done;
+    void* arg;
+} VBlkBatch;
+
+static ushort gBase = 0;
+static uint gIrq = -1;
+static uint gSectors = 0;
+static uint gFeatures = 0;
+static uint gQSize = 0;
+static volatile VRingDesc* gDesc = NULL;
+static volatile ushort* gAvail = NULL;
+static volatile ushort* gUsedHdr = NULL;
+static volatile VRingUsed* gUsed = NULL;
+static ushort gUsedIdx = 0;
+static ushort gFree = VB_NONE;
+static uint gFreeNum = 0;
+static VBlkHeader gHdr[VB_DESC_MAX] = {0};
+static volatile byte gStatus[VB_DESC_MAX] = {0};
+static VBlkReq gReq[VB_DESC_MAX] = {0};
+static VBlkBatch gBatch[VB_BATCH_MAX] = {0};
+static uint gOpen = VB_BATCH_MAX;
+static uint gLast = VB_NONE;
+static uint gSyncDone = 0;
+static uint gSyncOk = 0;
+static byte* gBounce = NULL;
+static uint gStat = IOSTAT_DEV_MAX;
+
+static void Barrier()
+{
+    asm volatile("" : : : "memory");
+}
+
+static uint AllocDesc()
+{
+    uint ret = gFree;
+    
+    gFree = gDesc[ret].next;
+    gFreeNum--;
+    
+    return ret;
+}
+
+static void FreeChain(uint head)
+{
+    uint i = head;
+    uint more = 1;
+    
+    while( more )
+    {
+        uint next = gDesc[i].next;
+        
+        more = gDesc[i].flags & VRING_F_NEXT;
+        
+        gDesc[i].flags = 0;
+        gDesc[i].next = gFree;
+        
+        gFree = i;
+        gFreeNum++;
+        
+        i = next;
+    }
+}
+
+static void SetDesc(uint i, void* addr, uint len, uint flags, uint next)
+{
+    gDesc[i].addr = (uint)addr;
+    gDesc[i].addrHi = 0;
+    gDesc[i].len = len;
+    gDesc[i].flags = flags;
+    gDesc[i].next = next;
+}
+
+static uint Build(uint type, uint si, byte* buf, uint n, uint batch)
+{
+    uint h = AllocDesc();
+    uint s = 0;
+    uint d = 0;
+    
+    gHdr[h].type = type;
+    gHdr[h].reserved = 0;
+    gHdr[h].sector = si;
+    gHdr[h].sectorHi = 0;
+    
+    gStatus[h] = 0xFF;
+    
+    if( n )
+    {
+        d = AllocDesc();
+        s = AllocDesc();
+        
+        SetDesc(h, &gHdr[h], sizeof(VBlkHeader), VRING_F_NEXT, d);
+        SetDesc(d, buf, n * SECT_SIZE, VRING_F_NEXT | ((type == VBLK_T_IN) ? VRING_F_WRITE : 0), s);
+    }
+    else
+    {
+        s = AllocDesc();
+        
+        SetDesc(h, &gHdr[h], sizeof(VBlkHeader), VRING_F_NEXT, s);
+    }
+    
+    SetDesc(s, (void*)&gStatus[h], 1, VRING_F_WRITE, 0);
+    
+    gReq[h].si = si;
+    gReq[h].n = n;
+    gReq[h].write = (type == VBLK_T_OUT);
+    gReq[h].batch = batch;
+    gReq[h].tail = d;
+    gReq[h].segs = 1;
+    gReq[h].state = 1;
+    
+    if( n )
+    {
+        IOStatBegin(gStat, &gReq[h].span);
+    }
+    
+    return h;
+}
+
+static void Append(uint h, byte* buf, uint n)
+{
+    VBlkReq* req = &gReq[h];
+    uint d = AllocDesc();
+    uint s = gDesc[req->tail].next;
+    
+    SetDesc(d, buf, n * SECT_SIZE, VRING_F_NEXT | (req->write ? 0 : VRING_F_WRITE), s);
+    
+    gDesc[req->tail].next = d;
+    
+    req->tail = d;
+    req->n += n;
+    req->segs++;
+}
+
+static void Publish(uint h)
+{
+    ushort idx = gAvail[1];
+    
+    gAvail[2 + idx % gQSize] = h;
+    
+    Barrier();
+    
+    gAvail[1] = idx + 1;
+    
+    gReq[h].state = 2;
+}
+
+static void PublishAll()
+{
+    uint i = 0;
+    uint any = 0;
+    
+    for(i=0; i<VB_DESC_MAX; i++)
+    {
+        if( gReq[i].state == 1 )
+        {
+            Publish(i);
+            
+            any = 1;
+        }
+    }
+    
+    if( any )
+    {
+        Barrier();
+        
+        WritePortS(gBase + VIO_QUEUE_NOTIFY, 0);
+    }
+    
+    gLast = VB_NONE;
+}
+
+static void Wake(VBlkBatch* b)
+{
+    Event evt = {DiskEvent, (uint)&b->wait, b->failed ? -1 : b->value, 0};
+    
+    b->state = 0;
+    
+    if( b->done )
+    {
+        b->done(b->arg, !b->failed);
+    }
+    else
+    {
+        EventSchedule(NOTIFY, &evt);
+    }
+}
+
+static void Complete(uint h)
+{
+    VBlkReq* req = &gReq[h];
+    uint ok = (gStatus[h] == 0);
+    
+    if( req->n )
+    {
+        IOStatEnd(gStat, &req->span, req->si, req->n, (req->write ? IO_WRITE : IO_READ) | ((req->batch < VB_BATCH_MAX) ? IO_ASYNC : 0), ok);
+    }
+    
+    if( req->batch < VB_BATCH_MAX )
+    {
+        VBlkBatch* b = &gBatch[req->batch];
+        
+        b->failed = b->failed || !ok;
+        b->left--;
+        
+        if( !b->left && (b->state == 2) )
+        {
+            Wake(b);
+        }
+    }
+    else
+    {
+        gSyncDone = 1;
+        gSyncOk = ok;
+    }
+    
+    req->state = 0;
+    
+    FreeChain(h);
+}
+
+static void Reap()
+{
+    Barrier();
+    
+    while( gUsedIdx != gUsedHdr[1] )
+    {
+        uint h = gUsed[gUsedIdx % gQSize].id;
+        
+        if( (h < VB_DESC_MAX) && (gReq[h].state == 2) )
+        {
+            Complete(h);
+        }
+        
+        gUsedIdx++;
+    }
+}
+
+static uint Overlaps(uint si, uint n)
+{
+    uint ret = 0;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<VB_DESC_MAX); i++)
+    {
+        VBlkReq* req = &gReq[i];
+        
+        ret = req->state && (si < req->si + req->n) && (req->si < si + n);
+    }
+    
+    return ret;
+}
+
+static uint Busy()
+{
+    uint ret = 0;
+    uint i = 0;
+    
+    for(i=0; !ret && (i<VB_DESC_MAX); i++)
+    {
+        ret = gReq[i].state;
+    }
+    
+    return ret;
+}
+
+static void Settle(uint si, uint n, uint desc)
+{
+    uint i = 0;
+    
+    if( Overlaps(si, n) || (gFreeNum < desc) )
+    {
+        PublishAll();
+        
+        while( (Overlaps(si, n) || (gFreeNum < desc)) && (++i < VB_SPIN_MAX) )
+        {
+            Reap();
+        }
+    }
+}
+
+static uint Run(uint type, uint si, byte* buf, uint n)
+{
+    uint i = 0;
+    
+    Settle(si, n, 3);
+    
+    gSyncDone = 0;
+    gSyncOk = 0;
+    
+    if( gFreeNum >= 3 )
+    {
+        Build(type, si, buf, n, VB_BATCH_MAX);
+        
+        PublishAll();
+        
+        while( !gSyncDone && (++i < VB_SPIN_MAX) )
+        {
+            Reap();
+        }
+        
+        IOStatWait(gStat, NULL, !gSyncDone);
+    }
+    
+    return gSyncOk;
+}
+
+static uint VBlkSectors(const BlkDev* dev)
+{
+    return gSectors;
+}
+
+static uint CanDma(byte* buf, uint n)
+{
+    return ((uint)buf + n * SECT_SIZE <= FMapBase);
+}
+
+static uint Transfer(uint type, uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( CanDma(buf, n) )
+    {
+        ret = Run(type, si, buf, n) ? n : 0;
+    }
+    else if( gBounce || (gBounce = Malloc(SECT_SIZE)) )
+    {
+        uint ok = 1;
+        
+        for(ret=0; ok && (ret<n); ret+=ok)
+        {
+            byte* p = AddrOff(buf, ret * SECT_SIZE);
+            
+            if( type == VBLK_T_OUT )
+            {
+                MemCpy(gBounce, p, SECT_SIZE);
+            }
+            
+            ok = Run(type, si + ret, gBounce, 1);
+            
+            if( ok && (type == VBLK_T_IN) )
+            {
+                MemCpy(p, gBounce, SECT_SIZE);
+            }
+        }
+    }
+    
+    return ret;
+}
+
+static uint VBlkRead(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        ret = Transfer(VBLK_T_IN, si, buf, n);
+    }
+    
+    return ret;
+}
+
+static uint VBlkWrite(const BlkDev* dev, uint si, byte* buf, uint n)
+{
+    uint ret = 0;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf )
+    {
+        ret = Transfer(VBLK_T_OUT, si, buf, n);
+    }
+    
+    return ret;
+}
+
+static uint VBlkFlush(const BlkDev* dev)
+{
+    uint i = 0;
+    
+    PublishAll();
+    
+    while( Busy() && (++i < VB_SPIN_MAX) )
+    {
+        Reap();
+    }
+    
+    return !(gFeatures & VBLK_F_FLUSH) || Run(VBLK_T_FLUSH, 0, NULL, 0);
+}
+
+static uint NewBatch()
+{
+    uint ret = 0;
+    
+    while( (ret < VB_BATCH_MAX) && gBatch[ret].state )
+    {
+        ret++;
+    }
+    
+    if( ret < VB_BATCH_MAX )
+    {
+        gBatch[ret].state = 1;
+        gBatch[ret].left = 0;
+        gBatch[ret].failed = 0;
+        gBatch[ret].done = NULL;
+    }
+    
+    return ret;
+}
+
+static uint VBlkQueue(const BlkDev* dev, uint si, byte* buf, uint n, uint write)
+{
+    uint ret = 0;
+    VBlkReq* last = (gLast != VB_NONE) ? &gReq[gLast] : NULL;
+    
+    if( n && (si < gSectors) && (n <= gSectors - si) && buf && CanDma(buf, n) )
+    {
+        if( last && (last->state == 1) && (last->si + last->n == si) && (last->write == write) && (last->segs < VB_SEG_MAX) && gFreeNum && !Overlaps(si, n) )
+        {
+            Append(gLast, buf, n);
+            
+            ret = n;
+        }
+        else
+        {
+            if( Overlaps(si, n) )
+            {
+                Settle(si, n, 0);
+            }
+            
+            if( (gFreeNum >= 3) && ((gOpen < VB_BATCH_MAX) || ((gOpen = NewBatch()) < VB_BATCH_MAX)) )
+            {
+                gLast = Build(write ? VBLK_T_OUT : VBLK_T_IN, si, buf, n, gOpen);
+                gBatch[gOpen].left++;
+                
+                ret = n;
+            }
+        }
+    }
+    
+    return ret;
+}
+
+static uint VBlkSubmit(const BlkDev* dev, uint* result, uint value)
+{
+    uint ret = 0;
+    VBlkBatch* b = (gOpen < VB_BATCH_MAX) ? &gBatch[gOpen] : NULL;
+    Event* evt = NULL;
+    
+    gOpen = VB_BATCH_MAX;
+    
+    PublishAll();
+    
+    if( b && b->left && (gIrq < 16) && result && (evt = CreateEvent(DiskEvent, (uint)&b->wait, (uint)result, 0)) )
+    {
+        b->value = value;
+        b->state = 2;
+        
+        EventSchedule(WAIT, evt);
+        
+        ret = 1;
+    }
+    else if( b )
+    {
+        uint i = 0;
+        
+        while( b->left && (++i < VB_SPIN_MAX) )
+        {
+            Reap();
+        }
+        
+        if( result && (b->failed || b->left) )
+        {
+            *result = -1;
+        }
+        
+        b->state = 0;
+    }
+    
+    return ret;
+}
+
+static void VBlkStart(const BlkDev* dev, BlkDone done, void* arg)
+{
+    VBlkBatch* b = (gOpen < VB_BATCH_MAX) ? &gBatch[gOpen] : NULL;
+    
+    gOpen = VB_BATCH_MAX;
+    
+    PublishAll();
+    
+    if( b && b->left && (gIrq < 16) )
+    {
+        b->done = done;
+        b->arg = arg;
+        b->state = 2;
+    }
+    else
+    {
+        uint i = 0;
+        
+        while( b && b->left && (++i < VB_SPIN_MAX) )
+        {
+            Reap();
+        }
+        
+        if( b )
+        {
+            b->state = 0;
+        }
+        
+        done(arg, !(b && (b->failed || b->left)));
+    }
+}
+
+static const BlkDev gVBlk = {"vd", NULL, VBlkSectors, VBlkRead, VBlkWrite, VBlkFlush, VBlkQueue, VBlkSubmit, VBlkStart};
+
+static uint SetupQueue()
+{
+    uint ret = 0;
+    uint avail = 0;
+    uint used = 0;
+    uint size = 0;
+    byte* mem = NULL;
+    uint i = 0;
+    
+    WritePortS(gBase + VIO_QUEUE_SEL, 0);
+    
+    gQSize = ReadPortS(gBase + VIO_QUEUE_SIZE);
+    
+    avail = gQSize * sizeof(VRingDesc);
+    used = (avail + 6 + 2 * gQSize + VRING_ALIGN - 1) / VRING_ALIGN * VRING_ALIGN;
+    size = used + 6 + 8 * gQSize;
+    
+    if( gQSize && (mem = Malloc(size + VRING_ALIGN)) )
+    {
+        byte* ring = (byte*)(((uint)mem + VRING_ALIGN - 1) / VRING_ALIGN * VRING_ALIGN);
+        
+        MemSet(ring, 0, size);
+        
+        gDesc = (VRingDesc*)ring;
+        gAvail = (ushort*)AddrOff(ring, avail);
+        gUsedHdr = (ushort*)AddrOff(ring, used);
+        gUsed = (VRingUsed*)AddrOff(ring, used + 4);
+        
+        for(i=0; i<Min(gQSize, VB_DESC_MAX); i++)
+        {
+            gDesc[i].next = gFree;
+            gFree = i;
+            gFreeNum++;
+        }
+        
+        WritePortL(gBase + VIO_QUEUE_PFN, (uint)ring / VRING_ALIGN);
+        
+        ret = 1;
+    }
+    
+    return ret;
+}
+
+void VBlkModInit()
+{
+    uint dev = PCIFindId(VIRTIO_VENDOR, VIRTIO_BLK_LEGACY);
+    uint i = 0;
+    
+    if( dev && (PCIRead(dev, PCI_BAR0) & 1) )
+    {
+        gBase = PCIRead(dev, PCI_BAR0) & 0xFFFC;
+        
+        PCIWrite(dev, PCI_COMMAND, PCIRead(dev, PCI_COMMAND) | 0x05);
+        
+        WritePort(gBase + VIO_STATUS, 0);
+        WritePort(gBase + VIO_STATUS, VIO_ACK | VIO_DRIVER);
+        
+        gFeatures = ReadPortL(gBase + VIO_DEV_FEATURES) & VBLK_F_FLUSH;
+        
+        WritePortL(gBase + VIO_GUEST_FEATURES, gFeatures);
+        
+        if( SetupQueue() )
+        {
+            gSectors = ReadPortL(gBase + VIO_BLK_CAPACITY + 4) ? -2 : ReadPortL(gBase + VIO_BLK_CAPACITY);
+            gIrq = PCIRead(dev, PCI_IRQ_LINE) & 0xFF;
+            gStat = IOStatAdd(gVBlk.name);
+            
+            AddDiskIrq(gIrq);
+            
+            WritePort(gBase + VIO_STATUS, VIO_ACK | VIO_DRIVER | VIO_DRIVER_OK);
+        }
+    }
+    
+    for(i=0; i<VB_BATCH_MAX; i++)
+    {
+        Queue_Init(&gBatch[i].wait);
+    }
+}
+
+const BlkDev* VBlkDevice()
+{
+    return gSectors ? &gVBlk : NULL;
+}
+
+void VBlkIrq()
+{
+    if( gBase )
+    {
+        ReadPort(gBase + VIO_ISR);
+        
+        Reap();
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef VBLK_H
+#define VBLK_H
+
+#include "blkdev.h"
+
+void VBlkModInit();
+const BlkDev* VBlkDevice();
+void VBlkIrq();
+
+#endif